@@ -0,0 +1,389 @@
+#include "NativeFlash.h"
+#include "SensorFile.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Replays storage workloads of the sensor nodes and gateway on the host-native flash backend, and
+// reports the latency of the storage operations along with the flash operations they caused.
+// Latencies are measured on the host: they are only meaningful relative to other runs.
+
+using namespace mirra;
+
+namespace
+{
+/// @brief Label of the partition used by the SensorFile.
+constexpr const char* dataPartition = "data";
+/// @brief Default comm and sample intervals of the gateway (see gateway/config.h).
+constexpr uint32_t commInterval = 60 * 60;
+constexpr uint32_t sampleInterval = 20 * 60;
+/// @brief Maximum amount of entries per node per comm period (see MAX_ENTRIES in gateway.h).
+constexpr size_t maxEntries(uint32_t commInterval, uint32_t sampleInterval)
+{
+    return (3 * commInterval / (2 * sampleInterval)) + 1;
+}
+/// @brief Maximum amount of nodes per gateway (see MAX_SENSOR_NODES in gateway/config.h).
+constexpr size_t maxSensorNodes = 35;
+/// @brief Amount of values sampled by a typical sensor node.
+constexpr uint8_t typicalNValues = 8;
+
+std::mt19937 random{0x4D495252};
+
+/// @brief Latencies of a single operation, in microseconds.
+class Latencies
+{
+    const char* name;
+    std::vector<double> samples;
+
+public:
+    Latencies(const char* name) : name{name} {}
+
+    template <class F> void measure(F&& operation)
+    {
+        auto start{std::chrono::steady_clock::now()};
+        operation();
+        std::chrono::duration<double, std::micro> duration{std::chrono::steady_clock::now() -
+                                                           start};
+        samples.push_back(duration.count());
+    }
+
+    void print() const
+    {
+        if (samples.empty())
+            return;
+        std::vector<double> sorted{samples};
+        std::sort(sorted.begin(), sorted.end());
+        double sum{0};
+        for (double sample : sorted)
+            sum += sample;
+        auto percentile = [&sorted](double p) {
+            return sorted[static_cast<size_t>(p * (sorted.size() - 1))];
+        };
+        printf("  %-8s n=%-7zu mean=%9.1fus p50=%9.1fus p99=%9.1fus max=%9.1fus\n", name,
+               sorted.size(), sum / sorted.size(), percentile(0.5), percentile(0.99),
+               sorted.back());
+    }
+};
+
+/// @brief Prints the flash operations performed on a partition, the wear distribution over its
+/// sectors and the writes to NVS since the workload started.
+/// @param payload Amount of bytes of data stored by the workload, for the write amplification.
+void printFlash(const char* label, size_t payload)
+{
+    const std::vector<native::SectorCounters>& counters{native::getSectorCounters(label)};
+    size_t erases{0}, programmed{0}, read{0};
+    std::vector<size_t> wear;
+    for (const native::SectorCounters& sector : counters)
+    {
+        erases += sector.erases;
+        programmed += sector.bytesProgrammed;
+        read += sector.bytesRead;
+        wear.push_back(sector.erases);
+    }
+    std::sort(wear.begin(), wear.end());
+    printf("  flash    erases=%zu programmed=%zuKB read=%zuKB payload=%zuKB amplification=%.2f\n",
+           erases, programmed / 1024, read / 1024, payload / 1024,
+           payload ? static_cast<double>(programmed) / payload : 0.0);
+    printf("  nvs      writes=%zu\n", native::getNVSWrites());
+    printf("  wear     min=%zu p50=%zu p90=%zu max=%zu mean=%.2f erases/sector over %zu sectors\n",
+           wear.front(), wear[wear.size() / 2], wear[wear.size() * 9 / 10], wear.back(),
+           static_cast<double>(erases) / wear.size(), wear.size());
+}
+
+void prepare(const char* workload)
+{
+    printf("%s\n", workload);
+    nvs_flash_erase();
+    native::resetPartition(dataPartition);
+}
+
+/// @return Whether the entry holds samples, rather than aggregates of compacted entries.
+bool isSample(const SensorFile::DataEntry& entry)
+{
+    return entry.flags.nValues == 0 ||
+           SensorFile::getStatistic(entry.values[0]) == SensorFile::Statistic::SAMPLE;
+}
+
+/// @brief Creates an entry of slowly varying values following a daily cycle, with some noise,
+/// quantised to the 1/16 resolution typical of digital sensors.
+SensorFile::DataEntry createEntry(const MACAddress& source, uint32_t time, uint8_t nValues)
+{
+    std::normal_distribution<float> noise{0, 0.25};
+    SensorFile::DataEntry::SensorValueArray values{};
+    for (uint8_t i{0}; i < nValues; i++)
+    {
+        float value{10 * i + 5 * std::sin(2 * static_cast<float>(M_PI) * time / (24 * 60 * 60) + i) +
+                    noise(random)};
+        values[i] = SensorValue(i, 0, std::round(value * 16) / 16);
+    }
+    return SensorFile::DataEntry{source, time, SensorFile::DataEntry::Flags{nValues, false}, values};
+}
+
+MACAddress createMAC(size_t index)
+{
+    uint8_t address[MACAddress::length]{0x24, 0x0A, 0xC4, 0x00, 0x00, static_cast<uint8_t>(index)};
+    return MACAddress(address);
+}
+
+/// @brief A sensor node sampling and communicating every hour for a year. Every sample and every
+/// comm period is a separate wake from deep sleep, opening the data file anew.
+void sensorNodeYear()
+{
+    prepare("sensor node: hourly samples and comm periods for a year");
+    Latencies sample{"sample"}, comm{"comm"};
+    MACAddress mac{createMAC(0)};
+    size_t payload{0};
+    size_t nEntries{maxEntries(60 * 60, 60 * 60)};
+    for (uint32_t hour{0}; hour < 365 * 24; hour++)
+    {
+        SensorFile::DataEntry entry{createEntry(mac, hour * 60 * 60, typicalNValues)};
+        payload += entry.getSize();
+        sample.measure([&entry] {
+            SensorFile file{};
+            file.push(entry);
+        });
+        comm.measure([nEntries] {
+            SensorFile file{};
+            SensorFile::Iterator it{file.unuploaded()};
+            for (size_t i{0}; i < nEntries && it != file.end(); i++)
+            {
+                SensorFile::Iterator next{it};
+                ++next;
+                file.setUploaded(it.getAddress());
+                it = next;
+            }
+        });
+    }
+    sample.print();
+    comm.print();
+    printFlash(dataPartition, payload);
+    SensorFile file{};
+    printf("  stored   %zuKB\n", file.getSize() / 1024);
+    // every wake recovers the FIFO state anew, from the sector headers or the mark log
+    size_t entries{0}, uploaded{0};
+    for (const SensorFile::DataEntry& entry : file)
+    {
+        entries++;
+        uploaded += entry.flags.uploaded;
+    }
+    if (entries != 365 * 24 || uploaded != 365 * 24)
+        printf("  ERROR: %zu entries recovered, %zu uploaded\n", entries, uploaded);
+}
+
+/// @brief A fully loaded gateway for a month: every comm period, all nodes send their maximum
+/// amount of messages, which are stored at once and uploaded afterwards.
+void gatewayBursts()
+{
+    prepare("gateway: bursts of 35 nodes x MAX_ENTRIES every comm period for a month");
+    Latencies store{"store"}, upload{"upload"};
+    size_t nEntries{maxEntries(commInterval, sampleInterval)};
+    size_t payload{0}, uploaded{0};
+    for (uint32_t period{0}; period < 30 * 24 * 60 * 60 / commInterval; period++)
+    {
+        std::vector<Message<SENSOR_DATA>> data;
+        for (size_t node{0}; node < maxSensorNodes; node++)
+        {
+            for (size_t i{0}; i < nEntries; i++)
+            {
+                SensorFile::DataEntry entry{createEntry(
+                    createMAC(node), period * commInterval + i * sampleInterval, typicalNValues)};
+                data.emplace_back(entry.source, MACAddress(), uint32_t{entry.time},
+                                  uint8_t{entry.flags.nValues}, entry.values);
+                payload += entry.getSize();
+            }
+        }
+        store.measure([&data] {
+            SensorFile file{};
+            for (const Message<SENSOR_DATA>& m : data)
+                file.push(m);
+        });
+        upload.measure([&uploaded] {
+            SensorFile file{};
+            for (auto it{file.unuploaded()}; it != file.end(); ++it)
+            {
+                file.setUploaded(it.getAddress());
+                uploaded++;
+            }
+        });
+    }
+    store.print();
+    upload.print();
+    printFlash(dataPartition, payload);
+    printf("  uploaded %zu entries\n", uploaded);
+}
+
+/// @brief A fully loaded gateway without connection to the MQTT server for a week, after which
+/// the backlog is looked up at increasing depths, as when sending it out in windows.
+void gatewayOutage()
+{
+    prepare("gateway outage: a week of bursts, then lookups into the backlog");
+    Latencies lookup{"lookup"};
+    size_t nEntries{maxEntries(commInterval, sampleInterval)};
+    {
+        SensorFile file{};
+        for (uint32_t period{0}; period < 7 * 24 * 60 * 60 / commInterval; period++)
+        {
+            for (size_t node{0}; node < maxSensorNodes; node++)
+            {
+                for (size_t i{0}; i < nEntries; i++)
+                    file.push(createEntry(createMAC(node),
+                                          period * commInterval + i * sampleInterval,
+                                          typicalNValues));
+            }
+        }
+    }
+    auto bytesRead = [] {
+        size_t read{0};
+        for (const native::SectorCounters& sector : native::getSectorCounters(dataPartition))
+            read += sector.bytesRead;
+        return read;
+    };
+    size_t readBefore{bytesRead()};
+    SensorFile file{};
+    size_t found{0};
+    for (size_t index{0}; index < 64 * 1024; index += 97)
+        lookup.measure([&file, &found, index] { found += file.getUnuploadedAddress(index) ? 1 : 0; });
+    lookup.print();
+    printf("  flash    read=%zuKB\n", (bytesRead() - readBefore) / 1024);
+    printf("  found %zu entries\n", found);
+}
+
+/// @brief A sensor node sampling every five minutes that never reaches its gateway for three years.
+/// Once the file is full, the oldest entries are compacted into hourly and later daily aggregates.
+void retention()
+{
+    prepare("retention: 5-minute samples of a sensor node without gateway for three years");
+    Latencies sample{"sample"};
+    MACAddress mac{createMAC(0)};
+    size_t payload{0};
+    constexpr uint32_t interval{5 * 60};
+    uint32_t time{0};
+    for (; time < 3 * 365 * 24 * 60 * 60; time += interval)
+    {
+        SensorFile::DataEntry entry{createEntry(mac, time, typicalNValues)};
+        payload += entry.getSize();
+        sample.measure([&entry] {
+            SensorFile file{};
+            file.push(entry);
+        });
+    }
+    sample.print();
+    printFlash(dataPartition, payload);
+    // oldest time held as samples, hourly and daily aggregates
+    std::array<uint32_t, 3> oldest{time, time, time};
+    std::array<size_t, 3> counts{};
+    for (const SensorFile::DataEntry& entry : SensorFile{})
+    {
+        size_t tier{0};
+        if (!isSample(entry))
+            tier = entry.values[0].instanceTag & SensorFile::dailyTag ? 2 : 1;
+        oldest[tier] = std::min(oldest[tier], entry.time);
+        counts[tier]++;
+    }
+    const char* names[]{"samples", "hourly", "daily"};
+    for (size_t tier{0}; tier < 3; tier++)
+        printf("  %-8s n=%-7zu reaching %.1f days back\n", names[tier], counts[tier],
+               (time - oldest[tier]) / (24.0 * 60 * 60));
+}
+
+/// @brief A full data file of a gateway walked from tail to head, as when dumping it over serial.
+void fullScan()
+{
+    prepare("full scan: a full gateway data file walked from tail to head");
+    Latencies scan{"scan"};
+    size_t nEntries{maxEntries(commInterval, sampleInterval)};
+    {
+        SensorFile file{};
+        for (uint32_t period{0}; file.getSize() + 4096 < file.getMaxSize(); period++)
+        {
+            for (size_t node{0}; node < maxSensorNodes; node++)
+            {
+                for (size_t i{0}; i < nEntries; i++)
+                    file.push(createEntry(createMAC(node),
+                                          period * commInterval + i * sampleInterval,
+                                          typicalNValues));
+            }
+        }
+    }
+    SensorFile file{};
+    size_t entries{0};
+    for (size_t run{0}; run < 8; run++)
+    {
+        entries = 0;
+        scan.measure([&file, &entries] {
+            for (const SensorFile::DataEntry& entry : file)
+                entries += entry.flags.nValues > 0;
+        });
+    }
+    scan.print();
+    printf("  %zu entries in %zuKB\n", entries, file.getSize() / 1024);
+}
+
+/// @brief Entries pushed into a file that is kept open, wrapping around several times, changing to
+/// a random size every 64 entries. Every push into a full file cuts entries from the tail. The
+/// entries kept are checked against the ones pushed.
+void wrapAround()
+{
+    prepare("wrap-around: entries of random sizes pushed until the file wrapped 4 times");
+    Latencies push{"push"}, flush{"flush"};
+    std::uniform_int_distribution<unsigned> nValues{1, Message<SENSOR_DATA>::maxNValues};
+    MACAddress mac{createMAC(0)};
+    size_t payload{0};
+    size_t entries{0}, aggregates{0};
+    {
+        std::vector<SensorFile::DataEntry> pushed;
+        SensorFile file{};
+        for (uint32_t time{0}; payload < 4 * file.getMaxSize(); time++)
+        {
+            uint8_t n{static_cast<uint8_t>(time % 64 == 0 ? nValues(random) : 0)};
+            SensorFile::DataEntry entry{createEntry(
+                mac, time * sampleInterval, n ? n : pushed.back().flags.nValues)};
+            payload += entry.getSize();
+            push.measure([&file, &entry] { file.push(entry); });
+            pushed.push_back(entry);
+            if (time % 16 == 15)
+                flush.measure([&file] { file.flush(); });
+        }
+        // nothing is uploaded, so entries cut from the tail are compacted into aggregates
+        for (const SensorFile::DataEntry& entry : file)
+        {
+            if (isSample(entry))
+                entries++;
+            else
+                aggregates++;
+        }
+        // the file holds the most recently pushed entries
+        size_t index{pushed.size() - entries};
+        for (const SensorFile::DataEntry& entry : file)
+        {
+            if (!isSample(entry))
+                continue;
+            if (std::memcmp(&entry, &pushed[index], entry.getSize()) != 0)
+                printf("  ERROR: entry %zu decoded wrongly\n", index);
+            index++;
+        }
+    }
+    push.print();
+    flush.print();
+    printFlash(dataPartition, payload);
+    printf("  %zu entries and %zu aggregates kept\n", entries, aggregates);
+}
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        native::setFlashDirectory(argv[1]);
+    fs::NVS::init();
+    sensorNodeYear();
+    gatewayBursts();
+    gatewayOutage();
+    fullScan();
+    retention();
+    wrapAround();
+    return 0;
+}
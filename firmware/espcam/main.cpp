@@ -77,7 +77,7 @@ void takePicture(void)
 
     if (psramFound())
     {
-        Log::debug("PSRAM found");
+        LOG_DEBUG(SENSORS, "PSRAM found");
         config.frame_size = FRAMESIZE_SXGA; // FRAMESIZE_ + QVGA|CIF|VGA|SVGA|XGA|SXGA|UXGA
         config.jpeg_quality = 10;
         config.fb_count = 1;
@@ -97,30 +97,30 @@ void takePicture(void)
     esp_err_t err = esp_camera_init(&config);
     if (err != ESP_OK)
     {
-        Log::error("Camera init failed with error ", static_cast<uint32_t>(err));
+        LOG_ERROR(SENSORS, "Camera init failed with error ", static_cast<uint32_t>(err));
         pictureSuccess = false;
         return;
     }
     else
     {
-        Log::info("Camera init OK.");
+        LOG_INFO(SENSORS, "Camera init OK.");
         pictureSuccess = true;
     }
-    Log::info("Starting SD Card");
+    LOG_INFO(SENSORS, "Starting SD Card");
     delay(500);
 
     // delay(1000);
     if (!SD_MMC.begin("/sdcard", true, false))
     { // Using ("/sdcard", true) sets mode1bit to true: sets SD card to '1_wire' mode: only uses
       // GPIO2 to read and write data to SD
-        Log::error("SD Card Mount Failed");
+        LOG_ERROR(SENSORS, "SD Card Mount Failed");
         delay(500);
     }
 
     uint8_t cardType = SD_MMC.cardType();
     if (cardType == CARD_NONE)
     {
-        Log::error("No SD Card attached");
+        LOG_ERROR(SENSORS, "No SD Card attached");
         pictureSuccess = false;
         return;
     }
@@ -134,7 +134,7 @@ void takePicture(void)
     constexpr size_t datetimeStringLength{sizeof("0000-00-00 00_00_00")};
     datetimeString.reserve(datetimeStringLength);
     strftime(datetimeString.begin(), datetimeStringLength, "%Y-%m-%d %H_%M_%S", &timeinfo);
-    Log::debug("Current datetime:", datetimeString.c_str());
+    LOG_DEBUG(SENSORS, "Current datetime:", datetimeString.c_str());
     delay(500);
 
     camera_fb_t* fb = NULL;
@@ -203,7 +203,7 @@ void takePicture(void)
             fb = esp_camera_fb_get();
             if (!fb)
             {
-                Log::error("Camera capture failed");
+                LOG_ERROR(SENSORS, "Camera capture failed");
                 pictureSuccess = false;
                 return;
             }
@@ -212,19 +212,19 @@ void takePicture(void)
             String path2 = "/" + datetimeString + "_" + b_s + "11_" + ae_s + ".jpg";
 
             fs::FS& fs = SD_MMC;
-            Log::debug("Picture file name: ", path2.c_str());
+            LOG_DEBUG(SENSORS, "Picture file name: ", path2.c_str());
 
             File file2 = fs.open(path2.c_str(), FILE_WRITE);
             if (!file2)
             {
-                Log::error("Failed to open file in writing mode");
+                LOG_ERROR(SENSORS, "Failed to open file in writing mode");
                 pictureSuccess = false;
                 return;
             }
             else
             {
                 file2.write(fb->buf, fb->len); // payload (image), payload length
-                Log::info("Saved file to path: ", path2.c_str());
+                LOG_INFO(SENSORS, "Saved file to path: ", path2.c_str());
             }
 
             file2.close();
@@ -270,13 +270,13 @@ void setup()
     }
     sntp_set_sync_mode(SNTP_SYNC_MODE_IMMED);
 
-    Log::debug("Setup done.");
+    LOG_DEBUG(SENSORS, "Setup done.");
     Serial.flush();
 }
 
 void loop()
 {
-    Log::debug("Cycle started");
+    LOG_DEBUG(SENSORS, "Cycle started");
     int64_t timeout{esp_timer_get_time() + 15 * 1000 * 1000};
     while (!Serial.available() && timeout > esp_timer_get_time())
         ;
@@ -291,36 +291,36 @@ void loop()
     switch (cmd)
     {
     case ESPCamCodes::SET_TIME:
-        Log::info("ESPCam::SET_TIME");
+        LOG_INFO(SENSORS, "ESPCam::SET_TIME");
         Serial.readBytes((uint8_t*)&owi_time, sizeof(owi_time));
-        Log::info(owi_time);
+        LOG_INFO(SENSORS, owi_time);
         owi_time_value = {owi_time, 0};
         sntp_sync_time(&owi_time_value);
         delay(100);
         sntp_sync_time(&owi_time_value);
         break;
     case ESPCamCodes::GET_TIME:
-        Log::info("ESPCam::GET_TIME");
+        LOG_INFO(SENSORS, "ESPCam::GET_TIME");
         break;
     case ESPCamCodes::GET_STATUS:
-        Log::info("ESPCam::GET_STATUS");
+        LOG_INFO(SENSORS, "ESPCam::GET_STATUS");
         if (pictureSuccess)
         {
-            Log::info("SUCCESS PRINT");
+            LOG_INFO(SENSORS, "SUCCESS PRINT");
             // digitalWrite(stat_pin, HIGH);
         }
         else
         {
-            Log::info("FAIL PRINT");
+            LOG_INFO(SENSORS, "FAIL PRINT");
             // digitalWrite(stat_pin, LOW);
         }
         break;
     case ESPCamCodes::TAKE_PICTURE:
-        Log::info("ESPCam::TAKE_PICTURE");
+        LOG_INFO(SENSORS, "ESPCam::TAKE_PICTURE");
         takePicture();
     case ESPCamCodes::ENABLE_SLEEP:
         // switch case fallthrough intended!
-        Log::info("ESPCam::ENABLE_SLEEP");
+        LOG_INFO(SENSORS, "ESPCam::ENABLE_SLEEP");
         Serial.flush();
         Serial.end();
         Log::log.close();
@@ -329,7 +329,7 @@ void loop()
         esp_deep_sleep_start();
         break;
     default:
-        Log::info("ESPCam::INVALID");
+        LOG_INFO(SENSORS, "ESPCam::INVALID");
         break;
     }
 }
\ No newline at end of file
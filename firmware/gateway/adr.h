@@ -0,0 +1,45 @@
+#ifndef __ADR_H__
+#define __ADR_H__
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+namespace mirra
+{
+/// @brief Adaptive data rate: picks the fastest spreading factor, then the lowest output power,
+/// that keep a margin above the SNR required by the spreading factor. Links below the margin
+/// first raise their output power, then their spreading factor.
+struct LinkAdaptation
+{
+    /// @brief Fastest (default) and most robust spreading factor that may be assigned.
+    uint8_t minSpreadingFactor, maxSpreadingFactor;
+    /// @brief Range of the output power in dBm that may be assigned.
+    int8_t minPower, maxPower;
+    /// @brief Link margin in dB kept above the SNR required by the spreading factor.
+    float margin;
+    /// @brief Margin in dB traded per step of spreading factor or output power.
+    int8_t step;
+
+    /// @param headroom SNR in dB of the node's messages above the SNR required by the spreading
+    /// factor they were sent with.
+    /// @return The spreading factor and output power for the next comm period.
+    std::pair<uint8_t, int8_t> adapt(uint8_t spreadingFactor, int8_t power, float headroom) const
+    {
+        // steps that the link is above (positive) or below (negative) the margin
+        int steps{static_cast<int>(std::floor((headroom - margin) / step))};
+        for (; steps > 0 && spreadingFactor > minSpreadingFactor; steps--)
+            spreadingFactor--;
+        for (; steps > 0 && power > minPower; steps--)
+            power = std::max<int8_t>(power - step, minPower);
+        for (; steps < 0 && power < maxPower; steps++)
+            power = std::min<int8_t>(power + step, maxPower);
+        for (; steps < 0 && spreadingFactor < maxSpreadingFactor; steps++)
+            spreadingFactor++;
+        return {spreadingFactor, power};
+    }
+};
+}
+
+#endif
@@ -42,12 +42,29 @@ constexpr uint32_t defaultSampleOffset = 0;
 
 #define DISCOVERY_TIMEOUT 5 * 60 * 1000 // ms
 
-#define TIME_CONFIG_TIMEOUT 6000 // ms
+// Timeouts are derived from the time on air of the messages at the given spreading factor, see
+// LoRaModule::getAnswerTime.
+#define TIME_CONFIG_TIMEOUT(SF)                                                                    \
+    ((TIME_CONFIG_ATTEMPTS + 1) *                                                                  \
+     LoRaModule::getAnswerTime(sizeof(Message<TIME_CONFIG>), SF)) // ms
 #define TIME_CONFIG_ATTEMPTS 1
 
-#define SENSOR_DATA_TIMEOUT 6000 // ms
+#define SENSOR_DATA_TIMEOUT(SF)                                                                    \
+    LoRaModule::getAnswerTime(MessageHeader::maxLength,                                            \
+                              SF) // ms, time to wait for the first sensor data message of a window
 #define SENSOR_DATA_ATTEMPTS 1
+#define SENSOR_DATA_WINDOW 4        // as on the sensor nodes
+#define SENSOR_DATA_BURST_DELAY 50 // ms, as on the sensor nodes
+#define SENSOR_DATA_FRAME_TIMEOUT(SF)                                                              \
+    LoRaModule::getAnswerTime(MessageHeader::maxLength, SF,                                        \
+                              SENSOR_DATA_BURST_DELAY) // ms, time to wait for the next message
 
 #define MAX_SENSOR_NODES 35
 
+// Adaptive data rate
+#define ADR_MARGIN 10 // dB, link margin kept above the SNR required by the spreading factor
+#define ADR_STEP 3    // dB, margin traded per step of spreading factor or output power
+#define ADR_MAX_SPREADING_FACTOR                                                                   \
+    9 // highest spreading factor assigned, which the comm periods of all nodes are sized for
+
 #endif
@@ -1,5 +1,6 @@
 #include "gateway.h"
 #include "HTTPClient.h"
+#include <cmath>
 #include <cstring>
 #include <esp_sntp.h>
 
@@ -14,6 +15,8 @@ void Node::timeConfig(Message<TIME_CONFIG>& m)
     this->commInterval = m.getCommInterval();
     this->nextCommTime = m.getCommTime();
     this->maxMessages = m.getMaxMessages();
+    this->spreadingFactor = m.getSpreadingFactor();
+    this->power = m.getPower();
     if (this->errors > 0)
         this->errors--;
 }
@@ -22,13 +25,69 @@ void Node::naiveTimeConfig(uint32_t cTime)
 {
     while (this->nextCommTime <= cTime)
         this->nextCommTime += commInterval;
+    // the node falls back to the default link when it misses its time config, as well as when
+    // it was asked to repeat its ack (see nodeCommPeriod)
+    this->spreadingFactor = 0;
+    this->power = 0;
     this->errors++;
 }
 
 Message<TIME_CONFIG> Node::currentTimeConfig(const MACAddress& src, uint32_t cTime)
 {
-    return Message<TIME_CONFIG>(src, mac, cTime, sampleInterval, sampleRounding, sampleOffset,
-                                commInterval, nextCommTime, maxMessages);
+    Message<TIME_CONFIG> timeConfig(src, mac, cTime, sampleInterval, sampleRounding, sampleOffset,
+                                    commInterval, nextCommTime, maxMessages);
+    timeConfig.setLink(spreadingFactor, power);
+    return timeConfig;
+}
+
+std::pair<uint8_t, int8_t> Node::adaptLink(float snr) const
+{
+    static constexpr LinkAdaptation adaptation{LORA_SPREADING_FACTOR, ADR_MAX_SPREADING_FACTOR,
+                                               LORA_POWER_MIN, LORA_POWER_MAX, ADR_MARGIN,
+                                               ADR_STEP};
+    uint8_t sf{spreadingFactor};
+    int8_t p{power};
+    if (sf == 0)
+    {
+        sf = LORA_SPREADING_FACTOR;
+        p = LORA_POWER;
+    }
+    return adaptation.adapt(sf, p, snr - LoRaModule::getRequiredSNR(sf));
+}
+
+Gateway::Parameters::Parameters() : nvs{"parameters"}, values{nvs.getRecord<Values>("record", {})}
+{
+    if (values.isDirty())
+        migrate();
+}
+
+void Gateway::Parameters::migrate()
+{
+    std::vector<const char*> migrated;
+    auto migrateKey = [this, &migrated](const char* key, auto& field) {
+        if (auto value{nvs.find<std::remove_reference_t<decltype(field)>>(key)})
+        {
+            field = *value;
+            migrated.push_back(key);
+        }
+    };
+    migrateKey("wifiSsid", values->wifiSsid);
+    migrateKey("wifiPass", values->wifiPass);
+    migrateKey("mqttServer", values->mqttServer);
+    migrateKey("mqttPort", values->mqttPort);
+    migrateKey("mqttPsk", values->mqttPsk);
+    migrateKey("sampleInterval", values->sampleInterval);
+    migrateKey("sampleRounding", values->sampleRounding);
+    migrateKey("sampleOffset", values->sampleOffset);
+    migrateKey("commInterval", values->commInterval);
+    if (migrated.empty())
+        return;
+    // the keys are only erased once the record holding their values is committed, so that a reset
+    // in between does not lose them
+    values.commit();
+    for (const char* key : migrated)
+        nvs.eraseKey(key);
+    nvs.commit();
 }
 
 Gateway::Gateway(const MIRRAPins& pins) : MIRRAModule(pins), parameters{}
@@ -38,7 +97,7 @@ Gateway::Gateway(const MIRRAPins& pins) : MIRRAModule(pins), parameters{}
 
 void Gateway::wake()
 {
-    Log::debug("Running wake()...");
+    LOG_DEBUG(GATEWAY, "Running wake()...");
     if (!nodes.empty() && rtc.getSysTime() >= (WAKE_COMM_PERIOD(nodes[0].getNextCommTime()) - 3))
     {
         commPeriod();
@@ -46,8 +105,8 @@ void Gateway::wake()
     }
     Serial.printf("Welcome! This is Gateway %s\n", lora.getMACAddress().toString());
     commandEntry.prompt(Commands(this));
-    Log::debug("Entering deep sleep...");
-    parameters.~Parameters();
+    LOG_DEBUG(GATEWAY, "Entering deep sleep...");
+    parameters.commit();
     if (nodes.empty())
         deepSleep(3600);
     else
@@ -66,27 +125,27 @@ std::optional<std::reference_wrapper<Node>> Gateway::macToNode(const MACAddress&
 
 void Gateway::discovery()
 {
-    Log::info("Starting discovery...");
+    LOG_INFO(GATEWAY, "Starting discovery...");
     while (true)
     {
-        Log::info("Awaiting discovery message...");
+        LOG_INFO(GATEWAY, "Awaiting discovery message...");
         auto hello{lora.listenMessage<HELLO>(DISCOVERY_TIMEOUT, pins.bootPin)};
         if (!hello)
         {
             if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT1)
             {
-                Log::info("Discovery aborted with BOOT button.");
+                LOG_INFO(GATEWAY, "Discovery aborted with BOOT button.");
                 return;
             }
             continue;
         }
         MACAddress candidate = hello->getSource();
-        Log::info("Node found at ", candidate.toString());
+        LOG_INFO(GATEWAY, "Node found at ", candidate.toString());
 
         auto duplicate{macToNode(candidate)};
 
         uint32_t cTime{rtc.getSysTime()};
-        Log::debug("Sending time config message to ", candidate.toString());
+        LOG_DEBUG(GATEWAY, "Sending time config message to ", candidate.toString());
         if (duplicate)
         {
             lora.sendMessage(duplicate->get().currentTimeConfig(lora.getMACAddress(), cTime));
@@ -95,57 +154,60 @@ void Gateway::discovery()
         {
             if (nodes.size() >= MAX_SENSOR_NODES)
             {
-                Log::info("Could not add node because maximum amount of nodes has been reached.");
+                LOG_INFO(GATEWAY,
+                         "Could not add node because maximum amount of nodes has been reached.");
                 return;
             }
             uint32_t commTime{
-                std::all_of(nodes.cbegin(), nodes.cend(), Node::bindIsLost(parameters.commInterval))
-                    ? cTime + parameters.commInterval
+                std::all_of(nodes.cbegin(), nodes.cend(),
+                            Node::bindIsLost(parameters->commInterval))
+                    ? cTime + parameters->commInterval
                     : nextScheduledCommTime()};
             Message<TIME_CONFIG> timeConfig{
                 lora.getMACAddress(),
                 candidate,
                 cTime,
-                parameters.sampleInterval,
-                parameters.sampleRounding,
-                parameters.sampleOffset,
-                parameters.commInterval,
+                parameters->sampleInterval,
+                parameters->sampleRounding,
+                parameters->sampleOffset,
+                parameters->commInterval,
                 commTime,
-                MAX_MESSAGES(parameters.commInterval, parameters.sampleInterval)};
-            Log::debug("Time config constructed. cTime = ", cTime,
-                       " sampleInterval = ", static_cast<uint32_t>(parameters.sampleInterval),
-                       " sampleRounding = ", static_cast<uint32_t>(parameters.sampleRounding),
-                       " sampleOffset = ", static_cast<uint32_t>(parameters.sampleOffset),
-                       " commInterval = ", static_cast<uint32_t>(parameters.commInterval),
-                       " comTime = ", commTime);
+                getMaxMessages(parameters->commInterval, parameters->sampleInterval, 0)};
+            LOG_DEBUG(GATEWAY, "Time config constructed. cTime = ", cTime,
+                      " sampleInterval = ", parameters->sampleInterval,
+                      " sampleRounding = ", parameters->sampleRounding,
+                      " sampleOffset = ", parameters->sampleOffset,
+                      " commInterval = ", parameters->commInterval,
+                      " comTime = ", commTime);
             nodes.emplace_back(timeConfig);
             lora.sendMessage(timeConfig);
         }
         auto timeAck{
-            lora.receiveMessage<ACK_TIME>(TIME_CONFIG_TIMEOUT, TIME_CONFIG_ATTEMPTS, candidate)};
+            lora.receiveMessage<ACK_TIME>(TIME_CONFIG_TIMEOUT(lora.getSpreadingFactor()),
+                                          TIME_CONFIG_ATTEMPTS, candidate)};
         if (!timeAck)
         {
-            Log::error("Error while receiving ack to time config message from ",
-                       candidate.toString(), ". Aborting discovery.");
+            LOG_ERROR(GATEWAY, "Error while receiving ack to time config message from ",
+                      candidate.toString(), ". Aborting discovery.");
             if (!duplicate)
                 nodes.pop_back();
             continue;
         }
 
-        Log::info("Node ", timeAck->getSource().toString(), " has been registered.");
+        LOG_INFO(GATEWAY, "Node ", timeAck->getSource().toString(), " has been registered.");
         storeNodes();
     }
 }
 
 void Gateway::loadNodes()
 {
-    Log::debug("Recovering nodes from file...");
+    LOG_DEBUG(GATEWAY, "Recovering nodes from file...");
     fs::NVS nvsNodes{"nodes"};
     for (const char* nodeMac : nvsNodes)
     {
         nodes.push_back(nvsNodes.getValue<Node>(nodeMac));
     }
-    Log::debug(nodes.size(), " nodes found in NVS.");
+    LOG_DEBUG(GATEWAY, nodes.size(), " nodes found in NVS.");
 }
 
 void Gateway::storeNodes()
@@ -175,7 +237,7 @@ void Gateway::removeNode(Node& node)
 
 void Gateway::commPeriod()
 {
-    Log::info("Starting comm period...");
+    LOG_INFO(GATEWAY, "Starting comm period...");
     std::vector<Message<SENSOR_DATA>> data;
     size_t expectedMessages{0};
     for (const Node& n : nodes)
@@ -190,17 +252,20 @@ void Gateway::commPeriod()
     {
         if (n.getNextCommTime() > farCommTime)
             break;
-        farCommTime =
-            n.getNextCommTime() +
-            2 * (COMM_PERIOD_LENGTH(MAX_MESSAGES(parameters.commInterval, n.getSampleInterval())) +
-                 COMM_PERIOD_PADDING);
+        farCommTime = n.getNextCommTime() +
+                      2 * (getCommPeriodLength(getMaxMessages(parameters->commInterval,
+                                                              n.getSampleInterval(),
+                                                              n.getNValues())) +
+                           COMM_PERIOD_PADDING);
+        lora.setLink(n.getSpreadingFactor(), n.getPower());
         if (!nodeCommPeriod(n, data))
             n.naiveTimeConfig(rtc.getSysTime());
     }
+    lora.resetLink();
     std::sort(nodes.begin(), nodes.end(), lambdaByNextCommTime);
     if (nodes.empty())
     {
-        Log::info("No comm periods performed because no nodes have been registered.");
+        LOG_INFO(GATEWAY, "No comm periods performed because no nodes have been registered.");
     }
     else
     {
@@ -218,11 +283,11 @@ uint32_t Gateway::nextScheduledCommTime()
     for (size_t i{1}; i <= nodes.size(); i++)
     {
         const Node& n{nodes[nodes.size() - i]};
-        if (!n.isLost(parameters.commInterval))
-            return n.getNextCommTime() + COMM_PERIOD_LENGTH(n.getMaxMessages()) +
+        if (!n.isLost(parameters->commInterval))
+            return n.getNextCommTime() + getCommPeriodLength(n.getMaxMessages()) +
                    COMM_PERIOD_PADDING;
     }
-    Log::error("Next scheduled comm time was asked but all nodes are lost!");
+    LOG_ERROR(GATEWAY, "Next scheduled comm time was asked but all nodes are lost!");
     return -1;
 }
 
@@ -231,74 +296,147 @@ bool Gateway::nodeCommPeriod(Node& n, std::vector<Message<SENSOR_DATA>>& data)
     uint32_t cTime{rtc.getSysTime()};
     if (cTime > n.getNextCommTime())
     {
-        Log::error("Node ", n.getMACAddress().toString(),
-                   "'s comm time was faultily scheduled before this gateway's comm period. "
-                   "Skipping communication with this node.");
+        LOG_ERROR(GATEWAY, "Node ", n.getMACAddress().toString(),
+                  "'s comm time was faultily scheduled before this gateway's comm period. "
+                  "Skipping communication with this node.");
         return false;
     }
     lightSleepUntil(
         LISTEN_COMM_PERIOD(n.getNextCommTime()));  // light sleep until scheduled comm period
-    uint32_t listenMs{COMM_PERIOD_PADDING * 1000}; // pre-listen in anticipation of message
+    // listen for the first message as long before and after the comm time as the clocks may differ
+    uint32_t listenMs{2 * COMM_PERIOD_PADDING * 1000};
+    uint32_t commTime{n.getNextCommTime() + parameters->commInterval};
+    if (n.isLost(parameters->commInterval) &&
+        !(std::all_of(nodes.cbegin(), nodes.cend(), n.bindIsLost(parameters->commInterval))))
+    {
+        commTime = nextScheduledCommTime();
+    }
+    std::optional<Message<TIME_CONFIG>> timeConfig;
     size_t messagesReceived{0};
+    size_t entriesReceived{0};
+    uint8_t nValues{0}; // most values held by an entry received
+    WindowReceiver receiver;
+    size_t silentRounds{0};
+    float snr{INFINITY};
+    float rssi{INFINITY};
     while (true)
     {
-        Log::debug("Awaiting data from ", n.getMACAddress().toString(), " ...");
-        auto sensorData{lora.receiveMessage<SENSOR_DATA>(SENSOR_DATA_TIMEOUT, SENSOR_DATA_ATTEMPTS,
-                                                         n.getMACAddress(), listenMs)};
+        LOG_DEBUG(GATEWAY, "Awaiting data from ", n.getMACAddress().toString(), " ...");
+        // the first message of a round answers the acknowledgement, the others follow it back to
+        // back up to the end of the burst
+        uint32_t timeoutMs{SENSOR_DATA_TIMEOUT(lora.getSpreadingFactor())};
+        uint32_t frameTimeoutMs{SENSOR_DATA_FRAME_TIMEOUT(lora.getSpreadingFactor())};
+        bool heard{false};
+        while (auto sensorData{lora.receiveMessage<SENSOR_BATCH>(timeoutMs, 0, n.getMACAddress(),
+                                                                   listenMs)})
+        {
+            listenMs = 0;
+            timeoutMs = frameTimeoutMs;
+            heard = true;
+            snr = std::min(snr, lora.getSNR());
+            rssi = std::min(rssi, lora.getRSSI());
+            if (!receiver.receive(*sensorData))
+            {
+                LOG_DEBUG(GATEWAY, "Duplicate sensor data message received.");
+            }
+            else
+            {
+                LOG_INFO(GATEWAY, "Sensor data received from ", n.getMACAddress().toString(),
+                         " with length ", sensorData->getLength(), " holding ",
+                         sensorData->getNEntries(), " entries");
+                size_t offset{0};
+                for (size_t i{0}; i < sensorData->getNEntries(); i++)
+                {
+                    auto entry{sensorData->getEntry(offset)};
+                    if (!entry)
+                    {
+                        LOG_ERROR(GATEWAY, "Sensor data from ", n.getMACAddress().toString(),
+                                  " holds a malformed entry. Dropping the remaining entries.");
+                        break;
+                    }
+                    data.push_back(*entry);
+                    entriesReceived++;
+                    nValues = std::max(nValues, entry->nValues);
+                }
+                messagesReceived++;
+            }
+            // a node whose acknowledgement was lost resends the whole window: answering at the
+            // first duplicate would talk over the rest of the burst
+            if (receiver.isBurstOver())
+                break;
+        }
         listenMs = 0;
-        if (!sensorData)
+        if (!heard && silentRounds++ >= SENSOR_DATA_ATTEMPTS)
         {
-            Log::error("Error while awaiting/receiving data from ", n.getMACAddress().toString(),
-                       ". Skipping communication with this node.");
+            LOG_ERROR(GATEWAY, "Error while awaiting/receiving data from ",
+                      n.getMACAddress().toString(), ". Skipping communication with this node.");
             return false;
         }
-        Log::info("Sensor data received from ", n.getMACAddress().toString(), " with length ",
-                  sensorData->getLength());
-        data.push_back(*sensorData);
-        messagesReceived++;
-        if (sensorData->isLast() || messagesReceived >= n.getMaxMessages())
+        if (heard)
+            silentRounds = 0;
+        // acknowledging the messages received so far has the node resend the others, or the
+        // whole first window if none were received
+        if (!receiver.isLast() && messagesReceived < n.getMaxMessages())
+        {
+            LOG_DEBUG(GATEWAY, "Sending data ACK to ", n.getMACAddress().toString(), " ...");
+            lora.sendMessage(Message<ACK_DATA>(lora.getMACAddress(), n.getMACAddress(),
+                                               receiver.getWindow(), receiver.getReceived()));
+            continue;
+        }
+        // the final window is acknowledged by the time config message
+        LOG_INFO(GATEWAY, "Sending time config message to ", n.getMACAddress().toString(), " ...");
+        cTime = rtc.getSysTime();
+        timeConfig.emplace(lora.getMACAddress(), n.getMACAddress(), cTime, n.getSampleInterval(),
+                           n.getSampleRounding(), n.getSampleOffset(), parameters->commInterval,
+                           commTime,
+                           getMaxMessages(parameters->commInterval, n.getSampleInterval(),
+                                          entriesReceived > 0 ? nValues : n.getNValues()));
+        timeConfig->setReceived(receiver.getWindow(), receiver.getReceived());
+        auto [spreadingFactor, power]{n.adaptLink(snr)};
+        timeConfig->setLink(spreadingFactor, power);
+        lora.sendMessage(*timeConfig);
+        if (receiver.isComplete())
         {
-            Log::debug("Last message received.");
+            LOG_DEBUG(GATEWAY, "Last window received.");
             break;
         }
-        Log::debug("Sending data ACK to ", n.getMACAddress().toString(), " ...");
-        lora.sendMessage(Message<ACK_DATA>(lora.getMACAddress(), n.getMACAddress()));
     }
-    uint32_t commTime{n.getNextCommTime() + parameters.commInterval};
-    if (n.isLost(parameters.commInterval) &&
-        !(std::all_of(nodes.cbegin(), nodes.cend(), n.bindIsLost(parameters.commInterval))))
-    {
-        commTime = nextScheduledCommTime();
-    }
-    Log::info("Sending time config message to ", n.getMACAddress().toString(), " ...");
-    cTime = rtc.getSysTime();
-    Message<TIME_CONFIG> timeConfig{lora.getMACAddress(),
-                                    n.getMACAddress(),
-                                    cTime,
-                                    n.getSampleInterval(),
-                                    n.getSampleRounding(),
-                                    n.getSampleOffset(),
-                                    parameters.commInterval,
-                                    commTime,
-                                    MAX_MESSAGES(parameters.commInterval, n.getSampleInterval())};
-    lora.sendMessage(timeConfig);
     auto timeAck =
-        lora.receiveMessage<ACK_TIME>(TIME_CONFIG_TIMEOUT, TIME_CONFIG_ATTEMPTS, n.getMACAddress());
+        lora.receiveMessage<ACK_TIME>(TIME_CONFIG_TIMEOUT(lora.getSpreadingFactor()),
+                                      TIME_CONFIG_ATTEMPTS, n.getMACAddress());
     if (!timeAck)
     {
-        Log::error("Error while receiving ack to time config message from ",
-                   n.getMACAddress().toString(), ". Skipping communication with this node.");
+        LOG_ERROR(GATEWAY, "Error while receiving ack to time config message from ",
+                  n.getMACAddress().toString(), ". Skipping communication with this node.");
         return false;
     }
-    Log::info("Communication with node ", n.getMACAddress().toString(),
-              " successful: ", messagesReceived, " messages received");
-    n.timeConfig(timeConfig);
+    LOG_INFO(GATEWAY, "Communication with node ", n.getMACAddress().toString(),
+             " successful: ", messagesReceived, " messages received holding ", entriesReceived,
+             " entries at SNR ", snr, " dB, RSSI ", rssi, " dBm");
+    if (lora.getRepeatsSent() > 0)
+    {
+        // the node only switches to the new link if it was not asked to repeat its ack: the link
+        // only changes if no REPEAT was sent
+        LOG_INFO(GATEWAY, "Time config acknowledged after a REPEAT, node ",
+                 n.getMACAddress().toString(), " falls back to the default link.");
+        timeConfig->setLink(0, 0);
+    }
+    else if (timeConfig->getSpreadingFactor() != lora.getSpreadingFactor() ||
+             timeConfig->getPower() != lora.getPower())
+    {
+        LOG_INFO(GATEWAY, "Link of node ", n.getMACAddress().toString(), " switched to SF",
+                 timeConfig->getSpreadingFactor(), " at ", timeConfig->getPower(), " dBm");
+    }
+    n.timeConfig(*timeConfig);
+    n.setSignal(snr, rssi);
+    if (entriesReceived > 0)
+        n.setNValues(nValues);
     return true;
 }
 
 void Gateway::wifiConnect(const char* SSID, const char* password)
 {
-    Log::info("Connecting to WiFi with SSID: ", SSID);
+    LOG_INFO(GATEWAY, "Connecting to WiFi with SSID: ", SSID);
     WiFi.begin(SSID, password);
     for (size_t i = 10; i > 0 && WiFi.status() != WL_CONNECTED; i--)
     {
@@ -308,15 +446,15 @@ void Gateway::wifiConnect(const char* SSID, const char* password)
     Serial.print('\n');
     if (WiFi.status() != WL_CONNECTED)
     {
-        Log::error("Could not connect to WiFi.");
+        LOG_ERROR(GATEWAY, "Could not connect to WiFi.");
         return;
     }
-    Log::info("Connected to WiFi.");
+    LOG_INFO(GATEWAY, "Connected to WiFi.");
 }
 
 void Gateway::wifiConnect()
 {
-    wifiConnect(parameters.wifiSsid->data(), parameters.wifiPass->data());
+    wifiConnect(parameters->wifiSsid.data(), parameters->wifiPass.data());
 }
 
 bool Gateway::MQTTClient::clientConnect()
@@ -342,56 +480,61 @@ char* Gateway::createTopic(char* topic, const MACAddress& nodeMAC)
 
 void Gateway::uploadPeriod()
 {
-    Log::info("Commencing upload to MQTT server...");
+    LOG_INFO(GATEWAY, "Commencing upload to MQTT server...");
     wifiConnect();
     SensorFile file{};
     if (WiFi.status() == WL_CONNECTED)
     {
-        MQTTClient mqtt{parameters.mqttServer->data(), parameters.mqttPort, lora.getMACAddress(),
-                        parameters.mqttPsk->data()};
+        MQTTClient mqtt{parameters->mqttServer.data(), parameters->mqttPort, lora.getMACAddress(),
+                        parameters->mqttPsk.data()};
         size_t nErrors{0}; // amount of errors while uploading
         size_t messagesPublished{0};
-        while (true)
+        // entries are streamed from the file, which is not written to while uploading
+        SensorFile::Iterator it{file.unuploaded()};
+        while (it != file.end()) // until no more unuploaded entries remain
         {
-            auto entry = file.getUnuploaded(0);
-            if (!entry)
-                break; // no more unuploaded entries remaining
+            const SensorFile::DataEntry& entry{*it};
             char topic[topicSize];
-            createTopic(topic, entry->source);
+            createTopic(topic, entry.source);
 
             if (mqtt.clientConnect())
             {
-                if (mqtt.mqtt.publish(topic, reinterpret_cast<uint8_t*>(&entry), entry->getSize()))
+                if (mqtt.mqtt.publish(topic, reinterpret_cast<const uint8_t*>(&entry),
+                                      entry.getSize()))
                 {
-                    Log::debug("MQTT message successfully published.");
-                    file.setUploaded();
+                    LOG_DEBUG(GATEWAY, "MQTT message successfully published.");
+                    file.setUploaded(it.getAddress());
+                    ++it;
                     messagesPublished++;
                 }
                 else
                 {
-                    Log::error("Error while publishing to MQTT server. State: ", mqtt.mqtt.state());
+                    LOG_ERROR(GATEWAY, "Error while publishing to MQTT server. State: ",
+                              mqtt.mqtt.state());
                     nErrors++;
                 }
             }
             else
             {
-                Log::error("Error while connecting to MQTT server. Aborting upload. State: ",
-                           mqtt.mqtt.state());
+                LOG_ERROR(GATEWAY,
+                          "Error while connecting to MQTT server. Aborting upload. State: ",
+                          mqtt.mqtt.state());
                 break;
             }
             if (nErrors >= MAX_MQTT_ERRORS)
             {
-                Log::error("Too many errors while publishing to MQTT server. Aborting upload.");
+                LOG_ERROR(GATEWAY,
+                          "Too many errors while publishing to MQTT server. Aborting upload.");
                 break;
             }
         }
         mqtt.mqtt.disconnect();
         WiFi.disconnect();
-        Log::info("MQTT upload finished with ", messagesPublished, " messages sent.");
+        LOG_INFO(GATEWAY, "MQTT upload finished with ", messagesPublished, " messages sent.");
     }
     else
     {
-        Log::error("WiFi not connected. Aborting upload to MQTT server...");
+        LOG_ERROR(GATEWAY, "WiFi not connected. Aborting upload to MQTT server...");
     }
 }
 
@@ -399,20 +542,20 @@ void Gateway::parseNodeUpdate(char* update)
 {
     if (strlen(update) < (MACAddress::stringLength + 2 + 2 + 1))
     {
-        Log::error("Update string '", update, "' has invalid length.");
+        LOG_ERROR(GATEWAY, "Update string '", update, "' has invalid length.");
         return;
     }
     auto node{macToNode(MACAddress::fromString(update))};
     if (!node)
     {
-        Log::error("Could not deduce node from update string.");
+        LOG_ERROR(GATEWAY, "Could not deduce node from update string.");
         return;
     }
     char* timeString{&update[MACAddress::stringLength - 1]};
     uint32_t sampleInterval, sampleRounding, sampleOffset;
     if (sscanf(timeString, "/%u/%u/%u", &sampleInterval, &sampleRounding, &sampleOffset) != 3)
     {
-        Log::error("Could not deduce updated timings from update string '", update, "'.");
+        LOG_ERROR(GATEWAY, "Could not deduce updated timings from update string '", update, "'.");
         return;
     }
     node->get().setSampleInterval(sampleInterval);
@@ -422,14 +565,14 @@ void Gateway::parseNodeUpdate(char* update)
 
 CommandCode Gateway::Commands::changeWifi()
 {
-    char ssidBuffer[sizeof(*(parent->parameters.wifiSsid))];
-    strncpy(ssidBuffer, parent->parameters.wifiSsid->data(), sizeof(ssidBuffer));
+    char ssidBuffer[sizeof(parent->parameters->wifiSsid)];
+    strncpy(ssidBuffer, parent->parameters->wifiSsid.data(), sizeof(ssidBuffer));
     Serial.printf("Enter WiFi SSID (current: '%s') :\n", ssidBuffer);
     if (!CommandParser::editValue(ssidBuffer))
         return COMMAND_TIMEOUT;
 
-    char passBuffer[sizeof(*(parent->parameters.wifiPass))];
-    strncpy(passBuffer, parent->parameters.wifiPass->data(), sizeof(passBuffer));
+    char passBuffer[sizeof(parent->parameters->wifiPass)];
+    strncpy(passBuffer, parent->parameters->wifiPass.data(), sizeof(passBuffer));
     Serial.println("Enter WiFi password:");
     if (!CommandParser::editValue(passBuffer))
         return COMMAND_TIMEOUT;
@@ -438,8 +581,8 @@ CommandCode Gateway::Commands::changeWifi()
     if (WiFi.status() == WL_CONNECTED)
     {
         WiFi.disconnect();
-        strncpy(parent->parameters.wifiSsid->data(), ssidBuffer, sizeof(ssidBuffer));
-        strncpy(parent->parameters.wifiPass->data(), passBuffer, sizeof(passBuffer));
+        strncpy(parent->parameters->wifiSsid.data(), ssidBuffer, sizeof(ssidBuffer));
+        strncpy(parent->parameters->wifiPass.data(), passBuffer, sizeof(passBuffer));
         Serial.println("WiFi connected! This WiFi network has been set as the default.");
         return COMMAND_SUCCESS;
     }
@@ -455,7 +598,7 @@ CommandCode Gateway::Commands::rtcUpdateTime()
     parent->wifiConnect();
     if (WiFi.status() == WL_CONNECTED)
     {
-        Log::info("Fetching NTP time.");
+        LOG_INFO(GATEWAY, "Fetching NTP time.");
         sntp_setoperatingmode(SNTP_OPMODE_POLL);
         sntp_setservername(0, NTP_URL);
         sntp_set_sync_interval(15000);
@@ -467,7 +610,7 @@ CommandCode Gateway::Commands::rtcUpdateTime()
         }
         Serial.println("\nWriting time to RTC...");
         parent->rtc.writeTime(parent->rtc.getSysTime());
-        Log::info("RTC and system time updated.");
+        LOG_INFO(GATEWAY, "RTC and system time updated.");
         sntp_stop();
     }
     WiFi.disconnect();
@@ -510,19 +653,19 @@ CommandCode Gateway::Commands::rtcSet()
 
 CommandCode Gateway::Commands::changeServer()
 {
-    char serverBuffer[sizeof(*(parent->parameters.mqttServer))];
-    strncpy(serverBuffer, parent->parameters.mqttServer->data(), sizeof(serverBuffer));
+    char serverBuffer[sizeof(parent->parameters->mqttServer)];
+    strncpy(serverBuffer, parent->parameters->mqttServer.data(), sizeof(serverBuffer));
     Serial.printf("Enter server URL or IP address (current: '%s') :\n", serverBuffer);
     if (!CommandParser::editValue(serverBuffer))
         return COMMAND_ERROR;
 
-    uint16_t portBuffer{parent->parameters.mqttPort};
+    uint16_t portBuffer{parent->parameters->mqttPort};
     Serial.printf("Enter the server's MQTT port (current: '%u') :\n", portBuffer);
     if (!CommandParser::editValue(portBuffer))
         return COMMAND_ERROR;
 
     Serial.printf("Start the gateway setup on the web portal and enter the access code:\n");
-    char pskBuffer[sizeof(*(parent->parameters.mqttPsk))]{0};
+    char pskBuffer[sizeof(parent->parameters->mqttPsk)]{0};
     auto code{CommandParser::readLine()};
     if (!code)
         return COMMAND_TIMEOUT;
@@ -566,14 +709,14 @@ CommandCode Gateway::Commands::changeServer()
         MQTTClient client{serverBuffer, portBuffer, parent->lora.getMACAddress(), pskBuffer};
         if (client.clientConnect())
         {
-            strncpy(parent->parameters.mqttServer->data(), serverBuffer, sizeof(serverBuffer));
-            parent->parameters.mqttPort = portBuffer;
-            strncpy(parent->parameters.mqttPsk->data(), pskBuffer, sizeof(pskBuffer));
+            strncpy(parent->parameters->mqttServer.data(), serverBuffer, sizeof(serverBuffer));
+            parent->parameters->mqttPort = portBuffer;
+            strncpy(parent->parameters->mqttPsk.data(), pskBuffer, sizeof(pskBuffer));
             Serial.println(
                 "Connection to provided server successful. Configuration has been changed.");
-            Serial.printf("mqttServer: %s\n", parent->parameters.mqttServer->data());
-            Serial.printf("mqttPort: %u\n", *(parent->parameters.mqttPort));
-            Serial.printf("mqttPsk: %s\n", parent->parameters.mqttPsk->data());
+            Serial.printf("mqttServer: %s\n", parent->parameters->mqttServer.data());
+            Serial.printf("mqttPort: %u\n", parent->parameters->mqttPort);
+            Serial.printf("mqttPsk: %s\n", parent->parameters->mqttPsk.data());
             WiFi.disconnect();
             return COMMAND_SUCCESS;
         }
@@ -586,27 +729,27 @@ CommandCode Gateway::Commands::changeServer()
 
 CommandCode Gateway::Commands::changeIntervals()
 {
-    uint32_t commIntervalBuffer{parent->parameters.commInterval};
+    uint32_t commIntervalBuffer{parent->parameters->commInterval};
     Serial.printf("Enter communication interval in seconds (current: '%u') : ", commIntervalBuffer);
     if (!CommandParser::editValue(commIntervalBuffer))
         return COMMAND_ERROR;
-    uint32_t sampleIntervalBuffer{parent->parameters.sampleInterval};
+    uint32_t sampleIntervalBuffer{parent->parameters->sampleInterval};
     Serial.printf("Enter sample interval in seconds (current: '%u') : ", sampleIntervalBuffer);
     if (!CommandParser::editValue(sampleIntervalBuffer))
         return COMMAND_ERROR;
-    uint32_t sampleRoundingBuffer{parent->parameters.sampleRounding};
+    uint32_t sampleRoundingBuffer{parent->parameters->sampleRounding};
     Serial.printf("Enter sample rounding in seconds (current: '%u') : ", sampleRoundingBuffer);
     if (!CommandParser::editValue(sampleRoundingBuffer))
         return COMMAND_ERROR;
-    uint32_t sampleOffsetBuffer{parent->parameters.sampleOffset};
+    uint32_t sampleOffsetBuffer{parent->parameters->sampleOffset};
     Serial.printf("Enter sample offset in seconds (current: '%u') : ", sampleOffsetBuffer);
     if (!CommandParser::editValue(sampleOffsetBuffer))
         return COMMAND_ERROR;
 
-    parent->parameters.commInterval = commIntervalBuffer;
-    parent->parameters.sampleInterval = sampleIntervalBuffer;
-    parent->parameters.sampleRounding = sampleRoundingBuffer;
-    parent->parameters.sampleOffset = sampleOffsetBuffer;
+    parent->parameters->commInterval = commIntervalBuffer;
+    parent->parameters->sampleInterval = sampleIntervalBuffer;
+    parent->parameters->sampleRounding = sampleRoundingBuffer;
+    parent->parameters->sampleOffset = sampleOffsetBuffer;
 
     return COMMAND_SUCCESS;
 }
@@ -640,9 +783,9 @@ CommandCode Gateway::Commands::addNode()
     }
     uint32_t commTime{static_cast<uint32_t>(mktime(&tm))};
     Message<TIME_CONFIG> timeConfig(
-        mac, mac, 0, parent->parameters.sampleInterval, parent->parameters.sampleRounding,
-        parent->parameters.sampleOffset, parent->parameters.commInterval, commTime,
-        MAX_MESSAGES(parent->parameters.commInterval, parent->parameters.sampleInterval));
+        mac, mac, 0, parent->parameters->sampleInterval, parent->parameters->sampleRounding,
+        parent->parameters->sampleOffset, parent->parameters->commInterval, commTime,
+        getMaxMessages(parent->parameters->commInterval, parent->parameters->sampleInterval, 0));
     if (parent->nodes.size() >= MAX_SENSOR_NODES)
     {
         Serial.printf("Maximum amount of nodes reached. This node will not be added.\n");
@@ -682,15 +825,18 @@ CommandCode Gateway::Commands::printSchedule()
 {
     constexpr size_t timeLength{sizeof("0000-00-00 00:00:00")};
     char buffer[timeLength]{0};
-    Serial.println("MAC\tNEXT COMM TIME\tSAMPLE INTERVAL\tMAX MESSAGES");
+    Serial.println("MAC\tNEXT COMM TIME\tSAMPLE INTERVAL\tMAX MESSAGES\tSF\tPOWER\tSNR\tRSSI");
     for (const Node& n : parent->nodes)
     {
         tm time;
         time_t nextNodeCommTime{static_cast<time_t>(n.getNextCommTime())};
         gmtime_r(&nextNodeCommTime, &time);
         strftime(buffer, timeLength, "%F %T", &time);
-        Serial.printf("%s\t%s\t%u\t%u\n", n.getMACAddress().toString(), buffer,
-                      n.getSampleInterval(), n.getMaxMessages());
+        bool defaultLink{n.getSpreadingFactor() == 0};
+        Serial.printf("%s\t%s\t%u\t%u\t%u\t%i\t%.1f\t%.1f\n", n.getMACAddress().toString(),
+                      buffer, n.getSampleInterval(), n.getMaxMessages(),
+                      defaultLink ? LORA_SPREADING_FACTOR : n.getSpreadingFactor(),
+                      defaultLink ? LORA_POWER : n.getPower(), n.getSNR(), n.getRSSI());
     }
     return COMMAND_SUCCESS;
 }
@@ -706,8 +852,8 @@ CommandCode Gateway::Commands::testMQTT(uint32_t timestamp, uint32_t value)
     parent->wifiConnect();
     if (WiFi.status() == WL_CONNECTED)
     {
-        MQTTClient mqtt{parent->parameters.mqttServer->data(), parent->parameters.mqttPort,
-                        parent->lora.getMACAddress(), parent->parameters.mqttPsk->data()};
+        MQTTClient mqtt{parent->parameters->mqttServer.data(), parent->parameters->mqttPort,
+                        parent->lora.getMACAddress(), parent->parameters->mqttPsk.data()};
         char topic[topicSize];
         parent->createTopic(topic, entry.source);
 
@@ -4,16 +4,40 @@
 #include "MIRRAModule.h"
 #include "PubSubClient.h"
 #include "WiFiClientSecure.h"
+#include "adr.h"
 #include "config.h"
 #include <vector>
 
-#define COMM_PERIOD_LENGTH(MAX_MESSAGES)                                                           \
-    ((MAX_MESSAGES * SENSOR_DATA_TIMEOUT + TIME_CONFIG_TIMEOUT) / 1000)
 #define IDEAL_MESSAGES(COMM_INTERVAL, SAMP_INTERVAL) (COMM_INTERVAL / SAMP_INTERVAL)
-#define MAX_MESSAGES(COMM_INTERVAL, SAMP_INTERVAL) ((3 * COMM_INTERVAL / (2 * SAMP_INTERVAL)) + 1)
+#define MAX_ENTRIES(COMM_INTERVAL, SAMP_INTERVAL) ((3 * COMM_INTERVAL / (2 * SAMP_INTERVAL)) + 1)
 
 namespace mirra
 {
+/// @return The maximum amount of messages a node may send in a comm period: enough to hold
+/// MAX_ENTRIES entries of the given amount of values. An unknown amount of values (zero) assumes
+/// the largest entries, one per message.
+constexpr uint32_t getMaxMessages(uint32_t commInterval, uint32_t sampleInterval, uint8_t nValues)
+{
+    uint32_t entriesPerMessage{static_cast<uint32_t>(Message<SENSOR_BATCH>::getEntriesPerBatch(
+        nValues == 0 ? Message<SENSOR_DATA>::maxNValues : nValues))};
+    return (MAX_ENTRIES(commInterval, sampleInterval) + entriesPerMessage - 1) / entriesPerMessage;
+}
+
+/// @return The length in s of the comm period of a node sending at most the given amount of
+/// messages at the highest spreading factor it may be assigned. It holds the tolerated clock
+/// difference, the time every message takes to be sent and every window takes to be
+/// acknowledged, as often as a window may be sent, and the time config exchange.
+constexpr uint32_t getCommPeriodLength(size_t maxMessages)
+{
+    constexpr uint8_t spreadingFactor{ADR_MAX_SPREADING_FACTOR};
+    uint32_t windows{static_cast<uint32_t>(maxMessages + SENSOR_DATA_WINDOW - 1) /
+                     SENSOR_DATA_WINDOW};
+    uint32_t round{
+        static_cast<uint32_t>(maxMessages) * SENSOR_DATA_FRAME_TIMEOUT(spreadingFactor) +
+        windows * LoRaModule::getAnswerTime(sizeof(Message<ACK_DATA>), spreadingFactor)};
+    uint32_t length{(1 + SENSOR_DATA_ATTEMPTS) * round + TIME_CONFIG_TIMEOUT(spreadingFactor)};
+    return COMM_PERIOD_PADDING + (length + 999) / 1000;
+}
 
 /// @brief Representation of a Sensor Node's attributes relevant for communication, used for
 /// tracking the status of nodes from the gateway.
@@ -29,6 +53,16 @@ private:
     uint32_t nextCommTime{0};
     uint32_t maxMessages{0};
     uint32_t errors{0};
+    // Fields below were appended to the layout stored in NVS. Nodes stored by older firmware load
+    // with their defaults.
+    /// @brief Link settings assigned by the adaptive data rate, zero for the defaults.
+    uint8_t spreadingFactor{0};
+    int8_t power{0};
+    /// @brief Lowest SNR (dB) and RSSI (dBm) of the node's messages in its last comm period.
+    float snr{0};
+    float rssi{0};
+    /// @brief Most values held by an entry of the node in its last comm period, zero if unknown.
+    uint8_t nValues{0};
 
 public:
     Node() {}
@@ -43,6 +77,20 @@ public:
 
     /// @return A Time Config message that yields the same exact configuration as this node.
     Message<TIME_CONFIG> currentTimeConfig(const MACAddress& src, uint32_t cTime);
+    /// @brief Records the signal quality of the node's messages in a comm period.
+    void setSignal(float snr, float rssi)
+    {
+        this->snr = snr;
+        this->rssi = rssi;
+    }
+    /// @brief Records the most values held by an entry of the node in a comm period, which its
+    /// maximum amount of messages is derived from.
+    void setNValues(uint8_t nValues) { this->nValues = nValues; }
+    /// @brief Adaptive data rate (see LinkAdaptation), keeping ADR_MARGIN above the SNR required by
+    /// the spreading factor of the node's current link.
+    /// @param snr Lowest SNR of the node's messages in the comm period, in dB.
+    /// @return The spreading factor and output power for the next comm period.
+    std::pair<uint8_t, int8_t> adaptLink(float snr) const;
 
     // TODO: Instead of using this lambda to determine if a node is lost, use a bool stored in each
     // node that signifies if a node is ' well-scheduled ', implying both that the node is not lost
@@ -67,6 +115,11 @@ public:
     uint32_t getCommInterval() const { return commInterval; }
     uint32_t getNextCommTime() const { return nextCommTime; }
     uint32_t getMaxMessages() const { return maxMessages; }
+    uint8_t getSpreadingFactor() const { return spreadingFactor; }
+    int8_t getPower() const { return power; }
+    float getSNR() const { return snr; }
+    float getRSSI() const { return rssi; }
+    uint8_t getNValues() const { return nValues; }
 
     void setSampleInterval(uint32_t sampleInterval) { this->sampleInterval = sampleInterval; }
     void setSampleRounding(uint32_t sampleRounding) { this->sampleRounding = sampleRounding; }
@@ -160,35 +213,41 @@ private:
         bool clientConnect();
     };
 
+    /// @brief Configuration of the gateway, stored in NVS as a single record so that changing it
+    /// costs at most one write.
     class Parameters
     {
+    public:
+        struct Values
+        {
+            std::array<char, 33> wifiSsid{defaultWifiSsid};
+            std::array<char, 33> wifiPass{defaultWifiPass};
+
+            std::array<char, 65> mqttServer{defaultMqttServer};
+            uint16_t mqttPort{defaultMqttPort};
+            std::array<char, 65> mqttPsk{defaultMqttPsk};
+
+            uint32_t sampleInterval{defaultSampleInterval};
+            uint32_t sampleRounding{defaultSampleRounding};
+            uint32_t sampleOffset{defaultSampleOffset};
+            uint32_t commInterval{defaultCommInterval};
+        };
+
+    private:
         fs::NVS nvs;
+        fs::NVS::Record<Values> values;
+
+        /// @brief Moves the parameters stored under separate keys by older firmware into the
+        /// record.
+        void migrate();
 
     public:
-        Parameters()
-            : nvs{"parameters"},
-              wifiSsid{nvs.getValue<std::array<char, 33>>("wifiSsid", defaultWifiSsid)},
-              wifiPass{nvs.getValue<std::array<char, 33>>("wifiPass", defaultWifiPass)},
-              mqttServer{nvs.getValue<std::array<char, 65>>("mqttServer", defaultMqttServer)},
-              mqttPort{nvs.getValue<uint16_t>("mqttPort", defaultMqttPort)},
-              mqttPsk{nvs.getValue<std::array<char, 65>>("mqttPsk", defaultMqttPsk)},
-              sampleInterval{nvs.getValue<uint32_t>("sampleInterval", defaultSampleInterval)},
-              sampleRounding{nvs.getValue<uint32_t>("sampleRounding", defaultSampleRounding)},
-              sampleOffset{nvs.getValue<uint32_t>("sampleOffset", defaultSampleOffset)},
-              commInterval{nvs.getValue<uint32_t>("commInterval", defaultCommInterval)}
-        {}
-
-        fs::NVS::Value<std::array<char, 33>> wifiSsid;
-        fs::NVS::Value<std::array<char, 33>> wifiPass;
-
-        fs::NVS::Value<std::array<char, 65>> mqttServer;
-        fs::NVS::Value<uint16_t> mqttPort;
-        fs::NVS::Value<std::array<char, 65>> mqttPsk;
-
-        fs::NVS::Value<uint32_t> sampleInterval;
-        fs::NVS::Value<uint32_t> sampleRounding;
-        fs::NVS::Value<uint32_t> sampleOffset;
-        fs::NVS::Value<uint32_t> commInterval;
+        Parameters();
+
+        Values* operator->() { return &*values; }
+        const Values* operator->() const { return &*values; }
+        /// @brief Writes the parameters to NVS, if any of them were changed.
+        void commit() { values.commit(); }
     };
 
     std::vector<Node> nodes;
@@ -2,8 +2,10 @@
 #define __COMMANDS_H__
 
 #include <array>
+#include <cstdint>
 #include <optional>
 #include <tuple>
+#include <utility>
 
 #define UART_PHASE_TIMEOUT                                                                         \
     (1 * 60) // s, length of UART inactivity required to automatically exit command phase
@@ -80,21 +82,73 @@ public:
     typename std::enable_if_t<std::is_base_of_v<CommonCommands, C>, void> prompt(C&& commands);
     // @brief Forcibly sets the commandPhaseFlag to true.
     void setFlag() { commandPhaseFlag = true; };
+    /// @return Whether the command phase will be entered when prompted.
+    bool isFlagSet() const { return commandPhaseFlag; }
 };
 
 class CommandParser
 {
     /// @brief Maximum line length in characters when entering commands.
     static constexpr size_t lineMaxLength{256};
+    /// @brief Maximum amount of arguments a command can take.
+    static constexpr size_t maxArgs{8};
+    using Arguments = std::array<char*, maxArgs>;
     template <class Tup, size_t I = 0>
     CommandCode parseArgs(Tup& argsTuple, const std::array<char*, std::tuple_size_v<Tup>>& buffers);
-    /// @brief Reads the command, calls the correct function with appropriate arguments.
+    /// @brief Calls the command in the commands set with the given alias that takes the given
+    /// amount of arguments.
+    /// @return The command code returned by the command. Disengaged if no command matched.
+    template <class C, size_t I = 0>
+    std::optional<CommandCode> callCommand(const char* command, const Arguments& args,
+                                           size_t nArgs, C&& commands);
+    /// @return Whether any command in the commands set has the given alias.
+    template <class C> static bool hasAlias(const char* command);
+
+    static constexpr bool equals(const char* a, const char* b)
+    {
+        for (; *a != '\0' && *a == *b; a++, b++)
+            ;
+        return *a == *b;
+    }
+    template <class A, class B> static constexpr bool isOverloaded(const A& a, const B& b)
+    {
+        if (a.getCommandArgCount() != b.getCommandArgCount())
+            return false;
+        for (const char* aliasA : a.getAliases())
+            for (const char* aliasB : b.getAliases())
+                if (equals(aliasA, aliasB))
+                    return true;
+        return false;
+    }
+    template <size_t I, class Tup, size_t... J>
+    static constexpr bool isDistinct(const Tup& commands, std::index_sequence<J...>)
+    {
+        return ((J == I || !isOverloaded(std::get<I>(commands), std::get<J>(commands))) && ...);
+    }
+    template <class Tup, size_t... I>
+    static constexpr bool areDistinct(const Tup& commands, std::index_sequence<I...> indices)
+    {
+        return (isDistinct<I>(commands, indices) && ...);
+    }
+
+public:
+    /// @brief Splits the line into the command and its arguments and calls the command with the
+    /// entered alias that takes exactly as many arguments as were entered. Commands may share an
+    /// alias if they take a different amount of arguments. If none takes that many, the one taking
+    /// the most arguments of those taking fewer is called and the surplus arguments are ignored.
     /// @tparam C Commands set to be used for this command phase.
-    /// @param line Pointer to char buffer holding the command.
+    /// @param line Pointer to char buffer holding the command, split in place.
     /// @return A command code desribing the result of the execution of the command.
-    template <class C, size_t I = 0> CommandCode parseLine(char* line, C&& commands);
+    template <class C> CommandCode parseLine(char* line, C&& commands);
+    /// @return Whether every command in the commands set can be reached, i.e. no two commands
+    /// sharing an alias take the same amount of arguments.
+    template <class C> static constexpr bool isUnambiguous()
+    {
+        constexpr auto commands{C::getCommands()};
+        return areDistinct(commands,
+                           std::make_index_sequence<std::tuple_size_v<decltype(commands)>>{});
+    }
 
-public:
     /// @brief Reads a line from the UART input stream. Helper function to be used during the
     /// command phase.
     /// @return An array representing a command sequence entered by the user. Disengaged if this
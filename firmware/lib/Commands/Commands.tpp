@@ -3,6 +3,7 @@
 #include "Commands.h"
 
 #include <Arduino.h>
+#include <algorithm>
 #include <charconv>
 
 template <class C>
@@ -80,6 +81,8 @@ template <class C>
 typename std::enable_if_t<std::is_base_of_v<CommonCommands, C>, void>
 CommandParser::start(C&& commands)
 {
+    static_assert(isUnambiguous<std::decay_t<C>>(),
+                  "Commands sharing an alias must take a different amount of arguments.");
     Serial.println("COMMAND PHASE");
     while (true)
     {
@@ -106,7 +109,7 @@ CommandParser::start(C&& commands)
     }
 }
 
-template <class Tup, size_t I = 0>
+template <class Tup, size_t I>
 CommandCode CommandParser::parseArgs(Tup& argsTuple,
                                      const std::array<char*, std::tuple_size_v<Tup>>& buffers)
 {
@@ -137,51 +140,74 @@ CommandCode CommandParser::parseArgs(Tup& argsTuple,
     }
 }
 
-template <class C, size_t I = 0> CommandCode CommandParser::parseLine(char* line, C&& commands)
+template <class C, size_t I>
+std::optional<CommandCode> CommandParser::callCommand(const char* command, const Arguments& args,
+                                                      size_t nArgs, C&& commands)
 {
-    char* command{line};
-    if constexpr (I == 0)
-    {
-        command = strtok(line, " \r\n");
-        if (command == nullptr) // when no command entered, simply loop again
-            return COMMAND_NOT_FOUND;
-    }
-    constexpr auto commandsTuple{C::getCommands()};
+    constexpr auto commandsTuple{std::decay_t<C>::getCommands()};
     if constexpr (I >= std::tuple_size_v<decltype(commandsTuple)>)
     {
-        Serial.printf("Command '%s' not found.\n", command);
-        return COMMAND_NOT_FOUND;
+        return std::nullopt;
     }
     else
     {
         constexpr auto pair{std::get<I>(commandsTuple)};
+        constexpr size_t argCount{pair.getCommandArgCount()};
+        static_assert(argCount <= maxArgs, "Command takes more arguments than can be entered.");
         constexpr auto aliases{pair.getAliases()};
-        for (const char* alias : aliases)
-            if (strcmp(command, alias) == 0)
-            {
-                constexpr auto function{pair.getCommand()};
-                typename decltype(pair)::ArgsTuple commandArgs;
-                std::array<char*, pair.getCommandArgCount()> commandArgsBuffer;
-                for (char*& commandArgBuffer : commandArgsBuffer)
+        if (nArgs == argCount)
+            for (const char* alias : aliases)
+                if (strcmp(command, alias) == 0)
                 {
-                    commandArgBuffer = strtok(nullptr, " \r\n");
-                    if (commandArgBuffer == nullptr)
+                    constexpr auto function{pair.getCommand()};
+                    typename decltype(pair)::ArgsTuple commandArgs;
+                    std::array<char*, argCount> commandArgsBuffer;
+                    std::copy_n(args.begin(), argCount, commandArgsBuffer.begin());
+                    if (parseArgs(commandArgs, commandArgsBuffer) != COMMAND_SUCCESS)
                     {
-                        Serial.printf("Command '%s' expects %u argument(s) but received fewer.\n",
-                                      alias, pair.getCommandArgCount());
-                        return COMMAND_NOT_FOUND;
+                        return COMMAND_ERROR;
                     }
+                    return std::apply(function,
+                                      std::tuple_cat(std::forward_as_tuple(commands), commandArgs));
                 }
-                if (parseArgs(commandArgs, commandArgsBuffer) != COMMAND_SUCCESS)
-                {
-                    return COMMAND_ERROR;
-                }
-                // implement argument parsing here
-                return std::apply(function,
-                                  std::tuple_cat(std::forward_as_tuple(commands), commandArgs));
-            }
 
-        return parseLine<C, I + 1>(command, std::forward<C>(commands));
+        return callCommand<C, I + 1>(command, args, nArgs, std::forward<C>(commands));
     }
 }
+
+template <class C> bool CommandParser::hasAlias(const char* command)
+{
+    return std::apply(
+        [command](const auto&... pairs)
+        {
+            auto isAlias{[command](const auto& aliases)
+                         {
+                             return std::any_of(aliases.begin(), aliases.end(),
+                                                [command](const char* alias)
+                                                { return strcmp(command, alias) == 0; });
+                         }};
+            return (isAlias(pairs.getAliases()) || ...);
+        },
+        C::getCommands());
+}
+
+template <class C> CommandCode CommandParser::parseLine(char* line, C&& commands)
+{
+    char* command{strtok(line, " \r\n")};
+    if (command == nullptr) // when no command entered, simply loop again
+        return COMMAND_NOT_FOUND;
+    Arguments args;
+    size_t nArgs{0};
+    while (nArgs < maxArgs && (args[nArgs] = strtok(nullptr, " \r\n")) != nullptr)
+        nArgs++;
+    // surplus arguments are ignored when no command takes as many
+    for (size_t n{nArgs + 1}; n-- > 0;)
+        if (auto code{callCommand(command, args, n, std::forward<C>(commands))})
+            return *code;
+    if (hasAlias<std::decay_t<C>>(command))
+        Serial.printf("Command '%s' received too few arguments.\n", command);
+    else
+        Serial.printf("Command '%s' not found.\n", command);
+    return COMMAND_NOT_FOUND;
+}
 #endif
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "CommunicationCommon.h"
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
 
 char* MACAddress::toString(char* string) const
 {
@@ -19,3 +21,50 @@ MACAddress MACAddress::fromString(const char* string)
 }
 const MACAddress MACAddress::broadcast{};
 char MACAddress::strBuffer[MACAddress::stringLength];
+
+bool Message<SENSOR_BATCH>::push(uint32_t time, uint8_t nValues, const SensorValue* values)
+{
+    nValues = std::min(nValues, static_cast<uint8_t>(Message<SENSOR_DATA>::maxNValues));
+    size_t entrySize{sizeof(EntryHeader) + nValues * sizeof(SensorValue)};
+    if (size + entrySize > maxSize)
+        return false;
+    EntryHeader header{time, nValues};
+    std::memcpy(&data[size], &header, sizeof(header));
+    std::memcpy(&data[size + sizeof(header)], values, nValues * sizeof(SensorValue));
+    size += entrySize;
+    nEntries++;
+    return true;
+}
+
+std::optional<Message<SENSOR_DATA>> Message<SENSOR_BATCH>::getEntry(size_t& offset) const
+{
+    if (offset + sizeof(EntryHeader) > size)
+        return std::nullopt;
+    EntryHeader header;
+    std::memcpy(&header, &data[offset], sizeof(header));
+    size_t valuesSize{header.nValues * sizeof(SensorValue)};
+    if (header.nValues > Message<SENSOR_DATA>::maxNValues ||
+        offset + sizeof(header) + valuesSize > size)
+        return std::nullopt;
+    Message<SENSOR_DATA> entry{getSource(), getDest(), header.time, header.nValues, {}};
+    std::memcpy(entry.values.data(), &data[offset + sizeof(header)], valuesSize);
+    offset += sizeof(header) + valuesSize;
+    return entry;
+}
+
+bool WindowReceiver::receive(const Message<SENSOR_BATCH>& message)
+{
+    if (window != message.getWindow())
+    {
+        window = message.getWindow();
+        received = 0;
+    }
+    windowMask = (1 << message.getWindowSize()) - 1;
+    last = message.isLast();
+    burstOver = message.getRemaining() == 0;
+    uint16_t bit = 1 << message.getSequence();
+    if (received & bit)
+        return false;
+    received |= bit;
+    return true;
+}
@@ -2,6 +2,7 @@
 #define __COMM_COMM_H__
 
 #include <array>
+#include <optional>
 
 #include "Sensor.h"
 
@@ -60,7 +61,8 @@ enum MessageType : uint8_t
     SENSOR_DATA = 5,
     ACK_DATA = 6,
     REPEAT = 7,
-    ALL = 8
+    SENSOR_BATCH = 8,
+    ALL = 9
 };
 
 /// @brief Base class providing a common interface between all message types and the header portion
@@ -99,12 +101,12 @@ public:
 
     /// @brief Converts this message in-place to a byte buffer.
     /// @return The pointer to the resulting byte buffer.
-    constexpr const uint8_t* toData() const { return reinterpret_cast<const uint8_t*>(this); }
+    const uint8_t* toData() const { return reinterpret_cast<const uint8_t*>(this); }
 
     /// @brief The length of the header in bytes.
     static constexpr size_t headerLength{1 + 2 * sizeof(MACAddress)};
-    /// @brief The maximum length of a message in bytes.
-    static constexpr size_t maxLength{256};
+    /// @brief The maximum length of a message in bytes, the maximum payload length of the SX1272.
+    static constexpr size_t maxLength{255};
 } __attribute__((packed));
 
 /// @brief Final message class.
@@ -120,17 +122,27 @@ public:
     /// @brief Converts a byte buffer in-place to this message type, without any runtime checking.
     /// @param data The byte buffer to interpret a message from.
     /// @return The resulting message object.
-    constexpr static Message<T>& fromData(uint8_t* data)
+    static Message<T>& fromData(uint8_t* data)
     {
         return *reinterpret_cast<Message<T>*>(data);
     }
 } __attribute__((packed));
 
+/// @brief Configures the schedule and link of a node. The time config message ending a comm period
+/// also acknowledges the final window of SENSOR_BATCH messages, in place of an ACK_DATA message.
 template <> class Message<TIME_CONFIG> : public MessageHeader
 {
 private:
     uint32_t curTime, sampleInterval, sampleRounding, sampleOffset, commInterval, commTime,
         maxMessages;
+    /// @brief Number of the acknowledged window within the comm period.
+    uint8_t window{0};
+    /// @brief Bitmap of the messages of the window that were received, by index in the window.
+    uint16_t received{0};
+    /// @brief Spreading factor and output power (dBm) for the node's next comm period, assigned by
+    /// the gateway's adaptive data rate. Zero for the defaults of the firmware.
+    uint8_t spreadingFactor{0};
+    int8_t power{0};
 
 public:
     Message(const MACAddress& src, const MACAddress& dest, uint32_t curTime,
@@ -147,6 +159,21 @@ public:
     uint32_t getCommInterval() const { return commInterval; }
     uint32_t getCommTime() const { return commTime; }
     uint32_t getMaxMessages() const { return maxMessages; }
+    uint8_t getWindow() const { return window; }
+    uint16_t getReceived() const { return received; }
+    /// @brief Sets the acknowledgement of the final window of the comm period.
+    void setReceived(uint8_t window, uint16_t received)
+    {
+        this->window = window;
+        this->received = received;
+    }
+    uint8_t getSpreadingFactor() const { return spreadingFactor; }
+    int8_t getPower() const { return power; }
+    void setLink(uint8_t spreadingFactor, int8_t power)
+    {
+        this->spreadingFactor = spreadingFactor;
+        this->power = power;
+    }
 
     /// @return The messages' length in bytes.
     constexpr size_t getLength() const { return sizeof(*this); }
@@ -155,7 +182,7 @@ public:
     /// @brief Converts a byte buffer in-place to this message type, without any runtime checking.
     /// @param data The byte buffer to interpret a message from.
     /// @return The resulting message object.
-    constexpr static Message<TIME_CONFIG>& fromData(uint8_t* data)
+    static Message<TIME_CONFIG>& fromData(uint8_t* data)
     {
         return *reinterpret_cast<Message<TIME_CONFIG>*>(data);
     }
@@ -171,8 +198,12 @@ public:
     uint8_t nValues;
 
     /// @brief The maximum amount of sensor values that can be held in a single sensor data message.
-    static constexpr size_t maxNValues =
-        (maxLength - headerLength - sizeof(time) - sizeof(nValues)) / sizeof(SensorValue);
+    /// An entry holding as many values must also fit a single SENSOR_BATCH message, whose fields
+    /// take batchFieldsLength bytes.
+    static constexpr size_t batchFieldsLength{5};
+    static constexpr size_t maxNValues = (maxLength - headerLength - batchFieldsLength -
+                                          sizeof(time) - sizeof(nValues)) /
+                                         sizeof(SensorValue);
 
     struct SensorValueArray : public std::array<SensorValue, Message<SENSOR_DATA>::maxNValues>
     {
@@ -194,14 +225,180 @@ public:
     /// @brief Converts a byte buffer in-place to this message type, without any runtime checking.
     /// @param data The byte buffer to interpret a message from.
     /// @return The resulting message object.
-    static constexpr Message<SENSOR_DATA>& fromData(uint8_t* data);
+    static Message<SENSOR_DATA>& fromData(uint8_t* data);
 } __attribute__((packed));
 
-constexpr Message<SENSOR_DATA>& Message<SENSOR_DATA>::fromData(uint8_t* data)
+inline Message<SENSOR_DATA>& Message<SENSOR_DATA>::fromData(uint8_t* data)
 {
     Message<SENSOR_DATA>& m{*reinterpret_cast<Message<SENSOR_DATA>*>(data)};
     m.nValues = std::min(m.nValues, static_cast<uint8_t>(maxNValues));
     return m;
 }
 
+/// @brief Message packing as many sensor data entries as fit. Every entry consists of its
+/// timestamp and amount of values, followed by the values themselves, so that entries are not
+/// padded to the maximum amount of values. The source of every entry is the source of the message.
+///
+/// Messages are sent in windows: bursts of messages sent back to back, acknowledged at once by a
+/// single ACK_DATA message, or by the TIME_CONFIG message for the final window of a comm period.
+/// Every message holds its window number and index in the window, and the amount of messages sent
+/// right after it in the same burst, so that the receiver only answers once the burst is over.
+template <> class Message<SENSOR_BATCH> : public MessageHeader
+{
+public:
+    /// @brief Header of an entry in the batch, followed by its values.
+    struct EntryHeader
+    {
+        /// @brief The timestamp associated with the entry's values (UNIX epoch, seconds).
+        uint32_t time;
+        uint8_t nValues;
+    } __attribute__((packed));
+
+private:
+    /// @brief The amount of entries held in the batch.
+    uint8_t nEntries{0};
+    /// @brief The size of the entries held in the batch in bytes.
+    uint8_t size{0};
+    /// @brief Number of the window holding the message within the comm period.
+    uint8_t window{0};
+    /// @brief Index of the message in its window.
+    uint8_t sequence : 4;
+    /// @brief Amount of messages in the window.
+    uint8_t windowSize : 4;
+    /// @brief Amount of messages sent right after this one in the same burst. Bursts resending a
+    /// window only hold the messages that were not acknowledged.
+    uint8_t remaining{0};
+
+public:
+    /// @brief The maximum size of the entries held in a single batch in bytes.
+    static constexpr size_t maxSize{maxLength - headerLength -
+                                    Message<SENSOR_DATA>::batchFieldsLength};
+    /// @brief The maximum amount of messages in a window.
+    static constexpr size_t maxWindowSize{(1 << 4) - 1};
+    /// @brief The maximum amount of entries that can be held in a single batch.
+    static constexpr size_t maxNEntries{maxSize / sizeof(EntryHeader)};
+    /// @return The amount of entries holding the given amount of values that fit a single batch.
+    static constexpr size_t getEntriesPerBatch(size_t nValues)
+    {
+        nValues = std::min(nValues, Message<SENSOR_DATA>::maxNValues);
+        return maxSize / (sizeof(EntryHeader) + nValues * sizeof(SensorValue));
+    }
+    static_assert(sizeof(EntryHeader) +
+                      Message<SENSOR_DATA>::maxNValues * sizeof(SensorValue) <=
+                  maxSize);
+
+private:
+    std::array<uint8_t, maxSize> data;
+
+public:
+    Message(const MACAddress& src, const MACAddress& dest)
+        : MessageHeader(SENSOR_BATCH, src, dest), sequence{0}, windowSize{1}
+    {}
+
+    uint8_t getNEntries() const { return nEntries; }
+    uint8_t getWindow() const { return window; }
+    uint8_t getSequence() const { return sequence; }
+    uint8_t getWindowSize() const { return windowSize; }
+    uint8_t getRemaining() const { return remaining; }
+    /// @brief Sets the window of this message.
+    /// @param window Number of the window within the comm period.
+    /// @param sequence Index of the message in the window.
+    /// @param windowSize Amount of messages in the window, at most maxWindowSize.
+    void setWindow(uint8_t window, uint8_t sequence, uint8_t windowSize)
+    {
+        this->window = window;
+        this->sequence = sequence;
+        this->windowSize = windowSize;
+    }
+    /// @brief Sets the amount of messages sent right after this one in the same burst.
+    void setRemaining(uint8_t remaining) { this->remaining = remaining; }
+    /// @brief Appends an entry to the batch, if it fits.
+    /// @param values Array of nValues sensor values.
+    /// @return Whether the entry was appended.
+    bool push(uint32_t time, uint8_t nValues, const SensorValue* values);
+    /// @brief Unpacks the entry at the given offset in the batch as a sensor data message.
+    /// @param offset Offset of the entry in the batch, set to the offset of the next entry.
+    /// @return The unpacked entry. Disengaged if the entry does not fit the batch.
+    std::optional<Message<SENSOR_DATA>> getEntry(size_t& offset) const;
+
+    /// @return The messages' length in bytes.
+    constexpr size_t getLength() const { return sizeof(*this) - maxSize + size; }
+    /// @return Whether the message's type flag matches the desired type.
+    constexpr bool isValid() const { return isType(SENSOR_BATCH); }
+    /// @brief Converts a byte buffer in-place to this message type, without any runtime checking.
+    /// @param data The byte buffer to interpret a message from.
+    /// @return The resulting message object.
+    static Message<SENSOR_BATCH>& fromData(uint8_t* data);
+} __attribute__((packed));
+
+static_assert(sizeof(Message<SENSOR_DATA>) <= MessageHeader::maxLength);
+static_assert(sizeof(Message<SENSOR_BATCH>) <= MessageHeader::maxLength);
+static_assert(sizeof(Message<SENSOR_BATCH>) - Message<SENSOR_BATCH>::maxSize ==
+              MessageHeader::headerLength + Message<SENSOR_DATA>::batchFieldsLength);
+
+inline Message<SENSOR_BATCH>& Message<SENSOR_BATCH>::fromData(uint8_t* data)
+{
+    Message<SENSOR_BATCH>& m{*reinterpret_cast<Message<SENSOR_BATCH>*>(data)};
+    m.size = std::min(m.size, static_cast<uint8_t>(maxSize));
+    return m;
+}
+
+/// @brief Acknowledgement of a window of SENSOR_BATCH messages.
+template <> class Message<ACK_DATA> : public MessageHeader
+{
+private:
+    /// @brief Number of the acknowledged window within the comm period.
+    uint8_t window;
+    /// @brief Bitmap of the messages of the window that were received, by index in the window.
+    uint16_t received;
+    static_assert(Message<SENSOR_BATCH>::maxWindowSize <= sizeof(received) * 8);
+
+public:
+    Message(const MACAddress& src, const MACAddress& dest, uint8_t window, uint16_t received)
+        : MessageHeader(ACK_DATA, src, dest), window{window}, received{received} {};
+
+    uint8_t getWindow() const { return window; }
+    uint16_t getReceived() const { return received; }
+
+    /// @return The messages' length in bytes.
+    constexpr size_t getLength() const { return sizeof(*this); }
+    /// @return Whether the message's type flag matches the desired type.
+    constexpr bool isValid() const { return isType(ACK_DATA); }
+    /// @brief Converts a byte buffer in-place to this message type, without any runtime checking.
+    /// @param data The byte buffer to interpret a message from.
+    /// @return The resulting message object.
+    static Message<ACK_DATA>& fromData(uint8_t* data)
+    {
+        return *reinterpret_cast<Message<ACK_DATA>*>(data);
+    }
+} __attribute__((packed));
+
+/// @brief Keeps track of the windows of SENSOR_BATCH messages received from a node, to acknowledge
+/// them with an ACK_DATA or TIME_CONFIG message.
+class WindowReceiver
+{
+    std::optional<uint8_t> window;
+    /// @brief Bitmap of the messages of the current window received.
+    uint16_t received{0};
+    uint16_t windowMask{0};
+    bool last{false};
+    bool burstOver{false};
+
+public:
+    /// @brief Registers a received message. A message of another window starts that window.
+    /// @return Whether the message was not received before, and its entries are to be unpacked.
+    bool receive(const Message<SENSOR_BATCH>& message);
+    /// @return Whether the last message received ended its burst. Until then, the node is still
+    /// sending and does not listen for the acknowledgement, even when all messages of the window
+    /// were received before.
+    bool isBurstOver() const { return burstOver; }
+    /// @return Whether all messages of the current window were received.
+    bool isComplete() const { return (received & windowMask) == windowMask; }
+    /// @return Whether the current window is the final window of the comm period.
+    bool isLast() const { return last; }
+    uint8_t getWindow() const { return window.value_or(0); }
+    /// @return Bitmap of the messages of the current window received, by index in the window.
+    uint16_t getReceived() const { return received & windowMask; }
+};
+
 #endif
@@ -15,19 +15,66 @@ LoRaModule::LoRaModule(const uint8_t csPin, const uint8_t rstPin, const uint8_t
                             LORA_SYNC_WORD, LORA_POWER, LORA_PREAMBLE_LENGHT, LORA_AMPLIFIER_GAIN);
     if (state == RADIOLIB_ERR_NONE)
     {
-        Log::debug("LoRa init successful for ", this->getMACAddress().toString());
+        LOG_DEBUG(LORA, "LoRa init successful for ", this->getMACAddress().toString());
     }
     else
     {
-        Log::error("LoRa module init failed, code: ", state);
+        LOG_ERROR(LORA, "LoRa module init failed, code: ", state);
     }
 };
 
+void LoRaModule::setLink(uint8_t spreadingFactor, int8_t power)
+{
+    if (spreadingFactor < 7 || spreadingFactor > 12 || power < LORA_POWER_MIN ||
+        power > LORA_POWER_MAX)
+    {
+        spreadingFactor = LORA_SPREADING_FACTOR;
+        power = LORA_POWER;
+    }
+    if (spreadingFactor == this->spreadingFactor && power == this->power)
+        return;
+    LOG_DEBUG(LORA, "Switching link to SF", spreadingFactor, " at ", power, " dBm");
+    int state{this->setSpreadingFactor(spreadingFactor)};
+    if (state == RADIOLIB_ERR_NONE)
+        state = this->setOutputPower(power);
+    if (state != RADIOLIB_ERR_NONE)
+    {
+        LOG_ERROR(LORA, "Switching link failed, code: ", state);
+        return;
+    }
+    this->spreadingFactor = spreadingFactor;
+    this->power = power;
+}
+
+bool LoRaModule::awaitClearChannel()
+{
+    for (size_t attempt{0}; attempt < LORA_LBT_ATTEMPTS; attempt++)
+    {
+        int state{this->scanChannel()};
+        if (state == RADIOLIB_CHANNEL_FREE)
+            return true;
+        if (state != RADIOLIB_PREAMBLE_DETECTED)
+        {
+            LOG_ERROR(LORA, "Channel activity detection failed, code: ", state);
+            return false;
+        }
+        uint32_t backoffMs{(esp_random() % LORA_LBT_BACKOFF + 1)
+                           << (this->spreadingFactor - LORA_SPREADING_FACTOR)};
+        LOG_DEBUG(LORA, "Channel in use, backing off for ", backoffMs, "ms");
+        esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
+        esp_sleep_enable_timer_wakeup(backoffMs * 1000);
+        esp_light_sleep_start();
+    }
+    LOG_ERROR(LORA, "Channel still in use after ", LORA_LBT_ATTEMPTS, " attempts, sending anyway.");
+    return false;
+}
+
 void LoRaModule::sendRepeat(const MACAddress& dest)
 {
-    Log::debug("Sending REPEAT message to ", dest.toString());
+    LOG_DEBUG(LORA, "Sending REPEAT message to ", dest.toString());
     auto repeatMessage = Message<REPEAT>(this->mac, dest);
     sendPacket(repeatMessage.toData(), repeatMessage.getLength());
+    repeatsSent++;
 }
 
 void LoRaModule::sendPacket(const uint8_t* buffer, size_t length)
@@ -38,11 +85,11 @@ void LoRaModule::sendPacket(const uint8_t* buffer, size_t length)
     if (state == RADIOLIB_ERR_NONE)
     {
         esp_light_sleep_start();
-        Log::debug("Packet sent!");
+        LOG_DEBUG(LORA, "Packet sent!");
     }
     else
     {
-        Log::error("Send failed, code: ", state);
+        LOG_ERROR(LORA, "Send failed, code: ", state);
     }
     this->finishTransmit();
 }
@@ -51,10 +98,11 @@ void LoRaModule::resendMessage()
 {
     if (sendLength == 0)
     {
-        Log::error("Could not repeat last sent message because no message has been sent yet.");
+        LOG_ERROR(LORA, "Could not repeat last sent message because no message has been sent yet.");
         esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
         return;
     }
-    Log::debug("Resending last sent message to ", this->getLastDest().toString());
+    LOG_DEBUG(LORA, "Resending last sent message to ", this->getLastDest().toString());
     sendPacket(this->sendBuffer, this->sendLength);
+    repeatsAnswered++;
 }
\ No newline at end of file
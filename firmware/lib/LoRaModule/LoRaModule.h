@@ -19,8 +19,21 @@
 #define LORA_POWER 10
 #define LORA_PREAMBLE_LENGHT 8
 #define LORA_AMPLIFIER_GAIN 0 // 0 is automatic
+#define LORA_IMPLICIT_HEADER 0 // messages are sent with an explicit header
+#define LORA_CRC 1             // messages are sent with a payload CRC
+// Range of the output power (dBm) the adaptive data rate may assign to a link
+#define LORA_POWER_MIN 2
+#define LORA_POWER_MAX 14
 
-#define SEND_DELAY 500 // ms, time to wait before sending a message
+#define LORA_RX_ENTER_LATENCY                                                                      \
+    10 // ms, time a module takes from the end of its transmission until it listens for the answer
+#define LORA_TURNAROUND_GUARD                                                                      \
+    (2 * LORA_RX_ENTER_LATENCY) // ms, time to wait before answering a message
+#define LORA_PROCESSING_TIME                                                                       \
+    100 // ms, time a module may take to process a message before it answers the message
+#define LORA_LBT_ATTEMPTS 3 // channel activity detections before sending regardless of activity
+#define LORA_LBT_BACKOFF                                                                           \
+    100 // ms, maximum random backoff after detecting activity, doubled per spreading factor step
 
 namespace mirra
 {
@@ -40,6 +53,18 @@ private:
     uint8_t sendBuffer[MessageHeader::maxLength]{0};
     /// @brief  Length of message currently stored in sendBuffer
     size_t sendLength{0};
+    /// @brief Amount of REPEAT messages sent, and received and answered, since the last message
+    /// was sent.
+    size_t repeatsSent{0}, repeatsAnswered{0};
+
+    /// @brief Spreading factor and output power currently in use.
+    uint8_t spreadingFactor{LORA_SPREADING_FACTOR};
+    int8_t power{LORA_POWER};
+
+    /// @brief Listens before talk: detects channel activity and backs off for a random time as
+    /// long as the channel is in use, up to LORA_LBT_ATTEMPTS times.
+    /// @return Whether the channel was found clear.
+    bool awaitClearChannel();
 
     /// @return The destination MAC address of the message currently stored in the sendBuffer
     const MACAddress& getLastDest()
@@ -60,11 +85,68 @@ public:
     /// @return The local MAC address of this module.
     const MACAddress& getMACAddress() { return mac; }
 
-    /// @brief
+    /// @brief Switches the link to the given spreading factor and output power. Settings out of
+    /// the supported range, such as zero, select the defaults (LORA_SPREADING_FACTOR, LORA_POWER).
+    /// @param spreadingFactor Spreading factor, 7 to 12.
+    /// @param power Output power in dBm, LORA_POWER_MIN to LORA_POWER_MAX.
+    void setLink(uint8_t spreadingFactor, int8_t power);
+    /// @brief Switches the link back to the default spreading factor and output power.
+    void resetLink() { setLink(LORA_SPREADING_FACTOR, LORA_POWER); }
+    uint8_t getSpreadingFactor() const { return spreadingFactor; }
+    int8_t getPower() const { return power; }
+    /// @return The amount of REPEAT messages sent since the last message was sent.
+    size_t getRepeatsSent() const { return repeatsSent; }
+    /// @return The amount of REPEAT messages answered since the last message was sent.
+    size_t getRepeatsAnswered() const { return repeatsAnswered; }
+    /// @return The lowest SNR in dB at which a message sent with the given spreading factor can
+    /// still be demodulated.
+    static constexpr float getRequiredSNR(uint8_t spreadingFactor)
+    {
+        return -5.0f - 2.5f * (spreadingFactor - 6);
+    }
+    /// @return The duration in us of a symbol sent with the given spreading factor.
+    static constexpr uint32_t getSymbolTime(uint8_t spreadingFactor)
+    {
+        return static_cast<uint32_t>((1UL << spreadingFactor) * 1000 / LORA_BANDWIDTH);
+    }
+    /// @return The time on air in ms of a message of the given length sent with the given
+    /// spreading factor, following the Semtech SX1272 datasheet.
+    static constexpr uint32_t getTimeOnAir(size_t length,
+                                           uint8_t spreadingFactor = LORA_SPREADING_FACTOR)
+    {
+        uint32_t symbolTime{getSymbolTime(spreadingFactor)};
+        // the radio optimizes for low data rates once symbols take longer than 16 ms
+        int32_t lowDataRateOptimize{symbolTime > 16000 ? 1 : 0};
+        int32_t bits{static_cast<int32_t>(8 * length) - 4 * spreadingFactor + 28 + 16 * LORA_CRC -
+                     20 * LORA_IMPLICIT_HEADER};
+        int32_t bitsPerBlock{4 * (spreadingFactor - 2 * lowDataRateOptimize)};
+        int32_t blocks{std::max<int32_t>((bits + bitsPerBlock - 1) / bitsPerBlock, 0)};
+        // the preamble is followed by 4.25 symbols of sync word, the payload by 8 symbols
+        uint32_t quarterSymbols{
+            static_cast<uint32_t>(4 * (LORA_PREAMBLE_LENGHT + 8 + blocks * LORA_CODING_RATE) + 17)};
+        return (quarterSymbols * symbolTime / 4 + 999) / 1000;
+    }
+    /// @return The maximum time in ms from the end of a transmission until an answer of the given
+    /// length is received, if the peer answers with the given spreading factor after the given
+    /// delay (see sendMessage). This covers the time to process the message, the delay, listening
+    /// before talk and the time on air of the answer.
+    static constexpr uint32_t getAnswerTime(size_t length,
+                                            uint8_t spreadingFactor = LORA_SPREADING_FACTOR,
+                                            uint32_t delay = LORA_TURNAROUND_GUARD)
+    {
+        uint32_t detectionTime{(2 * getSymbolTime(spreadingFactor) + 999) / 1000};
+        uint32_t backoffTime{static_cast<uint32_t>(LORA_LBT_BACKOFF)
+                             << (spreadingFactor - LORA_SPREADING_FACTOR)};
+        return LORA_PROCESSING_TIME + delay + LORA_LBT_ATTEMPTS * (detectionTime + backoffTime) +
+               getTimeOnAir(length, spreadingFactor);
+    }
+
+    /// @brief Sends a message once the channel is clear.
     /// @tparam T Type of the message to be sent. Must be of the enum MessageType.
     /// @param message The message to be sent.
-    /// @param delay Delay in ms to wait before sending the message
-    template <class T> void sendMessage(T&& message, uint32_t delay = SEND_DELAY);
+    /// @param delay Delay in ms to wait before sending the message. By default, the time the peer
+    /// needs to start listening after sending the message this one answers.
+    template <class T> void sendMessage(T&& message, uint32_t delay = LORA_TURNAROUND_GUARD);
     /// @brief Sends a repeat message to the given destination. This function does not modify the
     /// sendBuffer.
     /// @param dest Destination of repeat message
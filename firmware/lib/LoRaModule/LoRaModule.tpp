@@ -7,9 +7,11 @@ template <class T> void LoRaModule::sendMessage(T&& message, uint32_t delay)
     // this interrupt is used as wakeup source for the esp_light_sleep.
     char macSrcBuffer[MACAddress::stringLength];
     size_t length = message.getLength();
-    Log::debug("Sending message of type ", message.getType(), " and length ", length, " from ",
-               message.getSource().toString(macSrcBuffer), " to ", message.getDest().toString());
+    LOG_DEBUG(LORA, "Sending message of type ", message.getType(), " and length ", length, " from ",
+              message.getSource().toString(macSrcBuffer), " to ", message.getDest().toString());
     this->sendLength = length;
+    this->repeatsSent = 0;
+    this->repeatsAnswered = 0;
     message.fromData(this->sendBuffer) = std::forward<T>(message);
     if (delay > 0)
     {
@@ -17,6 +19,7 @@ template <class T> void LoRaModule::sendMessage(T&& message, uint32_t delay)
         esp_sleep_enable_timer_wakeup(delay * 1000);
         esp_light_sleep_start();
     }
+    awaitClearChannel();
     sendPacket(this->sendBuffer, this->sendLength);
 }
 
@@ -37,12 +40,12 @@ std::optional<Message<T>> LoRaModule::receiveMessage(uint32_t timeoutMs, size_t
     esp_sleep_enable_timer_wakeup((timeoutMs + listenMs) * 1000);
     do
     {
-        Log::debug("Starting receive ...");
+        LOG_DEBUG(LORA, "Starting receive ...");
         int state{this->startReceive()};
 
         if (state != RADIOLIB_ERR_NONE)
         {
-            Log::error("Receive failed, code: ", state);
+            LOG_ERROR(LORA, "Receive failed, code: ", state);
             return std::nullopt;
         }
 
@@ -58,41 +61,42 @@ std::optional<Message<T>> LoRaModule::receiveMessage(uint32_t timeoutMs, size_t
 
             if (state == RADIOLIB_ERR_CRC_MISMATCH)
             {
-                Log::error("Reading received data (", this->getPacketLength(false),
-                           " bytes) failed because of a CRC mismatch. Waiting for timeout and "
-                           "possible sending of REPEAT...");
+                LOG_ERROR(LORA, "Reading received data (", this->getPacketLength(false),
+                          " bytes) failed because of a CRC mismatch. Waiting for timeout and "
+                          "possible sending of REPEAT...");
                 continue;
             }
             if (state != RADIOLIB_ERR_NONE)
             {
-                Log::error("Reading received data (", this->getPacketLength(false),
-                           " bytes) failed, code: ", state);
+                LOG_ERROR(LORA, "Reading received data (", this->getPacketLength(false),
+                          " bytes) failed, code: ", state);
                 return std::nullopt;
             }
-            Log::debug("Reading received data (", this->getPacketLength(false), " bytes): success");
+            LOG_DEBUG(LORA, "Reading received data (", this->getPacketLength(false),
+                      " bytes): success");
             Message<T>& received{Message<T>::fromData(buffer)};
-            Log::debug("Message Type: ", received.getType());
-            Log::debug("Source: ", received.getSource().toString());
-            Log::debug("Dest: ", received.getDest().toString());
+            LOG_DEBUG(LORA, "Message Type: ", received.getType());
+            LOG_DEBUG(LORA, "Source: ", received.getSource().toString());
+            LOG_DEBUG(LORA, "Dest: ", received.getDest().toString());
             if (source.get() != MACAddress::broadcast && source.get() != received.getSource())
             {
                 char macSrcBuffer[MACAddress::stringLength];
-                Log::debug("Message from ", received.getSource().toString(),
-                           " discared because it is not the desired source of the message, namely ",
-                           source.get().toString(macSrcBuffer));
+                LOG_DEBUG(LORA, "Message from ", received.getSource().toString(),
+                          " discared because it is not the desired source of the message, namely ",
+                          source.get().toString(macSrcBuffer));
                 continue;
             }
 
             if ((!promiscuous) && (received.getDest() != this->mac) &&
                 (received.getDest() != MACAddress::broadcast))
             {
-                Log::debug("Message from ", received.getSource().toString(),
-                           " discarded because its destination does not match this device.");
+                LOG_DEBUG(LORA, "Message from ", received.getSource().toString(),
+                          " discarded because its destination does not match this device.");
                 continue;
             }
             if (received.isType(REPEAT))
             {
-                Log::debug("Received REPEAT message from ", received.getSource().toString());
+                LOG_DEBUG(LORA, "Received REPEAT message from ", received.getSource().toString());
                 if (this->getLastDest() == received.getSource())
                 {
                     this->resendMessage();
@@ -102,8 +106,8 @@ std::optional<Message<T>> LoRaModule::receiveMessage(uint32_t timeoutMs, size_t
             }
             if (!received.isValid())
             {
-                Log::debug("Message of type ", received.getType(),
-                           " discarded because message of type ", T, " is desired.");
+                LOG_DEBUG(LORA, "Message of type ", received.getType(),
+                          " discarded because message of type ", T, " is desired.");
                 continue;
             }
 
@@ -111,8 +115,8 @@ std::optional<Message<T>> LoRaModule::receiveMessage(uint32_t timeoutMs, size_t
         }
         else
         {
-            Log::debug("Receive timeout after ", timeoutMs, "ms with ", repeatAttempts,
-                       " repeat attempts left.");
+            LOG_DEBUG(LORA, "Receive timeout after ", timeoutMs, "ms with ", repeatAttempts,
+                      " repeat attempts left.");
             if (repeatAttempts == 0)
             {
                 return std::nullopt;
@@ -136,12 +140,12 @@ std::optional<Message<T>> LoRaModule::listenMessage(uint32_t timeoutMs, uint8_t
     esp_sleep_enable_timer_wakeup((timeoutMs)*1000);
     // Also use the wake pin to force wake-up
     esp_sleep_enable_ext1_wakeup(0x1 << wakePin, ESP_EXT1_WAKEUP_ALL_LOW);
-    Log::debug("Starting receive ...");
+    LOG_DEBUG(LORA, "Starting receive ...");
     int state{this->startReceive()};
 
     if (state != RADIOLIB_ERR_NONE)
     {
-        Log::error("Receive failed, code: ", state);
+        LOG_ERROR(LORA, "Receive failed, code: ", state);
         return std::nullopt;
     }
 
@@ -156,26 +160,27 @@ std::optional<Message<T>> LoRaModule::listenMessage(uint32_t timeoutMs, uint8_t
 
         if (state == RADIOLIB_ERR_CRC_MISMATCH)
         {
-            Log::error("Reading received data (", this->getPacketLength(false),
-                       " bytes) failed because of a CRC mismatch. Waiting for timeout and possible "
-                       "sending of REPEAT...");
+            LOG_ERROR(LORA, "Reading received data (", this->getPacketLength(false),
+                      " bytes) failed because of a CRC mismatch. Waiting for timeout and possible "
+                      "sending of REPEAT...");
             return std::nullopt;
         }
         if (state != RADIOLIB_ERR_NONE)
         {
-            Log::error("Reading received data (", this->getPacketLength(false),
-                       " bytes) failed, code: ", state);
+            LOG_ERROR(LORA, "Reading received data (", this->getPacketLength(false),
+                      " bytes) failed, code: ", state);
             return std::nullopt;
         }
-        Log::debug("Reading received data (", this->getPacketLength(false), " bytes): success");
+        LOG_DEBUG(LORA, "Reading received data (", this->getPacketLength(false),
+                  " bytes): success");
         Message<T>& received{Message<T>::fromData(buffer)};
-        Log::debug("Message Type: ", received.getType());
-        Log::debug("Source: ", received.getSource().toString());
-        Log::debug("Dest: ", received.getDest().toString());
+        LOG_DEBUG(LORA, "Message Type: ", received.getType());
+        LOG_DEBUG(LORA, "Source: ", received.getSource().toString());
+        LOG_DEBUG(LORA, "Dest: ", received.getDest().toString());
         if (!received.isValid())
         {
-            Log::debug("Message of type ", received.getType(),
-                       " discarded because message of type ", T, " is desired.");
+            LOG_DEBUG(LORA, "Message of type ", received.getType(),
+                      " discarded because message of type ", T, " is desired.");
             return std::nullopt;
         }
         return received;
@@ -0,0 +1,188 @@
+#include "LogExport.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using namespace mirra::logexport;
+
+namespace
+{
+/// @brief Minimum length of a match in the LZ4 block format.
+constexpr size_t minMatch = 4;
+/// @brief The last bytes of a block are always literals.
+constexpr size_t lastLiterals = 5;
+/// @brief The last match must start at least this many bytes before the end of the block.
+constexpr size_t matchLimit = 12;
+
+constexpr std::array<uint32_t, 16> crcTable{[] {
+    std::array<uint32_t, 16> table{};
+    for (uint32_t i{0}; i < table.size(); i++)
+    {
+        uint32_t crc{i};
+        for (size_t bit{0}; bit < 4; bit++)
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+        table[i] = crc;
+    }
+    return table;
+}()};
+
+uint32_t read32(const uint8_t* data)
+{
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+/// @brief Writes the remainder of a length that did not fit its 4 bits in the token.
+uint8_t* writeLength(uint8_t* destination, size_t length)
+{
+    for (; length >= 0xFF; length -= 0xFF)
+        *destination++ = 0xFF;
+    *destination++ = static_cast<uint8_t>(length);
+    return destination;
+}
+
+/// @brief Writes a sequence of literals followed by a match, or by nothing if the match length is
+/// zero, which ends the block.
+uint8_t* writeSequence(uint8_t* destination, const uint8_t* literals, size_t literalLength,
+                       size_t offset, size_t matchLength)
+{
+    uint8_t* token{destination++};
+    *token = static_cast<uint8_t>(std::min<size_t>(literalLength, 0xF) << 4);
+    if (literalLength >= 0xF)
+        destination = writeLength(destination, literalLength - 0xF);
+    std::memcpy(destination, literals, literalLength);
+    destination += literalLength;
+    if (matchLength == 0)
+        return destination;
+    *destination++ = static_cast<uint8_t>(offset);
+    *destination++ = static_cast<uint8_t>(offset >> 8);
+    matchLength -= minMatch;
+    *token |= static_cast<uint8_t>(std::min<size_t>(matchLength, 0xF));
+    if (matchLength >= 0xF)
+        destination = writeLength(destination, matchLength - 0xF);
+    return destination;
+}
+
+/// @brief Reads the remainder of a length that did not fit its 4 bits in the token.
+/// @return Whether the length could be read before the end of the source.
+bool readLength(const uint8_t*& source, const uint8_t* end, size_t& length)
+{
+    uint8_t byte;
+    do
+    {
+        if (source == end)
+            return false;
+        byte = *source++;
+        length += byte;
+    } while (byte == 0xFF);
+    return true;
+}
+}
+
+uint32_t mirra::logexport::crc32(const uint8_t* data, size_t size, uint32_t crc)
+{
+    crc = ~crc;
+    for (size_t i{0}; i < size; i++)
+    {
+        crc = crcTable[(crc ^ data[i]) & 0xF] ^ (crc >> 4);
+        crc = crcTable[(crc ^ (data[i] >> 4)) & 0xF] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+size_t Compressor::compress(const uint8_t* source, size_t size, uint8_t* destination)
+{
+    uint8_t* start{destination};
+    table.fill(0);
+    size_t anchor{0};
+    for (size_t i{0}; i + matchLimit <= size;)
+    {
+        uint32_t sequence{read32(&source[i])};
+        uint16_t& entry{table[(sequence * 2654435761U) >> (32 - hashBits)]};
+        size_t candidate{entry};
+        entry = static_cast<uint16_t>(i);
+        // entries are only ever set within the block, so a match of the sequence is a valid match
+        if (candidate >= i || read32(&source[candidate]) != sequence)
+        {
+            i++;
+            continue;
+        }
+        size_t length{minMatch};
+        while (i + length < size - lastLiterals && source[candidate + length] == source[i + length])
+            length++;
+        destination =
+            writeSequence(destination, &source[anchor], i - anchor, i - candidate, length);
+        i += length;
+        anchor = i;
+    }
+    destination = writeSequence(destination, &source[anchor], size - anchor, 0, 0);
+    return destination - start;
+}
+
+std::optional<size_t> mirra::logexport::decompress(const uint8_t* source, size_t size,
+                                                   uint8_t* destination, size_t capacity)
+{
+    const uint8_t* end{source + size};
+    size_t written{0};
+    while (source < end)
+    {
+        uint8_t token{*source++};
+        size_t literalLength{static_cast<size_t>(token >> 4)};
+        if (literalLength == 0xF && !readLength(source, end, literalLength))
+            return std::nullopt;
+        if (literalLength > static_cast<size_t>(end - source) || literalLength > capacity - written)
+            return std::nullopt;
+        std::memcpy(&destination[written], source, literalLength);
+        source += literalLength;
+        written += literalLength;
+        if (source == end) // the last sequence holds no match
+            break;
+        if (end - source < 2)
+            return std::nullopt;
+        size_t offset{static_cast<size_t>(source[0] | (source[1] << 8))};
+        source += 2;
+        if (offset == 0 || offset > written)
+            return std::nullopt;
+        size_t matchLength{static_cast<size_t>(token & 0xF)};
+        if (matchLength == 0xF && !readLength(source, end, matchLength))
+            return std::nullopt;
+        matchLength += minMatch;
+        if (matchLength > capacity - written)
+            return std::nullopt;
+        // matches may overlap the bytes they produce, so they are copied byte by byte
+        for (size_t i{0}; i < matchLength; i++, written++)
+            destination[written] = destination[written - offset];
+    }
+    return written;
+}
+
+size_t mirra::logexport::encodeFrame(Compressor& compressor, const uint8_t* block, size_t size,
+                                     uint32_t resume, uint32_t remaining, uint8_t* frame)
+{
+    uint8_t* data{&frame[sizeof(FrameHeader)]};
+    size_t dataSize{0};
+    if (size > 0)
+        dataSize = compressor.compress(block, size, data);
+    if (dataSize >= size)
+    {
+        std::memcpy(data, block, size);
+        dataSize = size;
+    }
+    FrameHeader header{frameMagic, resume, remaining, static_cast<uint16_t>(size),
+                       static_cast<uint16_t>(dataSize)};
+    std::memcpy(frame, &header, sizeof(header));
+    size_t frameSize{sizeof(header) + dataSize};
+    uint32_t crc{crc32(frame, frameSize)};
+    std::memcpy(&frame[frameSize], &crc, sizeof(crc));
+    return frameSize + sizeof(crc);
+}
+
+int mirra::logexport::formatCommand(char* buffer, size_t size, uint32_t baudRate,
+                                    std::optional<uint32_t> position)
+{
+    if (position)
+        return std::snprintf(buffer, size, "exportlog %u %u\r", baudRate, *position);
+    return std::snprintf(buffer, size, "exportlog %u\r", baudRate);
+}
@@ -0,0 +1,82 @@
+#ifndef __MIRRA_LOGEXPORT_H__
+#define __MIRRA_LOGEXPORT_H__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+/// @brief Format of the compressed log export, shared by the firmware and the host-side tool.
+///
+/// The formatted log lines are exported in blocks, each sent as a frame holding the block
+/// compressed in the LZ4 block format. Every frame is checked by a CRC-32 and can be decompressed
+/// on its own, so that an interrupted export can be resumed from the last frame received intact.
+/// The export ends with a frame holding no data.
+namespace mirra::logexport
+{
+/// @brief Identifies the start of a frame.
+constexpr uint32_t frameMagic = 0x31584C4D; // "MLX1"
+/// @brief Maximum amount of log text held by a frame, in bytes.
+constexpr size_t blockSize = 4096;
+/// @brief Baud rate the serial is switched to for the export, unless another one is requested.
+constexpr uint32_t defaultBaudRate = 921600;
+
+struct FrameHeader
+{
+    uint32_t magic;
+    /// @brief Position in the log partition of the first record following the frame, from which
+    /// the export is resumed.
+    uint32_t resume;
+    /// @brief Amount of bytes of the logfile following the frame.
+    uint32_t remaining;
+    /// @brief Size of the log text held by the frame, zero for the frame ending the export.
+    uint16_t rawSize;
+    /// @brief Size of the data of the frame. If equal to the raw size, the text is stored as is.
+    uint16_t size;
+} __attribute__((packed));
+
+/// @return The maximum size of a block of the given size once compressed.
+constexpr size_t getCompressedBound(size_t size) { return size + size / 255 + 16; }
+/// @brief Maximum size of a frame: its header, compressed block and trailing CRC-32.
+constexpr size_t maxFrameSize =
+    sizeof(FrameHeader) + getCompressedBound(blockSize) + sizeof(uint32_t);
+static_assert(getCompressedBound(blockSize) <= UINT16_MAX);
+
+/// @return The CRC-32 (IEEE 802.3) of the given data, continuing from the given CRC.
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0);
+
+/// @brief Greedy compressor to the LZ4 block format, finding matches through a hash table of the
+/// positions of 4-byte sequences. It trades ratio for speed and a small, fixed amount of memory.
+class Compressor
+{
+    static constexpr size_t hashBits = 12;
+    /// @brief Last position in the block of every hashed 4-byte sequence.
+    std::array<uint16_t, 1 << hashBits> table;
+
+public:
+    /// @brief Compresses a block of at most blockSize bytes.
+    /// @param destination Buffer of getCompressedBound(size) bytes the block is compressed into.
+    /// @return The size of the compressed block.
+    size_t compress(const uint8_t* source, size_t size, uint8_t* destination);
+};
+
+/// @brief Decompresses a block in the LZ4 block format.
+/// @param capacity Size of the destination buffer.
+/// @return The size of the decompressed block, std::nullopt if the block is corrupted or does not
+/// fit the destination buffer.
+std::optional<size_t> decompress(const uint8_t* source, size_t size, uint8_t* destination,
+                                 size_t capacity);
+
+/// @brief Writes the command line that starts an export in the command phase of a module.
+/// @param position Position to resume the export from, std::nullopt to start from the beginning.
+/// @return The length of the command line, as returned by snprintf.
+int formatCommand(char* buffer, size_t size, uint32_t baudRate, std::optional<uint32_t> position);
+
+/// @brief Encodes a block of log text as a frame. Blocks that do not compress are stored as is.
+/// @param frame Buffer of maxFrameSize bytes the frame is encoded into.
+/// @return The size of the frame.
+size_t encodeFrame(Compressor& compressor, const uint8_t* block, size_t size, uint32_t resume,
+                   uint32_t remaining, uint8_t* frame);
+}
+
+#endif
@@ -1,32 +1,398 @@
 #include "logging.h"
+#include <cstdlib>
+#include <esp_attr.h>
+#include <esp_ota_ops.h>
+#ifdef MIRRA_LOG_ASYNC
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#endif
 
 using namespace mirra;
 
+RTC_NOINIT_ATTR Log::Staging Log::staging;
+
+#ifdef MIRRA_LOG_ASYNC
+RTC_NOINIT_ATTR Log::Queue Log::queue;
+
+namespace
+{
+constexpr uint32_t logTaskStackSize{4096};
+constexpr UBaseType_t logTaskPriority{tskIDLE_PRIORITY + 1};
+TaskHandle_t logTask;
+/// @brief Held by the single consumer of the queue: the logging task, or a flush.
+SemaphoreHandle_t consumerMutex;
+}
+#endif
+
+Log::Log()
+{
+    if (staging.magic != stagingMagic || staging.size > stagingSize)
+    {
+        staging.magic = stagingMagic;
+        staging.size = 0;
+    }
+#ifdef MIRRA_LOG_ASYNC
+    if (queue.magic != queueMagic || queue.head - queue.tail > queueSize)
+    {
+        queue.magic = queueMagic;
+        queue.head.store(0);
+        queue.tail.store(0);
+    }
+    consumerMutex = xSemaphoreCreateMutex();
+    // the application runs on the other core
+    BaseType_t core{portNUM_PROCESSORS > 1 ? 1 - xPortGetCoreID() : 0};
+    xTaskCreatePinnedToCore(runTask, "log", logTaskStackSize, this, logTaskPriority, &logTask,
+                            core);
+    // records queued before a reset are stored first
+    xTaskNotifyGive(logTask);
+#endif
+}
+
+Log::~Log()
+{
+    flush();
+#ifdef MIRRA_LOG_ASYNC
+    Lock lock;
+    vTaskDelete(logTask);
+#endif
+}
+
+Log::Lock::Lock()
+{
+#ifdef MIRRA_LOG_ASYNC
+    xSemaphoreTake(consumerMutex, portMAX_DELAY);
+#endif
+}
+
+Log::Lock::~Lock()
+{
+#ifdef MIRRA_LOG_ASYNC
+    xSemaphoreGive(consumerMutex);
+#endif
+}
+
 Log& Log::getInstance()
 {
     static Log log{};
     return log;
 }
 
-size_t Log::File::cutTail(size_t cutSize)
+size_t Log::printPreamble(char* buffer, Level level, uint32_t time)
 {
-    static constexpr size_t searchSize{128};
-    uint8_t searchBuffer[searchSize];
-    while (true)
+    static constexpr size_t timeLength{sizeof("[0000-00-00 00:00:00]")};
+    time_t ctime{static_cast<time_t>(time)};
+    strftime(buffer, timeLength, "[%F %T]", gmtime(&ctime));
+    std::string_view levelString{levelToString(level)};
+    strcpy(&buffer[timeLength - 1], levelString.cbegin());
+    return getPreambleLength(level);
+}
+
+size_t Log::encodeLine(Level level, uint32_t time, size_t length)
+{
+    size_t preambleLength{getPreambleLength(level)};
+    return encodeText(record, level, time, &buffer[preambleLength], length - preambleLength - 1);
+}
+
+size_t Log::encodeText(uint8_t* data, Level level, uint32_t time, const char* text,
+                       size_t length)
+{
+    // header, argument kind, terminating NUL and trailer
+    length = std::min(length, maxRecordSize - sizeof(RecordHeader) - 3);
+    RecordHeader header{static_cast<uint8_t>(sizeof(RecordHeader) + length + 3), level,
+                        getImage(), time};
+    std::memcpy(data, &header, sizeof(header));
+    size_t size{sizeof(header)};
+    data[size++] = static_cast<uint8_t>(Argument::STRING);
+    std::memcpy(&data[size], text, length);
+    size += length;
+    data[size++] = '\0';
+    data[size++] = header.size;
+    return size;
+}
+
+bool Log::admit(Site& site, Level level, uint32_t time, size_t size)
+{
+    if (!site.listed)
+    {
+        site.next = sites;
+        sites = &site;
+        site.listed = true;
+    }
+    site.logged++;
+    // the arguments, and thus the trailer, of a repeated message are the same
+    size_t argumentsSize{size - sizeof(RecordHeader)};
+    if (&site == lastSite && size == lastSize &&
+        std::memcmp(&record[sizeof(RecordHeader)], lastArguments.data(), argumentsSize) == 0)
+    {
+        site.repeated++;
+        repeats++;
+        coalesced++;
+        return false;
+    }
+    if (time - site.windowStart >= rateWindow)
+    {
+        if (site.windowSuppressed > 0)
+        {
+            endRepeats(time);
+            notice(level, time, "Suppressed ", site.windowSuppressed, " messages logged at ",
+                   site.file, ":", static_cast<unsigned int>(site.line), ".");
+        }
+        site.windowStart = time;
+        site.windowCount = 0;
+        site.windowSuppressed = 0;
+    }
+    if (site.windowCount >= rateBurst)
+    {
+        site.suppressed++;
+        site.windowSuppressed++;
+        return false;
+    }
+    site.windowCount++;
+    endRepeats(time);
+    lastSite = &site;
+    lastLevel = level;
+    lastSize = size;
+    std::memcpy(lastArguments.data(), &record[sizeof(RecordHeader)], argumentsSize);
+    return true;
+}
+
+void Log::endRepeats(uint32_t time)
+{
+    if (repeats == 0)
+        return;
+    notice(lastLevel, time, "Last message repeated ", repeats, " times.");
+    repeats = 0;
+    // the next message is not coalesced with the one before this notice
+    lastSite = nullptr;
+}
+
+void Log::output(const uint8_t* data, size_t size)
+{
+#ifdef MIRRA_LOG_ASYNC
+    enqueue(data, size, true);
+#else
+    stage(data, size);
+    if (serial != nullptr)
+    {
+        char line[bufferSize];
+        serial->write(line, decode(data, line));
+    }
+#endif
+}
+
+uint16_t Log::getImage()
+{
+    static const uint16_t image{[] {
+        char sha256[5];
+        esp_ota_get_app_elf_sha256(sha256, sizeof(sha256));
+        return static_cast<uint16_t>(std::strtoul(sha256, nullptr, 16));
+    }()};
+    return image;
+}
+
+size_t Log::File::decode(size_t address, char* buffer, size_t& length) const
+{
+    uint8_t record[bufferSize];
+    RecordHeader header{getHeader(address)};
+    if (header.size <= sizeof(RecordHeader))
+        return 0;
+    const uint8_t* data{view(address, header.size)};
+    if (data == nullptr)
+    {
+        read(address, record, header.size);
+        data = record;
+    }
+    length = Log::decode(data, buffer);
+    return header.size;
+}
+
+size_t Log::decode(const uint8_t* data, char* buffer)
+{
+    RecordHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    size_t length{printPreamble(buffer, header.level, header.time)};
+    // literals of records stored by another image can not be looked up
+    bool sameImage{header.image == getImage()};
+    auto print = [buffer, &length](const char* format, auto... values) {
+        int printed{std::snprintf(&buffer[length], bufferSize - length - 1, format, values...)};
+        length = std::min(length + static_cast<size_t>(std::max(printed, 0)), bufferSize - 2);
+    };
+    const uint8_t* in{data + sizeof(RecordHeader)};
+    const uint8_t* end{data + header.size - 1};
+    auto take = [&in, end](auto& value) {
+        if (in + sizeof(value) > end)
+        {
+            in = end;
+            return false;
+        }
+        std::memcpy(&value, in, sizeof(value));
+        in += sizeof(value);
+        return true;
+    };
+    while (in < end)
     {
-        read(cutSize, &searchBuffer, searchSize);
-        uint8_t* found = reinterpret_cast<uint8_t*>(std::memchr(searchBuffer, '\n', searchSize));
-        if (found == nullptr)
+        switch (static_cast<Argument>(*in++))
+        {
+        case Argument::LITERAL:
+        {
+            uint32_t address;
+            if (!take(address))
+                break;
+            const char* literal{reinterpret_cast<const char*>(static_cast<uintptr_t>(address))};
+            print("%s", sameImage && esp_ptr_in_drom(literal) ? literal : "<?>");
+            break;
+        }
+        case Argument::STRING:
+        {
+            const char* string{reinterpret_cast<const char*>(in)};
+            size_t stringLength{strnlen(string, end - in)};
+            print("%.*s", static_cast<int>(stringLength), string);
+            in += std::min(stringLength + 1, static_cast<size_t>(end - in));
+            break;
+        }
+        case Argument::INT:
         {
-            cutSize += searchSize;
+            int32_t value;
+            if (take(value))
+                print("%i", static_cast<int>(value));
+            break;
         }
-        else
+        case Argument::UINT:
+        {
+            uint32_t value;
+            if (take(value))
+                print("%u", static_cast<unsigned int>(value));
+            break;
+        }
+        case Argument::FLOAT:
+        {
+            float value;
+            if (take(value))
+                print("%f", static_cast<double>(value));
+            break;
+        }
+        case Argument::CHAR:
+        {
+            char value;
+            if (take(value))
+                print("%c", value);
+            break;
+        }
+        default: // corrupted argument: the rest of the record can not be decoded
+            in = end;
+        }
+    }
+    buffer[length++] = '\n';
+    return length;
+}
+
+size_t Log::File::cutTail(size_t cutSize)
+{
+    if (cutSize >= getSize())
+        return FIFOFile::cutTail(getSize());
+    size_t cut{0};
+    if (auto summary{getSummary(cutSize)})
+    {
+        // records of a batch started in an earlier sector are cut along up to the next batch,
+        // which is at most a batch of records more than needed
+        if (summary->first >= cutSize)
+            return FIFOFile::cutTail(summary->first);
+        cut = summary->first;
+    }
+    while (cut < cutSize)
+    {
+        uint8_t size{read<uint8_t>(cut)};
+        if (size <= sizeof(RecordHeader))
+            return FIFOFile::cutTail(getSize()); // corrupted record: the file can not be walked
+        cut += size;
+    }
+    return FIFOFile::cutTail(std::min(cut, getSize()));
+}
+
+void Log::stage(const void* data, size_t size)
+{
+    if (staging.size + size > stagingSize)
+        storeStaged();
+    std::memcpy(&staging.data[staging.size], data, size);
+    staging.size += size;
+}
+
+void Log::storeStaged()
+{
+    if (staging.size == 0)
+        return;
+    file.push(staging.data.data(), staging.size);
+    staging.size = 0;
+}
+
+void Log::flush()
+{
+    endRepeats(std::time(nullptr));
+    Lock lock;
+#ifdef MIRRA_LOG_ASYNC
+    drain();
+#endif
+    storeStaged();
+}
+
+#ifdef MIRRA_LOG_ASYNC
+void Log::enqueue(const uint8_t* data, size_t size, bool print)
+{
+    uint32_t head{queue.head.load(std::memory_order_relaxed)};
+    uint32_t tail{queue.tail.load(std::memory_order_acquire)};
+    if (queueSize - (head - tail) < size + 1)
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    queue.data[head % queueSize] = print;
+    size_t position{(head + 1) % queueSize};
+    size_t first{std::min(size, queueSize - position)};
+    std::memcpy(&queue.data[position], data, first);
+    std::memcpy(queue.data.data(), data + first, size - first);
+    queue.head.store(head + 1 + size, std::memory_order_release);
+    xTaskNotifyGive(logTask);
+}
+
+void Log::drain()
+{
+    uint8_t data[bufferSize];
+    char line[bufferSize];
+    uint32_t tail{queue.tail.load(std::memory_order_relaxed)};
+    uint32_t head;
+    while (tail != (head = queue.head.load(std::memory_order_acquire)))
+    {
+        bool print{queue.data[tail % queueSize] != 0};
+        size_t position{(tail + 1) % queueSize};
+        size_t size{queue.data[position]};
+        if (size <= sizeof(RecordHeader) || size + 1 > head - tail)
         {
-            cutSize += std::distance(searchBuffer, found) + 1;
-            return FIFOFile::cutTail(cutSize);
+            // corrupted queue, e.g. after a reset while queueing: the rest can not be walked
+            queue.tail.store(head, std::memory_order_release);
+            return;
         }
+        size_t first{std::min(size, queueSize - position)};
+        std::memcpy(data, &queue.data[position], first);
+        std::memcpy(data + first, queue.data.data(), size - first);
+        tail += 1 + size;
+        queue.tail.store(tail, std::memory_order_release);
+        stage(data, size);
+        if (print && serial != nullptr)
+            serial->write(line, decode(data, line));
+    }
+}
+
+void Log::runTask(void* log)
+{
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        Lock lock;
+        static_cast<Log*>(log)->drain();
     }
 }
+#endif
 
 void Log::close()
 {
@@ -3,8 +3,31 @@
 
 #include "../MIRRAFS/FS.h"
 #include <HardwareSerial.h>
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <limits>
+#include <soc/soc_memory_layout.h>
+#include <string_view>
 #include <type_traits>
 
+// minimum levels of the messages compiled in per module, see Log::compiledLevels
+#ifndef MIRRA_LOG_LEVEL_GENERAL
+#define MIRRA_LOG_LEVEL_GENERAL DEBUG
+#endif
+#ifndef MIRRA_LOG_LEVEL_LORA
+#define MIRRA_LOG_LEVEL_LORA DEBUG
+#endif
+#ifndef MIRRA_LOG_LEVEL_FS
+#define MIRRA_LOG_LEVEL_FS DEBUG
+#endif
+#ifndef MIRRA_LOG_LEVEL_GATEWAY
+#define MIRRA_LOG_LEVEL_GATEWAY DEBUG
+#endif
+#ifndef MIRRA_LOG_LEVEL_SENSORS
+#define MIRRA_LOG_LEVEL_SENSORS DEBUG
+#endif
+
 namespace mirra
 {
 class Log
@@ -16,44 +39,279 @@ public:
         INFO,
         ERROR
     };
+    /// @brief Part of the firmware a message is logged from. Every module has its own log level.
+    enum class Module : uint8_t
+    {
+        GENERAL,
+        LORA,
+        FS,
+        GATEWAY,
+        SENSORS
+    };
+    static constexpr size_t nModules{5};
+    /// @brief Log level of every module.
+    using Levels = std::array<Level, nModules>;
+    /// @brief Minimum level of the messages of every module that are compiled in, set with the
+    /// MIRRA_LOG_LEVEL_<MODULE> build flags (e.g. -DMIRRA_LOG_LEVEL_LORA=INFO). Messages below it
+    /// that are logged with the LOG_ macros are removed entirely, arguments included.
+    static constexpr Levels compiledLevels{Level::MIRRA_LOG_LEVEL_GENERAL,
+                                           Level::MIRRA_LOG_LEVEL_LORA, Level::MIRRA_LOG_LEVEL_FS,
+                                           Level::MIRRA_LOG_LEVEL_GATEWAY,
+                                           Level::MIRRA_LOG_LEVEL_SENSORS};
+
+    /// @brief Whether messages are stored in the log file as binary records holding their
+    /// arguments rather than their text, enabled with the MIRRA_LOG_BINARY build flag. Binary
+    /// records are only formatted when they are printed.
+#ifdef MIRRA_LOG_BINARY
+    static constexpr bool binary{true};
+#else
+    static constexpr bool binary{false};
+#endif
+    /// @brief Whether records are stored and printed by a separate logging task rather than by
+    /// the caller, enabled with the MIRRA_LOG_ASYNC build flag. The task runs on the core that the
+    /// application does not run on, at low priority, and owns the output serial and logfile.
+#ifdef MIRRA_LOG_ASYNC
+    static constexpr bool async{true};
+#else
+    static constexpr bool async{false};
+#endif
+    /// @brief Kind of an argument of a binary record, derived from its format specifier.
+    enum class Argument : uint8_t
+    {
+        /// @brief String in flash, stored as its address.
+        LITERAL,
+        /// @brief String in RAM, stored NUL-terminated.
+        STRING,
+        INT,
+        UINT,
+        FLOAT,
+        CHAR
+    };
+    /// @brief Header of a record, followed by its arguments and trailed by the size of the record,
+    /// so that the file can be walked in both directions. Every argument is stored as its kind
+    /// followed by its raw bytes. Records holding text have the formatted message as their only
+    /// argument.
+    struct RecordHeader
+    {
+        /// @brief Size of the record in bytes, header and trailer included.
+        uint8_t size;
+        Level level;
+        /// @brief Identifies the firmware image that stored the record. Addresses of literals are
+        /// only valid in that same image.
+        uint16_t image;
+        uint32_t time;
+    } __attribute__((packed));
+    static constexpr size_t bufferSize{256};
+    /// @brief Maximum size of a record in bytes, which must fit in its header.
+    static constexpr size_t maxRecordSize{std::numeric_limits<uint8_t>::max()};
+
+    /// @brief Length of the window in which the messages of a call site are rate limited, in
+    /// seconds.
+    static constexpr uint32_t rateWindow{60};
+    /// @brief Amount of messages a call site may log per window. Any more are suppressed.
+    static constexpr uint16_t rateBurst{10};
+    /// @brief Call site of the LOG_ macros, holding its rate limiting state and counters. Sites
+    /// are listed once they logged their first message.
+    struct Site
+    {
+        const char* file;
+        uint16_t line;
+        /// @brief Amount of messages logged since the start, suppressed ones included.
+        uint32_t logged{0};
+        /// @brief Amount of messages coalesced since the start, because they repeated the
+        /// message before them.
+        uint32_t repeated{0};
+        /// @brief Amount of messages suppressed since the start by rate limiting.
+        uint32_t suppressed{0};
+        /// @brief Start of the current rate limiting window.
+        uint32_t windowStart{0};
+        /// @brief Amount of messages admitted in the current window.
+        uint16_t windowCount{0};
+        /// @brief Amount of messages suppressed in the current window.
+        uint32_t windowSuppressed{0};
+        /// @brief Next site in the list of sites, nullptr for the last one.
+        Site* next{nullptr};
+        bool listed{false};
+
+        constexpr Site(const char* file, uint16_t line) : file{file}, line{line} {}
+    };
 
 private:
-    Log(){};
+    Log();
     Log(const Log&) = delete;
     Log(Log&&) = delete;
     Log& operator=(const Log&) = delete;
     Log& operator=(Log&&) = delete;
-    ~Log() = default;
+    ~Log();
+
+    /// @brief Size of the staging buffer in bytes.
+    static constexpr size_t stagingSize{2048};
+    static constexpr uint32_t stagingMagic{0x4754534D}; // "MSTG"
+    /// @brief Records staged to be stored in the logfile, so that logging a message never waits
+    /// on flash. Kept in RTC memory, which survives deep sleep as well as the reset following a
+    /// panic: records staged before a crash are stored along with the next flush.
+    struct Staging
+    {
+        uint32_t magic;
+        uint32_t size;
+        std::array<uint8_t, stagingSize> data;
+    };
+    static Staging staging;
+    static_assert(stagingSize >= bufferSize);
+    /// @brief Stages a record, storing the staged records first if it does not fit.
+    void stage(const void* data, size_t size);
+    /// @brief Stores the staged records in the logfile.
+    void storeStaged();
+
+    /// @brief Size of the queue of records handed to the logging task in bytes, a power of two.
+    static constexpr size_t queueSize{2048};
+    static constexpr uint32_t queueMagic{0x5551514D}; // "MQQU"
+    /// @brief Single-producer single-consumer queue of records, handed from the logging caller to
+    /// the logging task without locking. Kept in RTC memory like the staging buffer, so that
+    /// records still queued when the module crashes are stored after the reset.
+    struct Queue
+    {
+        uint32_t magic;
+        /// @brief Position up to which records were queued, only advanced by the caller.
+        std::atomic<uint32_t> head;
+        /// @brief Position up to which records were taken by the task, only advanced by the task.
+        /// Positions run freely, wrapping around the data.
+        std::atomic<uint32_t> tail;
+        std::array<uint8_t, queueSize> data;
+    };
+    static Queue queue;
+    static_assert((queueSize & (queueSize - 1)) == 0 && queueSize >= bufferSize);
+    /// @brief Part of the 8KB of RTC slow memory that may be taken by the staging buffer, the
+    /// queue and the wear maps of the partitions. The rest is left to the ULP reserve (512 bytes)
+    /// and the RTC_DATA_ATTR state of the modules.
+    static constexpr size_t rtcBudget{7 * 1024};
+    static_assert(sizeof(Staging) + sizeof(Queue) + fs::Partition::getRTCFootprint() <= rtcBudget);
+    /// @brief Amount of records dropped since the start because the queue was full.
+    std::atomic<uint32_t> dropped{0};
+    /// @brief Hands a record to the logging task, or drops it if the queue is full. Every record
+    /// is queued after a byte telling whether it is to be printed.
+    /// @param print Whether the record is printed to the output serial as well as stored.
+    void enqueue(const uint8_t* data, size_t size, bool print);
+    /// @brief Stages and prints all queued records. Only called by a single consumer at a time.
+    void drain();
+    /// @brief Loop of the logging task, draining the queue whenever records were queued.
+    static void runTask(void*);
 
     /// @brief Buffer in which the final string is constructed and printed from.
-    char buffer[256]{0};
+    char buffer[bufferSize]{0};
+    /// @brief Buffer in which binary records are encoded.
+    uint8_t record[bufferSize]{0};
     /// @brief Prints the preamble portion of the log line.
-    /// @tparam level The level displayed in the preamble.
+    /// @param level The level displayed in the preamble.
     /// @param time The time displayed in the preamble.
     /// @return The length of the preamble that was printed.
-    template <Log::Level level> size_t printPreamble(const tm& time);
+    static size_t printPreamble(char* buffer, Level level, uint32_t time);
     /// @return String conversion from a level.
     static constexpr std::string_view levelToString(Level level);
-    /// @brief Prints to the logging buffer and forwards to (if enabled) the output serial and
-    /// logfile.
-    /// @tparam level Log level of printed message.
-    template <Log::Level level, class... Ts> void print(Ts&&... args);
+    /// @return The length of the preamble of a log line of the given level.
+    static constexpr size_t getPreambleLength(Level level)
+    {
+        return sizeof("[0000-00-00 00:00:00]") - 1 + levelToString(level).size();
+    }
+    /// @return Identifier of the running firmware image.
+    static uint16_t getImage();
+    /// @brief Formats a log line into the logging buffer.
+    /// @return The length of the line, newline included.
+    template <class... Ts> size_t format(Level level, uint32_t time, Ts&&... args);
+    /// @brief Encodes a binary record into the record buffer. Arguments that do not fit are left
+    /// out.
+    /// @return The size of the record.
+    template <class... Ts> size_t encode(Level level, uint32_t time, Ts&&... args);
+    template <class T> void encodeArgument(size_t& size, T&& arg);
+    /// @brief Formats a record as a log line.
+    /// @param data The record, header included.
+    /// @param buffer Buffer of bufferSize characters the line is formatted into.
+    /// @return The length of the line, newline included.
+    static size_t decode(const uint8_t* data, char* buffer);
+    /// @brief Encodes the log line formatted in the logging buffer as a record holding its
+    /// message, without the preamble and newline.
+    /// @param length The length of the line, newline included.
+    /// @return The size of the record.
+    size_t encodeLine(Level level, uint32_t time, size_t length);
+    /// @brief Encodes a record holding the given text.
+    /// @param data Buffer of bufferSize bytes the record is encoded into.
+    /// @return The size of the record.
+    static size_t encodeText(uint8_t* data, Level level, uint32_t time, const char* text,
+                             size_t length);
+
+    /// @brief First site in the list of call sites that logged a message.
+    Site* sites{nullptr};
+    /// @brief Call site of the last admitted message, nullptr if none or if it is not to be
+    /// coalesced with.
+    const Site* lastSite{nullptr};
+    Level lastLevel;
+    /// @brief Arguments of the last admitted message, as encoded in its record.
+    std::array<uint8_t, bufferSize> lastArguments;
+    size_t lastSize{0};
+    /// @brief Amount of repeats of the last admitted message that were coalesced.
+    uint32_t repeats{0};
+    /// @brief Amount of messages coalesced since the start.
+    uint32_t coalesced{0};
+    /// @brief Decides whether the message encoded in the record buffer is stored and printed.
+    /// Messages repeating the last admitted message are coalesced, and messages beyond the rate
+    /// of their call site are suppressed. Both are reported by a notice once they end.
+    /// @return Whether the message is admitted.
+    bool admit(Site& site, Level level, uint32_t time, size_t size);
+    /// @brief Stores and prints a notice of the logging module itself, bypassing rate limiting.
+    template <class... Ts> void notice(Level level, uint32_t time, Ts&&... args);
+    /// @brief Stores and prints a record.
+    void output(const uint8_t* data, size_t size);
+    /// @brief Reports the repeats of the last admitted message, if any, with a notice.
+    void endRepeats(uint32_t time);
 
 public:
     class File final : fs::FIFOFile
     {
+        /// @brief Identifies sectors holding binary records.
+        static constexpr uint32_t binaryMagic = 0x33424C4D; // "MLB3"
+        /// @brief Identifies sectors holding records of text.
+        static constexpr uint32_t textMagic = 0x33544C4D; // "MLT3"
+
+        /// @brief Cuts whole records from the tail. Records are pushed in batches, so the cut
+        /// starts walking them from the first batch started in the sector holding its end.
         size_t cutTail(size_t cutSize);
 
     public:
-        File() : FIFOFile("logs"), level{nvs.getValue("level", Level::INFO)} {}
-        /// @brief Logging level of the logging module. Messages below this level will not be
-        /// stored or printed.
-        fs::NVS::Value<Level> level;
+        File()
+            : FIFOFile("logs", binary ? binaryMagic : textMagic),
+              levels{nvs.getValue("levels", Levels{Level::INFO, Level::INFO, Level::INFO,
+                                                   Level::INFO, Level::INFO})},
+              echo{nvs.getValue<uint8_t>("echo", false)}
+        {}
+        /// @brief Logging level of every module. Messages below the level of their module will
+        /// not be stored or printed.
+        fs::NVS::Value<Levels> levels;
+        /// @brief Whether messages are printed to the output serial outside of the command phase
+        /// as well.
+        fs::NVS::Value<uint8_t> echo;
+        using FIFOFile::getHead;
         using FIFOFile::getMaxSize;
+        using FIFOFile::getName;
+        using FIFOFile::getRemainingLifetime;
+        using FIFOFile::getSectorCount;
         using FIFOFile::getSize;
+        using FIFOFile::getStats;
+        using FIFOFile::getTail;
+        using FIFOFile::getWear;
         using FIFOFile::read;
+        using FIFOFile::view;
 
         using FIFOFile::push;
+
+        /// @return The header of the record at the given address.
+        RecordHeader getHeader(size_t address) const { return read<RecordHeader>(address); }
+        /// @return The address of the record before the one at the given address.
+        size_t getPrevious(size_t address) const { return address - read<uint8_t>(address - 1); }
+        /// @brief Formats the record at the given address as a log line.
+        /// @param buffer Buffer of bufferSize characters the line is formatted into.
+        /// @param length Set to the length of the line, newline included.
+        /// @return The size of the record, zero if it is corrupted.
+        size_t decode(size_t address, char* buffer, size_t& length) const;
     };
 
     /// @brief Currently loaded logging file.
@@ -63,18 +321,65 @@ public:
 
     /// @brief Singleton global log object
     static Log& getInstance();
+    /// @return String conversion from a module.
+    static constexpr std::string_view moduleToString(Module module);
+    /// @return Whether messages of the given module and level are compiled in.
+    static constexpr bool isCompiled(Module module, Level level)
+    {
+        return level >= compiledLevels[static_cast<size_t>(module)];
+    }
+    /// @return Whether messages of the given module and level are stored and printed.
+    static bool isEnabled(Module module, Level level)
+    {
+        return level >= (*getInstance().file.levels)[static_cast<size_t>(module)];
+    }
     template <class... Ts> static void debug(Ts... args)
     {
-        getInstance().print<Level::DEBUG>(args...);
+        if (isEnabled(Module::GENERAL, Level::DEBUG))
+            getInstance().print<Level::DEBUG>(nullptr, args...);
     }
     template <class... Ts> static void info(Ts... args)
     {
-        getInstance().print<Level::INFO>(args...);
+        if (isEnabled(Module::GENERAL, Level::INFO))
+            getInstance().print<Level::INFO>(nullptr, args...);
     }
     template <class... Ts> static void error(Ts... args)
     {
-        getInstance().print<Level::ERROR>(args...);
+        if (isEnabled(Module::GENERAL, Level::ERROR))
+            getInstance().print<Level::ERROR>(nullptr, args...);
     }
+    /// @brief Stores in the logfile and forwards to (if enabled) the output serial, regardless of
+    /// the log levels.
+    /// @tparam level Log level of printed message.
+    /// @param site Call site of the message, subjecting it to rate limiting and coalescing of
+    /// repeats. nullptr to exempt the message.
+    template <Log::Level level, class... Ts> void print(Site* site, Ts&&... args);
+    /// @brief Stores a message in the logfile, without printing it to the output serial,
+    /// regardless of the log levels.
+    template <Level level, class... Ts> void store(Ts&&... args);
+    /// @brief Stores the staged records in the logfile, in one batched write. With the logging
+    /// task, the queued records are stored along. Repeats of the last message that are still
+    /// being coalesced are reported first.
+    void flush();
+    /// @brief Keeps the logging task from storing records in the logfile and printing them while
+    /// held, so that the logfile can be read in the meantime. Does nothing without the logging
+    /// task. Not recursive: the log may not be flushed while holding it.
+    class Lock
+    {
+    public:
+        Lock();
+        ~Lock();
+        Lock(const Lock&) = delete;
+        Lock& operator=(const Lock&) = delete;
+    };
+    /// @return The amount of records dropped since the start because the queue to the logging
+    /// task was full.
+    uint32_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+    /// @return The first site in the list of call sites that logged a message.
+    const Site* getSites() const { return sites; }
+    /// @return The amount of messages coalesced since the start, because they repeated the message
+    /// before them.
+    uint32_t getCoalesced() const { return coalesced; }
 
     static void close();
 };
@@ -83,6 +388,8 @@ public:
 template <class T> constexpr std::string_view typeToFormatSpecifier();
 /// @return A format string matched to the given type arguments.
 template <class... Ts> constexpr auto createFormatString();
+/// @return The kind of binary record argument matched to the type argument.
+template <class T> constexpr Log::Argument typeToArgument();
 /// @brief Type-safe variadic print function. Uses compile-time format string instantiation to
 /// ensure safety in using printf.
 /// @param buffer Buffer to which to print.
@@ -92,4 +399,23 @@ template <class... Ts> size_t printv(char* buffer, size_t max, Ts&&... args);
 #include "./logging.tpp"
 }
 
+/// @brief Logs a message of a module, e.g. LOG_DEBUG(LORA, "Packet sent!"). The arguments are only
+/// evaluated if the module's log level is met, and the statement is removed entirely if its level
+/// is below the module's compile-time level. Every statement is a call site of its own, rate
+/// limited separately.
+#define MIRRA_LOG(module, level, ...)                                                              \
+    do                                                                                             \
+    {                                                                                              \
+        using mirra::Log;                                                                          \
+        if constexpr (Log::isCompiled(Log::Module::module, Log::Level::level))                     \
+        {                                                                                          \
+            static Log::Site site{__FILE__, __LINE__};                                             \
+            if (Log::isEnabled(Log::Module::module, Log::Level::level))                            \
+                Log::getInstance().print<Log::Level::level>(&site, __VA_ARGS__);                   \
+        }                                                                                          \
+    } while (false)
+#define LOG_DEBUG(module, ...) MIRRA_LOG(module, DEBUG, __VA_ARGS__)
+#define LOG_INFO(module, ...) MIRRA_LOG(module, INFO, __VA_ARGS__)
+#define LOG_ERROR(module, ...) MIRRA_LOG(module, ERROR, __VA_ARGS__)
+
 #endif
\ No newline at end of file
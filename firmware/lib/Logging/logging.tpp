@@ -12,13 +12,22 @@ constexpr std::string_view Log::levelToString(Level level)
     return "NONE: ";
 }
 
-template <Log::Level level> size_t Log::printPreamble(const tm& time)
+constexpr std::string_view Log::moduleToString(Module module)
 {
-    static constexpr size_t timeLength{sizeof("[0000-00-00 00:00:00]")};
-    strftime(buffer, timeLength, "[%F %T]", &time);
-    constexpr std::string_view levelString{levelToString(level)};
-    strcpy(&buffer[timeLength - 1], levelString.cbegin());
-    return timeLength + levelString.size() - 1;
+    switch (module)
+    {
+    case Module::GENERAL:
+        return "GENERAL";
+    case Module::LORA:
+        return "LORA";
+    case Module::FS:
+        return "FS";
+    case Module::GATEWAY:
+        return "GATEWAY";
+    case Module::SENSORS:
+        return "SENSORS";
+    }
+    return "NONE";
 }
 
 template <class T> constexpr std::string_view rawTypeToFormatSpecifier();
@@ -107,17 +116,157 @@ template <class... Ts> size_t printv(char* buffer, size_t max, Ts&&... args)
     constexpr auto fmt{createFormatString<Ts...>()};
     return std::snprintf(buffer, max, fmt.data(), std::forward<Ts>(args)...);
 }
-template <Log::Level level, class... Ts> void Log::print(Ts&&... args)
+template <class T> constexpr Log::Argument typeToArgument()
 {
-    if (level < file.level)
-        return;
-    time_t ctime{time(nullptr)};
-    tm* time{gmtime(&ctime)};
-    size_t size{printPreamble<level>(*time)};
+    constexpr std::string_view specifier{typeToFormatSpecifier<T>()};
+    switch (specifier[1])
+    {
+    case 's':
+        return Log::Argument::STRING;
+    case 'i':
+        return Log::Argument::INT;
+    case 'u':
+        return Log::Argument::UINT;
+    case 'f':
+        return Log::Argument::FLOAT;
+    default:
+        return Log::Argument::CHAR;
+    }
+}
+
+template <class... Ts> size_t Log::format(Level level, uint32_t time, Ts&&... args)
+{
+    size_t size{printPreamble(buffer, level, time)};
     size += printv(&buffer[size], sizeof(buffer) - size - 1, std::forward<Ts>(args)...);
+    size = std::min(size, sizeof(buffer) - 2);
     buffer[size] = '\n';
+    return size + 1;
+}
+
+template <class... Ts> size_t Log::encode(Level level, uint32_t time, Ts&&... args)
+{
+    size_t size{sizeof(RecordHeader)};
+    (encodeArgument(size, std::forward<Ts>(args)), ...);
     size++;
-    file.push(buffer, size);
+    record[size - 1] = static_cast<uint8_t>(size);
+    RecordHeader header{static_cast<uint8_t>(size), level, getImage(), time};
+    std::memcpy(record, &header, sizeof(header));
+    return size;
+}
+
+template <class T> void Log::encodeArgument(size_t& size, T&& arg)
+{
+    // keeping room for the trailer
+    static constexpr size_t maxSize{maxRecordSize - 1};
+    auto append = [this, &size](Argument argument, const void* data, size_t length) {
+        if (size + 1 + length > maxSize)
+        {
+            size = maxSize; // leave out this and all following arguments
+            return;
+        }
+        record[size++] = static_cast<uint8_t>(argument);
+        std::memcpy(&record[size], data, length);
+        size += length;
+    };
+    if (size >= maxSize)
+        return;
+    constexpr Argument argument{typeToArgument<T>()};
+    if constexpr (argument == Argument::STRING)
+    {
+        const char* string{arg};
+        if (string == nullptr)
+            string = "(null)";
+        if (size + 2 > maxSize)
+        {
+            size = maxSize;
+            return;
+        }
+        if (esp_ptr_in_drom(string))
+        {
+            uint32_t address{static_cast<uint32_t>(reinterpret_cast<uintptr_t>(string))};
+            append(Argument::LITERAL, &address, sizeof(address));
+        }
+        else
+        {
+            // strings too long are cut short, keeping room for the terminating NUL
+            size_t length{strnlen(string, maxSize - size - 2)};
+            record[size++] = static_cast<uint8_t>(Argument::STRING);
+            std::memcpy(&record[size], string, length);
+            size += length;
+            record[size++] = '\0';
+        }
+    }
+    else if constexpr (argument == Argument::INT)
+    {
+        int32_t value{static_cast<int32_t>(arg)};
+        append(argument, &value, sizeof(value));
+    }
+    else if constexpr (argument == Argument::UINT)
+    {
+        uint32_t value{static_cast<uint32_t>(arg)};
+        append(argument, &value, sizeof(value));
+    }
+    else if constexpr (argument == Argument::FLOAT)
+    {
+        float value{static_cast<float>(arg)};
+        append(argument, &value, sizeof(value));
+    }
+    else
+    {
+        char value{static_cast<char>(arg)};
+        append(argument, &value, sizeof(value));
+    }
+}
+
+template <Log::Level level, class... Ts> void Log::store(Ts&&... args)
+{
+    uint32_t now(std::time(nullptr));
+    size_t size;
+    if constexpr (binary)
+        size = encode(level, now, std::forward<Ts>(args)...);
+    else
+        size = encodeLine(level, now, format(level, now, std::forward<Ts>(args)...));
+    if constexpr (async)
+        enqueue(record, size, false);
+    else
+        stage(record, size);
+}
+
+template <Log::Level level, class... Ts> void Log::print(Site* site, Ts&&... args)
+{
+    uint32_t now(std::time(nullptr));
+    size_t size;
+    size_t length{0};
+    if constexpr (binary)
+    {
+        size = encode(level, now, args...);
+    }
+    else
+    {
+        length = format(level, now, args...);
+        size = encodeLine(level, now, length);
+    }
+    if (site != nullptr && !admit(*site, level, now, size))
+        return;
+    if constexpr (async) // records are printed by the logging task
+    {
+        enqueue(record, size, true);
+        return;
+    }
+    stage(record, size);
     if (serial != nullptr)
-        serial->write(buffer, size);
+    {
+        // binary records are only formatted to be printed
+        if constexpr (binary)
+            length = format(level, now, args...);
+        serial->write(buffer, length);
+    }
+}
+
+template <class... Ts> void Log::notice(Level level, uint32_t time, Ts&&... args)
+{
+    char text[bufferSize];
+    size_t length{std::min(printv(text, bufferSize, std::forward<Ts>(args)...), bufferSize - 1)};
+    uint8_t data[bufferSize];
+    output(data, encodeText(data, level, time, text, length));
 }
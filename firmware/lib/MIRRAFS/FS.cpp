@@ -1,5 +1,11 @@
 #include "FS.h"
 
+#include <algorithm>
+#include <ctime>
+#include <esp_attr.h>
+#include <limits>
+#include <vector>
+
 using namespace mirra::fs;
 
 NVS::NVS(const char* name)
@@ -150,14 +156,120 @@ void NVS::init()
 Partition::Partition(const char* name)
     : part{esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_UNDEFINED,
                                     name)},
-      maxSize{part->size}, sectorBuffer{new std::array<uint8_t, sectorSize>}
+      maxSize{part->size}, cache{getCache(part)}
 {
     strncpy(this->name, name, partitionNameMaxSize);
+    if (cache->wear == nullptr)
+        loadWear();
 }
 
 Partition::~Partition()
 {
-    flush();
+    if (cache)
+        flush();
+}
+
+std::shared_ptr<Partition::Cache> Partition::getCache(const esp_partition_t* part)
+{
+    static std::vector<std::weak_ptr<Cache>> caches;
+    for (auto it = caches.begin(); it != caches.end();)
+    {
+        std::shared_ptr<Cache> cache{it->lock()};
+        if (!cache)
+        {
+            it = caches.erase(it);
+            continue;
+        }
+        if (cache->part == part)
+            return cache;
+        it++;
+    }
+    auto cache{std::make_shared<Cache>(part)};
+    caches.push_back(cache);
+    return cache;
+}
+
+RTC_NOINIT_ATTR std::array<Partition::Wear, Partition::maxWearMaps> Partition::wearMaps;
+
+void Partition::loadWear()
+{
+    Wear* slot{nullptr};
+    for (Wear& wear : wearMaps)
+    {
+        if (wear.magic == wearMagic && wear.address == part->address)
+        {
+            cache->wear = &wear;
+            return;
+        }
+        if (wear.magic != wearMagic && slot == nullptr)
+            slot = &wear;
+    }
+    // no slot left in RTC memory: track the wear in regular memory, which only the NVS backup
+    // survives
+    cache->wear = slot != nullptr ? slot : &cache->localWear;
+    Wear initial{};
+    initial.magic = wearMagic;
+    initial.address = part->address;
+    initial.since = time(nullptr);
+    NVS nvs{name};
+    auto backup{nvs.getValue<Wear>("wear", initial)};
+    if (backup->magic != wearMagic || backup->address != part->address)
+        *backup = initial;
+    *cache->wear = *backup;
+}
+
+void Partition::backupWear()
+{
+    cache->wear->backupErases = cache->wear->totalErases;
+    NVS nvs{name};
+    auto backup{nvs.getValue<Wear>("wear", *cache->wear)};
+    *backup = *cache->wear;
+}
+
+void Partition::recordErase(size_t sectorAddress)
+{
+    Wear& wear{*cache->wear};
+    size_t sector{sectorAddress / sectorSize};
+    if (sector < maxWearSectors)
+        wear.erases[sector]++;
+    wear.totalErases++;
+    if (wear.totalErases - wear.backupErases >= wearBackupInterval)
+        backupWear();
+}
+
+std::optional<uint64_t> Partition::getRemainingLifetime() const
+{
+    const Wear& wear{getWear()};
+    uint32_t maxErases{*std::max_element(wear.erases.begin(), wear.erases.end())};
+    uint32_t now = time(nullptr);
+    if (maxErases == 0 || now <= wear.since)
+        return std::nullopt;
+    if (maxErases >= sectorEndurance)
+        return 0;
+    return static_cast<uint64_t>(sectorEndurance - maxErases) * (now - wear.since) / maxErases;
+}
+
+Partition::Cache::~Cache()
+{
+    if (mapping)
+        spi_flash_munmap(mappingHandle);
+}
+
+const uint8_t* Partition::getMapping() const
+{
+    if (cache->mapping || cache->mappingFailed)
+        return cache->mapping;
+    const void* mapping;
+    esp_err_t err = esp_partition_mmap(part, 0, getMaxSize(), SPI_FLASH_MMAP_DATA, &mapping,
+                                       &cache->mappingHandle);
+    if (err != ESP_OK)
+    {
+        printf("Error while mapping partition '%s', code: %s\n", name, esp_err_to_name(err));
+        cache->mappingFailed = true;
+        return nullptr;
+    }
+    cache->mapping = static_cast<const uint8_t*>(mapping);
+    return cache->mapping;
 }
 
 constexpr size_t Partition::toSectorAddress(size_t address)
@@ -167,54 +279,172 @@ constexpr size_t Partition::toSectorAddress(size_t address)
 
 void Partition::loadFirstSector(size_t address)
 {
-    sectorDirty = false;
-    readSector(toSectorAddress(address));
+    if (!findSector(toSectorAddress(address)))
+        loadSector(toSectorAddress(address));
+}
+
+Partition::CachedSector* Partition::findSector(size_t sectorAddress) const
+{
+    for (CachedSector& sector : cache->sectors)
+    {
+        if (sector.buffer && sector.address == sectorAddress)
+        {
+            sector.lastUse = ++cache->useCounter;
+            cache->stats.cacheHits++;
+            return &sector;
+        }
+    }
+    cache->stats.cacheMisses++;
+    return nullptr;
 }
 
-bool Partition::inSector(size_t address) const
+Partition::CachedSector& Partition::evictSector()
 {
-    return (sectorAddress <= address) && (address < (sectorAddress + sectorSize));
+    CachedSector* victim{&cache->sectors[0]};
+    for (CachedSector& sector : cache->sectors)
+    {
+        if (!sector.buffer)
+        {
+            victim = &sector;
+            break;
+        }
+        if (sector.lastUse < victim->lastUse)
+            victim = &sector;
+    }
+    if (victim->isDirty())
+        writeSector(*victim);
+    if (!victim->buffer)
+        victim->buffer.reset(new std::array<uint8_t, sectorSize>);
+    victim->lastUse = ++cache->useCounter;
+    return *victim;
 }
 
-void Partition::readSector(size_t sectorAddress)
+Partition::CachedSector& Partition::loadSector(size_t sectorAddress)
 {
-    flush();
-    esp_err_t err = esp_partition_read(part, sectorAddress, sectorBuffer.get(), sectorSize);
+    CachedSector& sector{evictSector()};
+    esp_err_t err = esp_partition_read(part, sectorAddress, sector.buffer.get(), sectorSize);
     if (err != ESP_OK)
     {
         printf("Error while reading sector %u from partition '%s', code: %s\n", sectorAddress,
                getName(), esp_err_to_name(err));
     }
-    this->sectorAddress = sectorAddress;
+    cache->stats.reads++;
+    cache->stats.bytesRead += sectorSize;
+    sector.address = sectorAddress;
+    return sector;
 }
 
-void Partition::writeSector()
+void Partition::eraseSector(size_t sectorAddress)
 {
-    esp_err_t err = esp_partition_erase_range(part, sectorAddress, sectorSize);
-    if (err != ESP_OK)
-        printf("Error while erasing sector %u from partition '%s', code: %s\n", sectorAddress,
-               getName(), esp_err_to_name(err));
-    err = esp_partition_write(part, sectorAddress, sectorBuffer.get(), sectorSize);
-    if (err != ESP_OK)
-        printf("Error while writing sector %u from partition '%s', code: %s\n", sectorAddress,
-               getName(), esp_err_to_name(err));
-    sectorDirty = false;
+    CachedSector* sector{findSector(sectorAddress)};
+    if (sector == nullptr)
+    {
+        sector = &evictSector();
+        sector->address = sectorAddress;
+    }
+    sector->buffer->fill(0xFF);
+    sector->markClean();
+    sector->erase = true;
+}
+
+void Partition::writeSector(CachedSector& sector)
+{
+    esp_err_t err;
+    if (sector.erase)
+    {
+        err = esp_partition_erase_range(part, sector.address, sectorSize);
+        if (err != ESP_OK)
+            printf("Error while erasing sector %u from partition '%s', code: %s\n",
+                   sector.address, getName(), esp_err_to_name(err));
+        cache->stats.erases++;
+        recordErase(sector.address);
+    }
+    // program from the end of the sector backwards, so that a header at the start of the sector
+    // reaches flash after the data it describes
+    std::array<CachedSector::DirtyRange, maxDirtyRanges> ranges{sector.dirty};
+    std::sort(ranges.begin(), ranges.end(),
+              [](const auto& a, const auto& b) { return a.begin > b.begin; });
+    for (const CachedSector::DirtyRange& range : ranges)
+    {
+        if (range.isEmpty())
+            continue;
+        size_t size{range.end - range.begin};
+        err = esp_partition_write(part, sector.address + range.begin,
+                                  &(*sector.buffer)[range.begin], size);
+        if (err != ESP_OK)
+            printf("Error while writing sector %u from partition '%s', code: %s\n",
+                   sector.address, getName(), esp_err_to_name(err));
+        cache->stats.writes++;
+        cache->stats.bytesWritten += size;
+        cache->wear->bytesProgrammed += size;
+    }
+    sector.markClean();
+}
+
+bool Partition::CachedSector::isDirty() const
+{
+    return erase || std::any_of(dirty.begin(), dirty.end(),
+                                [](const DirtyRange& range) { return !range.isEmpty(); });
+}
+
+void Partition::CachedSector::markDirty(size_t begin, size_t end)
+{
+    // absorb all ranges touching the new one
+    for (DirtyRange& range : dirty)
+    {
+        if (!range.isEmpty() && range.begin <= end && begin <= range.end)
+        {
+            begin = std::min(begin, range.begin);
+            end = std::max(end, range.end);
+            range = DirtyRange{};
+        }
+    }
+    DirtyRange* target{nullptr};
+    size_t minGap{std::numeric_limits<size_t>::max()};
+    for (DirtyRange& range : dirty)
+    {
+        if (range.isEmpty())
+        {
+            target = &range;
+            break;
+        }
+        size_t gap{range.begin > end ? range.begin - end : begin - range.end};
+        if (gap < minGap)
+        {
+            target = &range;
+            minGap = gap;
+        }
+    }
+    if (!target->isEmpty())
+    {
+        begin = std::min(begin, target->begin);
+        end = std::max(end, target->end);
+    }
+    *target = DirtyRange{begin, end};
+}
+
+void Partition::CachedSector::markClean()
+{
+    erase = false;
+    dirty.fill(DirtyRange{});
 }
 
 void Partition::read(size_t address, void* buffer, size_t size) const
 {
     while (size > 0)
     {
-        size_t toRead;
-        if (inSector(address)) // if address in sector buffer: read straight from it
+        size_t sectorAddress{toSectorAddress(address)};
+        size_t toRead{std::min(sectorSize - (address - sectorAddress), size)};
+        const CachedSector* sector{findSector(sectorAddress)};
+        if (sector != nullptr) // if sector is cached: read straight from it
         {
-            toRead = std::min(sectorSize - (address - sectorAddress), size);
-            std::memcpy(buffer, &(*sectorBuffer)[address - sectorAddress], toRead);
+            std::memcpy(buffer, &(*sector->buffer)[address - sectorAddress], toRead);
         }
-        else // else (or if not all requested data in sector buffer), read straight from flash
+        else // else, read straight from flash without polluting the cache
         {
-            toRead = std::min((address < sectorAddress ? sectorAddress : maxSize) - address, size);
-            esp_partition_read(part, address, buffer, size);
+            esp_partition_read(part, address, buffer, toRead);
+            cache->stats.reads++;
+            cache->stats.bytesRead += toRead;
         }
         address = (address + toRead) % getMaxSize();
         buffer = static_cast<uint8_t*>(buffer) + toRead;
@@ -222,35 +452,218 @@ void Partition::read(size_t address, void* buffer, size_t size) const
     }
 }
 
+const uint8_t* Partition::view(size_t address, size_t size) const
+{
+    size_t sectorAddress{toSectorAddress(address)};
+    if (address + size > sectorAddress + sectorSize)
+        return nullptr;
+    // the cache holds the most recent contents of a sector, flash may be outdated
+    const CachedSector* sector{findSector(sectorAddress)};
+    if (sector != nullptr)
+        return &(*sector->buffer)[address - sectorAddress];
+    const uint8_t* mapping{getMapping()};
+    if (mapping == nullptr)
+        return nullptr;
+    return mapping + address;
+}
+
 void Partition::write(size_t address, const void* buffer, size_t size)
 {
     while (size > 0)
     {
-        if (!inSector(address))
-            readSector(toSectorAddress(address));
-
-        size_t toWrite = std::min(sectorSize - (address - sectorAddress), size);
-        std::memcpy(&(*sectorBuffer)[address - sectorAddress], buffer, toWrite);
+        size_t sectorAddress{toSectorAddress(address)};
+        CachedSector* sector{findSector(sectorAddress)};
+        if (sector == nullptr)
+            sector = &loadSector(sectorAddress);
+
+        size_t offset{address - sectorAddress};
+        size_t toWrite = std::min(sectorSize - offset, size);
+        uint8_t* target{&(*sector->buffer)[offset]};
+        const uint8_t* source{static_cast<const uint8_t*>(buffer)};
+        // flash programming can only clear bits: setting any bit requires an erase first
+        for (size_t i{0}; i < toWrite && !sector->erase; i++)
+        {
+            if ((source[i] & ~target[i]) != 0)
+            {
+                sector->erase = true;
+                sector->markDirty(0, sectorSize);
+            }
+        }
+        std::memcpy(target, source, toWrite);
+        sector->markDirty(offset, offset + toWrite);
         address = (address + toWrite) % getMaxSize();
-        buffer = static_cast<const uint8_t*>(buffer) + toWrite;
+        buffer = source + toWrite;
         size -= toWrite;
-        sectorDirty = true;
     }
 }
 
 void Partition::flush()
 {
-    if (sectorDirty)
+    // write back in order of last use, so metadata written last also reaches flash last
+    while (true)
     {
-        writeSector();
+        CachedSector* oldest{nullptr};
+        for (CachedSector& sector : cache->sectors)
+        {
+            if (sector.isDirty() && (oldest == nullptr || sector.lastUse < oldest->lastUse))
+                oldest = &sector;
+        }
+        if (oldest == nullptr)
+            return;
+        writeSector(*oldest);
     }
 }
 
-FIFOFile::FIFOFile(const char* name)
-    : Partition(name), nvs{getName()}, head{nvs.getValue<size_t>("head", 0)},
-      tail{nvs.getValue<size_t>("tail", 0)}, size{nvs.getValue<size_t>("size", 0)}
+FIFOFile::FIFOFile(const char* name, uint32_t magic)
+    : Partition(name), nvs{getName()}, magic{magic},
+      nSectors{Partition::getMaxSize() / sectorSize - nLogSectors}, headSector{nSectors - 1},
+      sequence{static_cast<uint32_t>(-1)}
 {
-    loadFirstSector(head);
+    recover();
+    loadFirstSector(toAddress(head));
+}
+
+void FIFOFile::recover()
+{
+    auto isValid = [this](size_t sector) {
+        return Partition::read<uint32_t>(sector * sectorSize + offsetof(SectorHeader, magic)) ==
+               magic;
+    };
+    auto getSequence = [this](size_t sector) {
+        return Partition::read<uint32_t>(sector * sectorSize + offsetof(SectorHeader, sequence));
+    };
+    std::optional<LogMark> logMark{recoverLog()};
+    std::optional<size_t> found;
+    if (isValid(0))
+    {
+        // the head moves through the sectors in order, incrementing the sequence number for every
+        // sector: the head sector is the last one continuing the sequence started by sector 0
+        uint32_t first{getSequence(0)};
+        size_t low{0}, high{nSectors - 1};
+        while (low < high)
+        {
+            size_t mid{(low + high + 1) / 2};
+            if (isValid(mid) && getSequence(mid) - first == mid)
+                low = mid;
+            else
+                high = mid - 1;
+        }
+        found = low;
+    }
+    else
+    {
+        // sector 0 is only invalid on a fresh partition or after an interrupted erase
+        for (size_t sector{0}; sector < nSectors; sector++)
+        {
+            if (isValid(sector) &&
+                (!found || static_cast<int32_t>(getSequence(sector) - getSequence(*found)) > 0))
+                found = sector;
+        }
+    }
+    if (!found)
+        return;
+    sequence = getSequence(*found);
+    // the most recent state is stored in the head sector, unless its marks were never written
+    for (size_t i{0}; i < nSectors; i++)
+    {
+        size_t sector{(*found + nSectors - i) % nSectors};
+        if (!isValid(sector))
+            return;
+        SectorHeader header{Partition::read<SectorHeader>(sector * sectorSize)};
+        std::optional<Mark> mark;
+        Mark erased;
+        std::memset(&erased, 0xFF, sizeof(erased));
+        nextMark = 0;
+        for (size_t m{0}; m < nMarks; m++)
+        {
+            if (header.marks[m].isValid())
+                mark = header.marks[m];
+            if (std::memcmp(&header.marks[m], &erased, sizeof(Mark)) != 0)
+                nextMark = m + 1;
+        }
+        if (!mark)
+            continue;
+        // all marks used: more recent state may have been appended to the mark log
+        if (nextMark >= nMarks && logMark && logMark->sequence == header.sequence &&
+            logMark->anchor == header.marks[nMarks - 1].check)
+            mark = logMark->mark;
+        headSector = sector;
+        sequence = header.sequence;
+        lastMark = *mark;
+        size = mark->size;
+        cursor = mark->cursor;
+        headCount = mark->count;
+        head = (headSector * sectorDataSize + mark->head) % getMaxSize();
+        tail = (head + getMaxSize() - size) % getMaxSize();
+        return;
+    }
+}
+
+std::optional<FIFOFile::LogMark> FIFOFile::recoverLog()
+{
+    LogMark erased;
+    std::memset(&erased, 0xFF, sizeof(erased));
+    std::optional<LogMark> latest;
+    std::array<size_t, nLogSectors> ends;
+    for (size_t sector{0}; sector < nLogSectors; sector++)
+    {
+        // log marks are appended in order: the log sector ends at its first erased log mark
+        for (ends[sector] = 0; ends[sector] < logSectorMarks; ends[sector]++)
+        {
+            LogMark logMark{Partition::read<LogMark>(toLogAddress(sector, ends[sector]))};
+            if (std::memcmp(&logMark, &erased, sizeof(LogMark)) == 0)
+                break;
+            if (logMark.isValid() &&
+                (!latest || static_cast<int32_t>(logMark.serial - latest->serial) > 0))
+            {
+                latest = logMark;
+                logSector = sector;
+            }
+        }
+    }
+    nextLogMark = ends[logSector];
+    if (latest)
+        logSerial = latest->serial;
+    return latest;
+}
+
+void FIFOFile::enterSector(size_t sector, uint16_t first,
+                           const std::array<uint8_t, 8>& previousInfo)
+{
+    eraseSector(sector * sectorSize);
+    Partition::write(sector * sectorSize + offsetof(SectorHeader, magic), magic);
+    Partition::write(sector * sectorSize + offsetof(SectorHeader, sequence), ++sequence);
+    Partition::write(sector * sectorSize + offsetof(SectorHeader, first), first);
+    Partition::write(sector * sectorSize + offsetof(SectorHeader, previousCount),
+                     static_cast<uint16_t>(headCount));
+    Partition::write(sector * sectorSize + offsetof(SectorHeader, previousInfo), previousInfo);
+    headSector = sector;
+    headCount = 0;
+    nextMark = 0;
+}
+
+void FIFOFile::readData(size_t position, void* buffer, size_t size) const
+{
+    while (size > 0)
+    {
+        size_t toRead{std::min(sectorDataSize - position % sectorDataSize, size)};
+        Partition::read(toAddress(position), buffer, toRead);
+        position = (position + toRead) % getMaxSize();
+        buffer = static_cast<uint8_t*>(buffer) + toRead;
+        size -= toRead;
+    }
+}
+
+void FIFOFile::writeData(size_t position, const void* buffer, size_t size)
+{
+    while (size > 0)
+    {
+        size_t toWrite{std::min(sectorDataSize - position % sectorDataSize, size)};
+        Partition::write(toAddress(position), buffer, toWrite);
+        position = (position + toWrite) % getMaxSize();
+        buffer = static_cast<const uint8_t*>(buffer) + toWrite;
+        size -= toWrite;
+    }
 }
 
 size_t FIFOFile::freeSpace() const
@@ -262,21 +675,115 @@ void FIFOFile::read(size_t address, void* buffer, size_t size) const
 {
     if (address >= this->size)
         return;
-    Partition::read((tail + address) % getMaxSize(), buffer, std::min(size, this->size - address));
+    readData((tail + address) % getMaxSize(), buffer, std::min(size, this->size - address));
+}
+
+const uint8_t* FIFOFile::view(size_t address, size_t size) const
+{
+    if (address + size > this->size)
+        return nullptr;
+    size_t position{(tail + address) % getMaxSize()};
+    if (position % sectorDataSize + size > sectorDataSize)
+        return nullptr;
+    return Partition::view(toAddress(position), size);
+}
+
+std::pair<const uint8_t*, size_t> FIFOFile::span(size_t address) const
+{
+    if (address >= this->size)
+        return {nullptr, 0};
+    size_t position{(tail + address) % getMaxSize()};
+    size_t size{std::min(sectorDataSize - position % sectorDataSize, this->size - address)};
+    return {Partition::view(toAddress(position), size), size};
 }
 
 void FIFOFile::push(const void* buffer, size_t size)
 {
-    this->size = (this->size + size) - (freeSpace() < size ? cutTail(size - freeSpace()) : 0);
-    Partition::write(head, buffer, size);
-    head = (head + size) % getMaxSize();
+    size_t end{head + size};
+    // sectors in which the pushed data starts are erased beforehand, so must be entirely free
+    size_t firstEntered{(head + sectorDataSize - 1) / sectorDataSize};
+    size_t lastEntered{(end - 1) / sectorDataSize};
+    size_t required{firstEntered <= lastEntered ? (lastEntered + 1) * sectorDataSize - head : size};
+    if (freeSpace() < required)
+        this->size -= cutTail(required - freeSpace());
+    bool pushStarted{head % sectorDataSize != 0};
+    if (pushStarted)
+        headCount++;
+    SectorInfo previousInfo;
+    if (firstEntered <= lastEntered)
+        previousInfo = leaveSector(pushStarted);
+    for (size_t sector{firstEntered}; sector <= lastEntered; sector++)
+    {
+        // the first push started in an entered sector is either this one or the one after it
+        uint16_t first{noPushes};
+        if (sector * sectorDataSize == head)
+            first = 0;
+        else if (end / sectorDataSize == sector)
+            first = end % sectorDataSize;
+        enterSector(sector % nSectors, first, previousInfo);
+        if (sector * sectorDataSize == head)
+            headCount++;
+        // sectors entered after the first only follow sectors this push started in
+        previousInfo.fill(0xFF);
+    }
+    writeData(head, buffer, size);
+    this->size += size;
+    head = end % getMaxSize();
 }
 
 void FIFOFile::write(size_t address, const void* buffer, size_t size)
 {
     if (address >= this->size)
         return;
-    Partition::write((tail + address) % getMaxSize(), buffer, std::min(size, this->size - address));
+    writeData((tail + address) % getMaxSize(), buffer, std::min(size, this->size - address));
+}
+
+std::optional<FIFOFile::SectorSummary> FIFOFile::getSummary(size_t address) const
+{
+    if (address >= this->size)
+        return std::nullopt;
+    size_t position{(tail + address) % getMaxSize()};
+    size_t sector{position / sectorDataSize};
+    uint16_t first{Partition::read<uint16_t>(sector * sectorSize + offsetof(SectorHeader, first))};
+    size_t count{headCount};
+    if (sector != headSector)
+    {
+        size_t next{(sector + 1) % nSectors};
+        count =
+            Partition::read<uint16_t>(next * sectorSize + offsetof(SectorHeader, previousCount));
+    }
+    if (first == noPushes || count == noPushes)
+        return std::nullopt;
+    // pushes cut from the tail sector lie outside of the file
+    size_t firstAddress{(sector * sectorDataSize + first + getMaxSize() - tail) % getMaxSize()};
+    if (firstAddress >= this->size)
+        return std::nullopt;
+    return SectorSummary{firstAddress, count,
+                         address + sectorDataSize - position % sectorDataSize};
+}
+
+FIFOFile::SectorInfo FIFOFile::leaveSector(bool)
+{
+    SectorInfo info;
+    info.fill(0xFF);
+    return info;
+}
+
+std::optional<FIFOFile::SectorInfo> FIFOFile::getSectorInfo(size_t address) const
+{
+    if (address >= this->size)
+        return std::nullopt;
+    size_t sector{((tail + address) % getMaxSize()) / sectorDataSize};
+    if (sector == headSector)
+        return std::nullopt;
+    size_t next{(sector + 1) % nSectors};
+    return Partition::read<SectorInfo>(next * sectorSize + offsetof(SectorHeader, previousInfo));
+}
+
+size_t FIFOFile::getSectorStart(size_t address) const
+{
+    size_t offset{(tail + address) % getMaxSize() % sectorDataSize};
+    return address < offset ? 0 : address - offset;
 }
 
 size_t FIFOFile::cutTail(size_t cutSize)
@@ -287,9 +794,45 @@ size_t FIFOFile::cutTail(size_t cutSize)
 
 void FIFOFile::flush()
 {
-    head.commit();
-    tail.commit();
-    size.commit();
-    nvs.commit();
+    // a head at the very end of the head sector wraps to the start of the next one
+    uint16_t headOffset((head + getMaxSize() - headSector * sectorDataSize) % getMaxSize());
+    if (headOffset == 0)
+        headOffset = sectorDataSize;
+    Mark mark{static_cast<uint32_t>(size), static_cast<uint32_t>(cursor), headOffset,
+              static_cast<uint16_t>(headCount),
+              Mark::computeCheck(headOffset, size, cursor, headCount)};
+    if (std::memcmp(&mark, &lastMark, sizeof(Mark)) != 0)
+    {
+        if (nextMark < nMarks)
+        {
+            Partition::write(headSector * sectorSize + offsetof(SectorHeader, marks) +
+                                 nextMark * sizeof(Mark),
+                             mark);
+            nextMark++;
+        }
+        else
+        {
+            // all marks used: append the state to the mark log rather than erasing the head
+            // sector, once the data it describes reached flash
+            Partition::flush();
+            uint16_t anchor{Partition::read<uint16_t>(headSector * sectorSize +
+                                                      offsetof(SectorHeader, marks) +
+                                                      (nMarks - 1) * sizeof(Mark) +
+                                                      offsetof(Mark, check))};
+            if (nextLogMark >= logSectorMarks)
+            {
+                // the log sector is full: continue in the next one, which holds older marks only
+                logSector = (logSector + 1) % nLogSectors;
+                eraseSector(toLogAddress(logSector, 0));
+                nextLogMark = 0;
+            }
+            logSerial++;
+            Partition::write(toLogAddress(logSector, nextLogMark),
+                             LogMark{logSerial, sequence, anchor, mark,
+                                     LogMark::computeCheck(logSerial, sequence, anchor, mark)});
+            nextLogMark++;
+        }
+        lastMark = mark;
+    }
     Partition::flush();
 }
@@ -1,6 +1,8 @@
 #ifndef __MIRRA_FS_H__
 #define __MIRRA_FS_H__
 
+#include <array>
+#include <cstddef>
 #include <cstring>
 #include <esp_partition.h>
 #include <memory>
@@ -33,16 +35,21 @@ public:
 
     void commit();
 
+    /// @brief Single value stored under a key, written back on destruction if it was changed.
     template <class T> class Value
     {
         const char* key;
         NVS* nvs;
+        /// @brief Value as stored in NVS, std::nullopt if nothing is stored yet.
+        std::optional<T> storedValue;
         T cachedValue;
 
-        Value(const char* key, NVS* nvs) : key{key}, nvs{nvs}, cachedValue{nvs->get<T>(key).value()}
+        Value(const char* key, NVS* nvs)
+            : key{key}, nvs{nvs}, storedValue{nvs->get<T>(key)}, cachedValue{storedValue.value()}
         {}
         Value(const char* key, NVS* nvs, const T& defaultValue)
-            : key{key}, nvs{nvs}, cachedValue{nvs->get<T>(key).value_or(defaultValue)}
+            : key{key}, nvs{nvs}, storedValue{nvs->get<T>(key)},
+              cachedValue{storedValue.value_or(defaultValue)}
         {}
 
     public:
@@ -52,7 +59,19 @@ public:
 
         ~Value() { commit(); };
 
-        void commit() { nvs->set<T>(key, cachedValue); }
+        /// @return Whether the value differs from the one stored in NVS.
+        bool isDirty() const
+        {
+            return !storedValue || std::memcmp(&*storedValue, &cachedValue, sizeof(T)) != 0;
+        }
+        /// @brief Writes the value to NVS, if it was changed.
+        void commit()
+        {
+            if (!isDirty())
+                return;
+            nvs->set<T>(key, cachedValue);
+            storedValue = cachedValue;
+        }
         T& operator=(const T& other) { return cachedValue = other; }
         T& operator=(T&& other) { return cachedValue = std::move(other); }
         operator T() const { return cachedValue; }
@@ -64,6 +83,48 @@ public:
         friend class NVS;
     };
 
+    /// @brief Record of related fields, stored together under a single key as one versioned blob.
+    /// The record is only written back, in a single transaction, if any of its fields changed.
+    /// @tparam T Trivially copyable struct holding the fields.
+    /// @tparam recordVersion Version of the layout of T. Stored records of another version are
+    /// discarded.
+    template <class T, uint8_t recordVersion = 0> class Record
+    {
+        struct Blob
+        {
+            uint8_t version;
+            T value;
+        };
+
+        const char* key;
+        NVS* nvs;
+        /// @brief Record as stored in NVS, std::nullopt if nothing (of this version) is stored.
+        std::optional<T> storedValue;
+        T cachedValue;
+
+        Record(const char* key, NVS* nvs, const T& defaultValue);
+
+    public:
+        Record(const Record&) = delete;
+        Record(Record&&) = delete;
+        Record& operator=(Record&&) = delete;
+
+        ~Record() { commit(); };
+
+        /// @return Whether any field differs from the record stored in NVS.
+        bool isDirty() const
+        {
+            return !storedValue || std::memcmp(&*storedValue, &cachedValue, sizeof(T)) != 0;
+        }
+        /// @brief Writes the record to NVS and commits, if any field was changed.
+        void commit();
+        constexpr const T& operator*() const { return cachedValue; }
+        constexpr T& operator*() { return cachedValue; }
+        constexpr const T* operator->() const { return &cachedValue; }
+        constexpr T* operator->() { return &cachedValue; }
+        friend class NVS;
+    };
+
     class Iterator
     {
         nvs_iterator_t nvsIterator;
@@ -92,6 +153,13 @@ public:
     {
         return Value<T>(key, this, defaultValue);
     }
+    template <class T, uint8_t recordVersion = 0>
+    Record<T, recordVersion> getRecord(const char* key, const T& defaultValue)
+    {
+        return Record<T, recordVersion>(key, this, defaultValue);
+    }
+    /// @return The value stored under the given key, std::nullopt if there is none.
+    template <class T> std::optional<T> find(const char* key) const { return get<T>(key); }
 
     void eraseKey(const char* key);
     template <class T> void eraseValue(const Value<T>& value) { return eraseKey(value->key); }
@@ -104,24 +172,148 @@ public:
 
 class Partition
 {
-    static constexpr size_t partitionNameMaxSize = 16;
+public:
+    /// @brief Flash access counters of a partition, shared by all open Partition objects on it.
+    struct Stats
+    {
+        /// @brief Amount of read operations issued to flash.
+        size_t reads{0};
+        /// @brief Amount of bytes read from flash.
+        size_t bytesRead{0};
+        /// @brief Amount of write operations issued to flash.
+        size_t writes{0};
+        /// @brief Amount of bytes written to flash.
+        size_t bytesWritten{0};
+        /// @brief Amount of sectors erased.
+        size_t erases{0};
+        /// @brief Amount of accesses served from the sector cache.
+        size_t cacheHits{0};
+        /// @brief Amount of accesses that missed the sector cache.
+        size_t cacheMisses{0};
+    };
+    /// @brief Maximum amount of sectors of a partition of which the erases are tracked.
+    static constexpr size_t maxWearSectors = 320;
+    /// @brief Amount of erase cycles a flash sector is rated for.
+    static constexpr uint32_t sectorEndurance = 100000;
+    /// @brief Lifetime wear of a partition. Kept in RTC memory to persist across deep sleep, and
+    /// backed up to NVS every few erases to survive resets and power loss.
+    struct Wear
+    {
+        uint32_t magic;
+        /// @brief Address of the partition in flash.
+        uint32_t address;
+        /// @brief Time (UNIX epoch, seconds) at which tracking started.
+        uint32_t since;
+        /// @brief Amount of erases over all sectors.
+        uint32_t totalErases;
+        /// @brief Value of totalErases at the last backup to NVS.
+        uint32_t backupErases;
+        /// @brief Amount of bytes programmed over all sectors.
+        uint64_t bytesProgrammed;
+        /// @brief Amount of erases per sector, wide enough to count past sectorEndurance.
+        std::array<uint32_t, maxWearSectors> erases;
+    };
+    /// @return Size of the wear maps kept in RTC memory.
+    static constexpr size_t getRTCFootprint() { return sizeof(Wear) * maxWearMaps; }
+
+protected:
     static constexpr size_t sectorSize = 4096;
     static constexpr size_t toSectorAddress(size_t address);
 
+private:
+    static constexpr size_t partitionNameMaxSize = 16;
+    /// @brief Amount of sectors held in the write-back cache of a partition.
+    static constexpr size_t cacheSize = 3;
+    /// @brief Amount of disjoint dirty ranges tracked per cached sector.
+    static constexpr size_t maxDirtyRanges = 4;
+    /// @brief Amount of partitions of which the wear can be kept in RTC memory.
+    static constexpr size_t maxWearMaps = 2;
+    static constexpr uint32_t wearMagic = 0x3241454D; // "MEA2"
+    /// @brief Amount of erases after which the wear of a partition is backed up to NVS.
+    static constexpr uint32_t wearBackupInterval = 64;
+    /// @brief Wear of the partitions in use, placed in RTC memory.
+    static std::array<Wear, maxWearMaps> wearMaps;
+
+    struct CachedSector
+    {
+        size_t address{0};
+        /// @brief Value of the cache's use counter at the last access, used for LRU eviction.
+        uint32_t lastUse{0};
+        /// @brief Whether the sector must be erased before the buffer can be written back.
+        bool erase{false};
+        /// @brief Range of bytes in the buffer that has to be programmed to flash.
+        struct DirtyRange
+        {
+            size_t begin{sectorSize}, end{0};
+
+            bool isEmpty() const { return begin >= end; }
+        };
+        /// @brief Disjoint dirty ranges, so that small writes far apart in the sector (e.g. a
+        /// header mark and appended data) do not drag the bytes in between along.
+        std::array<DirtyRange, maxDirtyRanges> dirty;
+        std::unique_ptr<std::array<uint8_t, sectorSize>> buffer;
+
+        bool isDirty() const;
+        /// @brief Adds the given range to the dirty ranges, merging it with the nearest one if
+        /// all are in use.
+        void markDirty(size_t begin, size_t end);
+        void markClean();
+    };
+    /// @brief Write-back sector cache, shared between all Partition objects opened on the same
+    /// partition.
+    struct Cache
+    {
+        const esp_partition_t* part;
+        std::array<CachedSector, cacheSize> sectors;
+        uint32_t useCounter{0};
+        Stats stats;
+        /// @brief Wear of the partition, pointing into RTC memory if a slot was available.
+        Wear* wear{nullptr};
+        Wear localWear;
+        /// @brief Read-only memory mapping of the entire partition, nullptr if not (yet) mapped.
+        const uint8_t* mapping{nullptr};
+        spi_flash_mmap_handle_t mappingHandle;
+        /// @brief Whether mapping the partition was attempted and failed, to avoid retrying.
+        bool mappingFailed{false};
+
+        Cache(const esp_partition_t* part) : part{part} {}
+        ~Cache();
+    };
+    /// @return The cache in use for the given partition, created if no other Partition object on
+    /// this partition is currently open.
+    static std::shared_ptr<Cache> getCache(const esp_partition_t* part);
+    /// @brief Looks up the wear of the cache's partition in RTC memory, restoring it from NVS if
+    /// it was lost.
+    void loadWear();
+    void backupWear();
+    void recordErase(size_t sectorAddress);
+
     const esp_partition_t* part;
     char name[partitionNameMaxSize];
     size_t maxSize;
-    std::unique_ptr<std::array<uint8_t, sectorSize>> sectorBuffer;
-    size_t sectorAddress;
-    bool sectorDirty;
-
-    bool inSector(size_t address) const;
-    void readSector(size_t sectorAddress);
-    void writeSector();
+    std::shared_ptr<Cache> cache;
+
+    /// @return The cached sector starting at the given address, nullptr if it is not cached.
+    CachedSector* findSector(size_t sectorAddress) const;
+    /// @brief Loads a sector into the cache, evicting (and writing back) the least recently used
+    /// sector if needed.
+    /// @return The cached sector starting at the given address.
+    CachedSector& loadSector(size_t sectorAddress);
+    /// @brief Frees up a sector in the cache by evicting the least recently used one.
+    /// @return The freed sector, of which the contents are undefined.
+    CachedSector& evictSector();
+    void writeSector(CachedSector& sector);
+    /// @return The memory mapping of the partition, mapped on first use. nullptr if the
+    /// partition could not be mapped.
+    const uint8_t* getMapping() const;
 
 protected:
     Partition(const char* name);
     void loadFirstSector(size_t address);
+    /// @brief Marks a sector to be erased on the next write-back, without reading it from flash.
+    /// Data written to this sector afterwards is programmed into the erased sector directly.
+    /// @param sectorAddress Start address of the sector to erase.
+    void eraseSector(size_t sectorAddress);
 
 public:
     Partition(const Partition&) = delete;
@@ -132,27 +324,208 @@ public:
 
     size_t getMaxSize() const { return maxSize; };
 
-    const char* getName() { return name; };
+    const char* getName() const { return name; };
+    /// @return The flash access counters of this partition.
+    const Stats& getStats() const { return cache->stats; }
+    /// @return The lifetime wear of this partition.
+    const Wear& getWear() const { return *cache->wear; }
+    /// @return The amount of sectors in this partition.
+    size_t getSectorCount() const { return maxSize / sectorSize; }
+    /// @return Projected remaining lifetime of the partition in seconds, extrapolating the erase
+    /// rate of its most worn sector since tracking started. std::nullopt if there is no wear yet.
+    std::optional<uint64_t> getRemainingLifetime() const;
+
     void read(size_t address, void* buffer, size_t size) const;
     template <class T> T read(size_t address) const;
-
+    /// @brief Gives read-only access to the partition without copying: bytes held in the sector
+    /// cache are viewed in the cache, all others straight in memory-mapped flash. The view is only
+    /// valid until the next write to the partition.
+    /// @param size Size of the view, which may not cross a sector boundary.
+    /// @return Pointer to the viewed bytes, nullptr if they can not be viewed.
+    const uint8_t* view(size_t address, size_t size) const;
+
+    /// @brief Writes to the partition. Bytes that only clear bits in flash (e.g. appends to erased
+    /// space) are programmed directly on write-back, other changes cause the sector to be erased
+    /// and rewritten.
     void write(size_t address, const void* buffer, size_t size);
     template <class T> void write(size_t address, const T& value);
 
+    /// @brief Writes all dirty cached sectors back to flash.
     void flush();
 };
+/// @brief Circular file stored in a partition. The position of the FIFO is not kept in NVS, but
+/// in small headers at the start of every sector of the partition: each time the head enters a
+/// sector, the sector is erased and stamped with an incrementing sequence number. On every flush,
+/// the FIFO state is programmed into the next free mark of the head sector's header, or once those
+/// are used up, appended to a log of marks in the last sectors of the partition.
 class FIFOFile : protected Partition
 {
 protected:
     NVS nvs;
 
 private:
-    NVS::Value<size_t> head;
-    NVS::Value<size_t> size;
-    NVS::Value<size_t> tail;
+    static constexpr size_t headerSize = 256;
+    /// @brief Amount of FIFO state marks held by a sector header.
+    static constexpr size_t nMarks = 16;
+    /// @brief Erased value of the push offset and count in a sector header.
+    static constexpr uint16_t noPushes = 0xFFFF;
+    /// @brief FIFO state, programmed once into an erased slot of the head sector's header.
+    struct Mark
+    {
+        /// @brief Size of the FIFO.
+        uint32_t size;
+        /// @brief Cursor as set by the derived class.
+        uint32_t cursor;
+        /// @brief Offset of the head in the head sector's data.
+        uint16_t head;
+        /// @brief Amount of pushes started in the head sector.
+        uint16_t count;
+        /// @brief Check value used to reject unwritten or torn marks.
+        uint16_t check;
+
+        static uint16_t computeCheck(uint16_t head, uint32_t size, uint32_t cursor,
+                                     uint16_t count)
+        {
+            return head ^ size ^ (size >> 16) ^ cursor ^ (cursor >> 16) ^ count ^ 0x5A5A;
+        }
+        bool isValid() const { return check == computeCheck(head, size, cursor, count); }
+    } __attribute__((packed));
+
+    struct SectorHeader
+    {
+        uint32_t magic;
+        uint32_t sequence;
+        /// @brief Offset of the first push started in the sector's data.
+        uint16_t first;
+        /// @brief Amount of pushes started in the previous sector, final once the head left it.
+        /// Stamped here along with the rest of the header, so that the previous sector is left
+        /// untouched.
+        uint16_t previousCount;
+        /// @brief Information about the previous sector, as given by the derived class.
+        std::array<uint8_t, 8> previousInfo;
+        std::array<Mark, nMarks> marks;
+    } __attribute__((packed));
+    static_assert(sizeof(SectorHeader) <= headerSize);
+    /// @brief FIFO state appended to the mark log once all marks of the head sector are used, so
+    /// that the head sector is never erased while it holds data.
+    struct LogMark
+    {
+        /// @brief Incremented for every mark appended, ordering the marks of all log sectors.
+        uint32_t serial;
+        /// @brief Sequence number of the head sector the state belongs to.
+        uint32_t sequence;
+        /// @brief Check value of the head sector's last mark, rejecting a log mark left behind by
+        /// an earlier sector with the same sequence number.
+        uint16_t anchor;
+        Mark mark;
+        /// @brief Check value used to reject unwritten or torn log marks.
+        uint16_t check;
+
+        static uint16_t computeCheck(uint32_t serial, uint32_t sequence, uint16_t anchor,
+                                     const Mark& mark)
+        {
+            return serial ^ (serial >> 16) ^ sequence ^ (sequence >> 16) ^ anchor ^ mark.check ^
+                   0xA5A5;
+        }
+        bool isValid() const
+        {
+            return mark.isValid() && check == computeCheck(serial, sequence, anchor, mark);
+        }
+    } __attribute__((packed));
+    /// @brief Amount of sectors at the end of the partition holding the mark log. They are
+    /// appended to in turns, so that the sector erased to continue the log never holds the latest
+    /// mark.
+    static constexpr size_t nLogSectors = 2;
+    /// @brief Amount of log marks held by a log sector.
+    static constexpr size_t logSectorMarks = sectorSize / sizeof(LogMark);
+
+    /// @brief Magic identifying the sectors of this file, distinguishing the formats of the data of
+    /// derived classes.
+    uint32_t magic;
+    size_t nSectors;
+    size_t head{0};
+    size_t tail{0};
+    size_t size{0};
+    /// @brief Sector that was entered last by the head, holding the most recent FIFO state.
+    size_t headSector;
+    /// @brief Sequence number of the head sector.
+    uint32_t sequence;
+    /// @brief Index of the next free mark in the head sector's header, nMarks once the state is
+    /// kept in the mark log.
+    size_t nextMark{0};
+    /// @brief Log sector holding the latest log mark.
+    size_t logSector{0};
+    /// @brief Index of the next free log mark in the log sector.
+    size_t nextLogMark{0};
+    /// @brief Serial of the latest log mark.
+    uint32_t logSerial{0};
+    /// @brief Amount of pushes started in the head sector.
+    size_t headCount{0};
+    /// @brief FIFO state as last stored in flash.
+    Mark lastMark{};
+
+    /// @return The partition address of the given position in the file data.
+    constexpr size_t toAddress(size_t position) const
+    {
+        return (position / sectorDataSize) * sectorSize + headerSize + position % sectorDataSize;
+    }
+    /// @return The partition address of the given log mark.
+    constexpr size_t toLogAddress(size_t sector, size_t index) const
+    {
+        return (nSectors + sector) * sectorSize + index * sizeof(LogMark);
+    }
+    /// @brief Recovers the FIFO state from the sector headers, using a binary search for the head
+    /// sector.
+    void recover();
+    /// @brief Finds the end of the mark log, to continue appending there.
+    /// @return The latest log mark, std::nullopt if the log holds none.
+    std::optional<LogMark> recoverLog();
+    /// @brief Erases the given sector and stamps it as the new head sector.
+    /// @param first Offset of the first push started in the sector, if any.
+    /// @param previousInfo Information about the sector left behind.
+    void enterSector(size_t sector, uint16_t first, const std::array<uint8_t, 8>& previousInfo);
+    void readData(size_t position, void* buffer, size_t size) const;
+    void writeData(size_t position, const void* buffer, size_t size);
 
 protected:
-    FIFOFile(const char* name);
+    /// @brief Identifies (and versions) sectors formatted as FIFO sectors.
+    static constexpr uint32_t sectorMagic = 0x3446464D; // "MFF4"
+    /// @brief Amount of file data held by a single sector.
+    static constexpr size_t sectorDataSize = sectorSize - headerSize;
+
+    /// @brief Position stored alongside the FIFO state, relative to the tail. Its meaning is up to
+    /// the derived class.
+    size_t cursor{0};
+
+    FIFOFile(const char* name, uint32_t magic = sectorMagic);
+
+    /// @brief Information about a sector, kept by the derived class in the header of the next
+    /// sector. Erased (all bytes 0xFF) if none was given.
+    using SectorInfo = std::array<uint8_t, 8>;
+    /// @brief Called when the head is about to leave the head sector, to obtain information about
+    /// it to keep in the header of the next sector.
+    /// @param pushStarted Whether the push entering the next sector started in the head sector.
+    virtual SectorInfo leaveSector(bool pushStarted);
+    /// @return The information kept about the sector holding the given address, std::nullopt for
+    /// the head sector.
+    std::optional<SectorInfo> getSectorInfo(size_t address) const;
+    /// @return The address at which the data of the sector holding the given address starts, zero
+    /// for the tail sector.
+    size_t getSectorStart(size_t address) const;
+
+    /// @brief Pushes started in a sector, allowing derived classes to skip over them at once.
+    struct SectorSummary
+    {
+        /// @brief Address of the first push started in the sector.
+        size_t first;
+        /// @brief Amount of pushes started in the sector.
+        size_t count;
+        /// @brief Address at which the sector's data ends and the next sector's data starts.
+        size_t end;
+    };
+    /// @return The summary of the sector holding the given address, std::nullopt if it is unknown
+    /// or no push started in the sector is still in the file.
+    std::optional<SectorSummary> getSummary(size_t address) const;
     /// @brief Cuts the beginning of the tail to free up space: how this cutting is implemented
     /// may be overriden.
     /// @param cutSize Minimal required size of cut in bytes.
@@ -162,15 +535,35 @@ protected:
 public:
     FIFOFile(FIFOFile&&) = default;
     FIFOFile& operator=(FIFOFile&&) = default;
-    virtual ~FIFOFile() {};
+    virtual ~FIFOFile() { flush(); };
 
     size_t getSize() const { return size; }
+    size_t getMaxSize() const { return nSectors * sectorDataSize; }
     size_t freeSpace() const;
+    /// @return Position of the head in the file data, where the next push is stored.
+    size_t getHead() const { return head; }
+    /// @return Position of the tail in the file data, where the oldest data is stored.
+    size_t getTail() const { return tail; }
 
     using Partition::getName;
+    using Partition::getRemainingLifetime;
+    using Partition::getSectorCount;
+    using Partition::getStats;
+    using Partition::getWear;
 
     void read(size_t address, void* buffer, size_t size) const;
     template <class T> T read(size_t address) const;
+    /// @brief Gives read-only access to file data without copying, valid until the next write to
+    /// the file.
+    /// @return Pointer to the viewed data, nullptr if the data is not stored contiguously (e.g.
+    /// when crossing a sector boundary) and must be read instead.
+    const uint8_t* view(size_t address, size_t size) const;
+    template <class T> const T* view(size_t address) const;
+    /// @brief Gives read-only access to the longest stretch of contiguously stored file data
+    /// starting at the given address. Walking the entire file thus takes one span per sector,
+    /// wrap-around included.
+    /// @return Pointer to the viewed data and its size, which is zero at the end of the file.
+    std::pair<const uint8_t*, size_t> span(size_t address) const;
 
     void push(const void* buffer, size_t size);
     template <class T> void push(const T& value);
@@ -178,6 +571,7 @@ public:
     void write(size_t address, const void* buffer, size_t size);
     template <class T> void write(size_t address, const T& value);
 
+    /// @brief Writes all file data to flash and stores the FIFO state in the head sector.
     void flush();
 };
 
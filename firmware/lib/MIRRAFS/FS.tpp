@@ -37,6 +37,27 @@ template <class T> void NVS::set(const char* key, const T& value)
         printf("Error while setting key '%s', code: %s\n", key, esp_err_to_name(err));
 }
 
+template <class T, uint8_t recordVersion>
+NVS::Record<T, recordVersion>::Record(const char* key, NVS* nvs, const T& defaultValue)
+    : key{key}, nvs{nvs}, cachedValue{defaultValue}
+{
+    std::optional<Blob> blob{nvs->get<Blob>(key)};
+    if (blob && blob->version == recordVersion)
+    {
+        storedValue = blob->value;
+        cachedValue = blob->value;
+    }
+}
+
+template <class T, uint8_t recordVersion> void NVS::Record<T, recordVersion>::commit()
+{
+    if (!isDirty())
+        return;
+    nvs->set<Blob>(key, Blob{recordVersion, cachedValue});
+    nvs->commit();
+    storedValue = cachedValue;
+}
+
 template <class T> T Partition::read(size_t address) const
 {
     T buffer;
@@ -56,6 +77,12 @@ template <class T> T FIFOFile::read(size_t address) const
     return buffer;
 }
 
+template <class T> const T* FIFOFile::view(size_t address) const
+{
+    static_assert(alignof(T) == 1, "Viewed types must be packed.");
+    return reinterpret_cast<const T*>(view(address, sizeof(T)));
+}
+
 template <class T> void FIFOFile::push(const T& value)
 {
     push(&value, sizeof(T));
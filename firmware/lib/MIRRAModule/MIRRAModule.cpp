@@ -1,9 +1,15 @@
 #include "MIRRAModule.h"
 
+#include "LogExport.h"
 #include "logging.h"
 #include <Arduino.h>
 #include <Wire.h>
+#include <algorithm>
+#include <cstring>
 #include <ctime>
+#include <limits>
+#include <memory>
+#include <optional>
 
 using namespace mirra;
 
@@ -44,90 +50,19 @@ MIRRAModule::MIRRAModule(const MIRRAPins& pins)
       lora{pins.csPin, pins.rstPin, pins.dio0Pin, pins.rxPin, pins.txPin},
       commandEntry{pins.bootPin, true}
 {
-    Log::getInstance().serial = &Serial;
+    // printing every message to the serial takes the caller's time: only do so when someone is
+    // likely to read it
+    if (commandEntry.isFlagSet() || *Log::getInstance().file.echo)
+        Log::getInstance().serial = &Serial;
     Serial.println("Logger initialised.");
-    Log::info("Reset reason: ", esp_rom_get_reset_reason(0));
-}
-
-MIRRAModule::SensorFile::SensorFile() : FIFOFile("data"), reader{nvs.getValue<size_t>("reader", 0)}
-{}
-
-size_t MIRRAModule::SensorFile::cutTail(size_t cutSize)
-{
-    size_t removed{0};
-    while (removed < cutSize)
-    {
-        removed += DataEntry::getSize(read<DataEntry::Flags>(removed + DataEntry::flagsPosition));
-    }
-    reader = reader < removed ? 0 : reader - removed;
-    return FIFOFile::cutTail(removed);
-}
-
-MIRRAModule::SensorFile::Iterator& MIRRAModule::SensorFile::Iterator::operator++()
-{
-    address += DataEntry::getSize(file->read<DataEntry::Flags>(address + DataEntry::flagsPosition));
-    return *this;
-}
-
-std::optional<size_t> MIRRAModule::SensorFile::getUnuploadedAddress(size_t index)
-{
-    size_t address = reader;
-    size_t count{0};
-    while (true)
-    {
-        if (address == getSize())
-            return std::nullopt;
-        DataEntry::Flags flags = read<DataEntry::Flags>(address + DataEntry::flagsPosition);
-        if (!flags.uploaded)
-        {
-            if (count == 0)
-                reader = address;
-            if (count == index)
-                return address;
-            count++;
-        }
-        address += DataEntry::getSize(flags);
-    }
-}
-
-std::optional<MIRRAModule::SensorFile::DataEntry>
-MIRRAModule::SensorFile::getUnuploaded(size_t index)
-{
-    auto address = getUnuploadedAddress(index);
-    if (!address)
-        return std::nullopt;
-    return read<DataEntry>(*address);
-}
-
-bool MIRRAModule::SensorFile::isLast(size_t index)
-{
-    return !getUnuploadedAddress(index + 1);
-}
-
-void MIRRAModule::SensorFile::push(const Message<SENSOR_DATA>& message)
-{
-    push(DataEntry{message.getSource(), message.time, DataEntry::Flags{message.nValues, false},
-                   message.values});
-}
-
-void MIRRAModule::SensorFile::setUploaded()
-{
-    DataEntry::Flags flags = read<DataEntry::Flags>(reader + DataEntry::flagsPosition);
-    flags.uploaded = true;
-    write(reader + DataEntry::flagsPosition, flags);
-}
-
-void MIRRAModule::SensorFile::flush()
-{
-    reader.commit();
-    FIFOFile::flush();
+    LOG_INFO(GENERAL, "Reset reason: ", esp_rom_get_reset_reason(0));
 }
 
 void MIRRAModule::deepSleep(uint32_t sleepTime)
 {
     if (sleepTime <= 0)
     {
-        Log::error("Sleep time was zero or negative! Sleeping one second to avert crisis.");
+        LOG_ERROR(GENERAL, "Sleep time was zero or negative! Sleeping one second to avert crisis.");
         sleepTime = 1;
     }
 
@@ -136,19 +71,19 @@ void MIRRAModule::deepSleep(uint32_t sleepTime)
     // 30s the internal oscillator will be used to wake from deep sleep
     if (sleepTime <= 30)
     {
-        Log::debug("Using internal timer for deep sleep.");
+        LOG_DEBUG(GENERAL, "Using internal timer for deep sleep.");
         esp_sleep_enable_timer_wakeup((uint64_t)sleepTime * 1000 * 1000);
     }
     else
     {
-        Log::debug("Using RTC for deep sleep.");
+        LOG_DEBUG(GENERAL, "Using RTC for deep sleep.");
         rtc.writeAlarm(rtc.readTimeEpoch() + sleepTime);
         rtc.enableAlarm();
         esp_sleep_enable_ext0_wakeup((gpio_num_t)rtc.getIntPin(), 0);
     }
     esp_sleep_enable_ext1_wakeup((gpio_num_t)_BV(this->pins.bootPin),
                                  ESP_EXT1_WAKEUP_ALL_LOW); // wake when BOOT button is pressed
-    Log::info("Good night.");
+    LOG_INFO(GENERAL, "Good night.");
     this->end();
     esp_deep_sleep_start();
 }
@@ -170,7 +105,7 @@ void MIRRAModule::lightSleep(float sleepTime)
 {
     if (sleepTime <= 0)
     {
-        Log::error("Sleep time was zero or negative! Skipping to avert crisis.");
+        LOG_ERROR(GENERAL, "Sleep time was zero or negative! Skipping to avert crisis.");
         return;
     }
     esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
@@ -191,82 +126,379 @@ void MIRRAModule::lightSleepUntil(uint32_t untilTime)
     }
 }
 
-CommandCode MIRRAModule::Commands::setLogLevel(const char* arg)
+/// @return The log level named by the given argument, std::nullopt if it names none.
+static std::optional<Log::Level> parseLogLevel(const char* arg)
 {
     if (strcmp("DEBUG", arg) == 0)
-        Log::getInstance().file.level = Log::Level::DEBUG;
+        return Log::Level::DEBUG;
     else if (strcmp("INFO", arg) == 0)
-        Log::getInstance().file.level = Log::Level::INFO;
+        return Log::Level::INFO;
     else if (strcmp("ERROR", arg) == 0)
-        Log::getInstance().file.level = Log::Level::ERROR;
+        return Log::Level::ERROR;
+    Serial.printf("Argument '%s' is not a valid log level.\n", arg);
+    return std::nullopt;
+}
+
+CommandCode MIRRAModule::Commands::setLogLevel(const char* arg)
+{
+    auto level{parseLogLevel(arg)};
+    if (!level)
+        return COMMAND_ERROR;
+    Log::getInstance().file.levels->fill(*level);
+    return COMMAND_SUCCESS;
+}
+
+CommandCode MIRRAModule::Commands::setLogEcho(const char* arg)
+{
+    if (strcmp("ON", arg) == 0)
+        *Log::getInstance().file.echo = true;
+    else if (strcmp("OFF", arg) == 0)
+        *Log::getInstance().file.echo = false;
     else
     {
-        Serial.printf("Argument '%s' is not a valid log level.\n", arg);
+        Serial.printf("Argument '%s' is not ON or OFF.\n", arg);
         return COMMAND_ERROR;
     }
+    // takes effect from the next boot on
+    Log::getInstance().file.echo.commit();
     return COMMAND_SUCCESS;
 }
 
+CommandCode MIRRAModule::Commands::setModuleLogLevel(const char* module, const char* level)
+{
+    auto moduleLevel{parseLogLevel(level)};
+    if (!moduleLevel)
+        return COMMAND_ERROR;
+    for (size_t i{0}; i < Log::nModules; i++)
+    {
+        Log::Module candidate{static_cast<Log::Module>(i)};
+        if (Log::moduleToString(candidate) != module)
+            continue;
+        (*Log::getInstance().file.levels)[i] = *moduleLevel;
+        if (!Log::isCompiled(candidate, *moduleLevel))
+            Serial.printf("Note: messages of module '%s' below level '%s' are not compiled in.\n",
+                          module, level);
+        return COMMAND_SUCCESS;
+    }
+    Serial.printf("Argument '%s' is not a valid log module.\n", module);
+    return COMMAND_ERROR;
+}
+
+/// @brief Prints the stored log records from the given address onwards that are at or above the
+/// given level and within the given time range. Records are formatted as they are printed, but
+/// only the headers of records that are filtered out are read. The caller holds a Log::Lock.
+static void printLogRecords(size_t address, Log::Level level, uint32_t from, uint32_t to)
+{
+    char buffer[Log::bufferSize];
+    const Log::File& file = Log::getInstance().file;
+    while (address < file.getSize())
+    {
+        Log::RecordHeader header{file.getHeader(address)};
+        if (header.size <= sizeof(Log::RecordHeader))
+        {
+            Serial.print("Corrupted log record, stopping.\n");
+            break;
+        }
+        if (header.level >= level && header.time >= from && header.time <= to)
+        {
+            size_t length;
+            file.decode(address, buffer, length);
+            Serial.write(buffer, length);
+        }
+        address += header.size;
+    }
+    Serial.print('\n');
+}
+
 CommandCode MIRRAModule::Commands::printLogs()
 {
-    static constexpr size_t bufferSize{256};
-    char buffer[bufferSize];
-    size_t cursor{0};
+    Log::getInstance().flush();
+    Log::Lock lock;
     const Log::File& file = Log::getInstance().file;
     Serial.printf("Logs: %u out of %u KB.\n", file.getSize() / 1024, file.getMaxSize() / 1024);
-    while (cursor < file.getSize())
+    if constexpr (Log::async)
     {
-        file.read(cursor, buffer, bufferSize);
-        Serial.write(buffer, std::min(bufferSize, file.getSize() - cursor));
-        cursor += bufferSize;
+        if (Log::getInstance().getDropped() > 0)
+            Serial.printf("%u messages dropped because the logging task fell behind.\n",
+                          Log::getInstance().getDropped());
     }
-    Serial.print('\n');
+    printLogRecords(0, Log::Level::DEBUG, 0, std::numeric_limits<uint32_t>::max());
     return COMMAND_SUCCESS;
 }
 
-CommandCode MIRRAModule::Commands::printData()
+CommandCode MIRRAModule::Commands::printLogsLevel(const char* level)
 {
-    SensorFile file{};
-    Serial.printf("Data: %u out of %u KB.\n", file.getSize() / 1024, file.getMaxSize() / 1024);
-    for (SensorFile::DataEntry entry : file)
+    return printLogsRange(level, 0, std::numeric_limits<uint32_t>::max());
+}
+
+CommandCode MIRRAModule::Commands::printLogsRange(const char* level, uint32_t from, uint32_t to)
+{
+    auto minLevel{parseLogLevel(level)};
+    if (!minLevel)
+        return COMMAND_ERROR;
+    Log::getInstance().flush();
+    Log::Lock lock;
+    printLogRecords(0, *minLevel, from, to);
+    return COMMAND_SUCCESS;
+}
+
+CommandCode MIRRAModule::Commands::printLogsTail(size_t count)
+{
+    Log::getInstance().flush();
+    Log::Lock lock;
+    const Log::File& file = Log::getInstance().file;
+    // walk back from the head over the records to print
+    size_t address{file.getSize()};
+    for (size_t i{0}; i < count && address > 0; i++)
+    {
+        size_t previous{file.getPrevious(address)};
+        if (previous >= address)
+        {
+            Serial.print("Corrupted log record, stopping.\n");
+            return COMMAND_ERROR;
+        }
+        address = previous;
+    }
+    printLogRecords(address, Log::Level::DEBUG, 0, std::numeric_limits<uint32_t>::max());
+    return COMMAND_SUCCESS;
+}
+
+/// @brief Prints a data entry to the serial output in human readable format.
+static void printEntry(const SensorFile::DataEntry& entry)
+{
+    Serial.printf("%s ", entry.source.toString());
+
+    time_t time = static_cast<time_t>(entry.time);
+    static constexpr size_t timeLength{sizeof("0000-00-00 00:00:00")};
+    char timeBuffer[timeLength];
+    std::strftime(timeBuffer, timeLength, "%F %T", gmtime(&time));
+    Serial.print(timeBuffer);
+
+    if (entry.flags.uploaded)
+        Serial.print(" UP");
+
+    // entries compacted to make room hold statistics over an hour or a day
+    if (entry.flags.aggregate)
+        Serial.print(entry.values[0].instanceTag & SensorFile::dailyTag ? " DAILY" : " HOURLY");
+
+    Serial.print("\n");
+
+    static constexpr const char* statisticNames[]{"", " MIN", " MEAN", " MAX"};
+    for (size_t i = 0; i < entry.flags.nValues; i++)
     {
-        Serial.printf("%s ", entry.source.toString());
+        Serial.printf("%u %f%s\n", entry.values[i].typeTag, entry.values[i].value,
+                      statisticNames[static_cast<uint8_t>(
+                          SensorFile::getStatistic(entry.values[i]))]);
+    }
 
-        time_t time = static_cast<time_t>(entry.time);
-        static constexpr size_t timeLength{sizeof("0000-00-00 00:00:00")};
-        char timeBuffer[timeLength];
-        std::strftime(timeBuffer, timeLength, "%F %T", gmtime(&time));
-        Serial.print(timeBuffer);
+    Serial.print("\n");
+}
+
+CommandCode MIRRAModule::Commands::printLogStats()
+{
+    Log::getInstance().flush();
+    Serial.printf("%u repeated messages coalesced.\n", Log::getInstance().getCoalesced());
+    if constexpr (Log::async)
+        Serial.printf("%u messages dropped because the logging task fell behind.\n",
+                      Log::getInstance().getDropped());
+    Serial.print("Call sites (logged, repeated, suppressed):\n");
+    for (const Log::Site* site{Log::getInstance().getSites()}; site != nullptr; site = site->next)
+    {
+        const char* name{std::strrchr(site->file, '/')};
+        Serial.printf("  %s:%u: %u, %u, %u\n", name != nullptr ? name + 1 : site->file, site->line,
+                      site->logged, site->repeated, site->suppressed);
+    }
+    return COMMAND_SUCCESS;
+}
 
-        if (entry.flags.uploaded)
-            Serial.print(" UP");
+/// @brief Exports the stored log records from the given address onwards as compressed frames of
+/// log lines, at the given baud rate. The caller holds a Log::Lock.
+static CommandCode exportLogRecords(size_t address, uint32_t baudRate)
+{
+    Log& log{Log::getInstance()};
+    const Log::File& file = log.file;
+    auto compressor{std::make_unique<logexport::Compressor>()};
+    auto block{std::make_unique<uint8_t[]>(logexport::blockSize)};
+    auto frame{std::make_unique<uint8_t[]>(logexport::maxFrameSize)};
 
-        Serial.print("\n");
+    Serial.printf("Exporting logs at %u baud, send a character once switched.\n", baudRate);
+    Serial.flush();
+    uint32_t previousBaudRate{Serial.baudRate()};
+    Serial.updateBaudRate(baudRate);
+    delay(10);
+    while (Serial.available())
+        Serial.read();
+    uint32_t start{millis()};
+    while (!Serial.available())
+    {
+        if (millis() - start >= 10 * 1000)
+        {
+            Serial.updateBaudRate(previousBaudRate);
+            return COMMAND_TIMEOUT;
+        }
+    }
+    while (Serial.available())
+        Serial.read();
+    // log messages printed during the export would corrupt the frames
+    HardwareSerial* serial{log.serial};
+    log.serial = nullptr;
 
-        for (size_t i = 0; i < entry.flags.nValues; i++)
+    bool corrupted{false};
+    size_t size;
+    do // fill blocks with whole log lines, ending the export with an empty one
+    {
+        size = 0;
+        while (address < file.getSize() && size + Log::bufferSize <= logexport::blockSize)
         {
-            Serial.printf("%u %f\n", entry.values[i].typeTag, entry.values[i].value);
+            size_t length;
+            size_t recordSize{file.decode(address, reinterpret_cast<char*>(&block[size]), length)};
+            if (recordSize == 0)
+            {
+                corrupted = true;
+                address = file.getSize();
+                break;
+            }
+            size += length;
+            address += recordSize;
         }
+        uint32_t resume{static_cast<uint32_t>((file.getTail() + address) % file.getMaxSize())};
+        Serial.write(frame.get(),
+                     logexport::encodeFrame(*compressor, block.get(), size, resume,
+                                            file.getSize() - address, frame.get()));
+    } while (size > 0);
+    Serial.flush();
+    Serial.updateBaudRate(previousBaudRate);
+    log.serial = serial;
+    if (corrupted)
+    {
+        Serial.print("Corrupted log record, export ended early.\n");
+        return COMMAND_ERROR;
+    }
+    return COMMAND_SUCCESS;
+}
+
+CommandCode MIRRAModule::Commands::exportLogs()
+{
+    return exportLogsBaud(logexport::defaultBaudRate);
+}
 
-        Serial.print("\n");
+CommandCode MIRRAModule::Commands::exportLogsBaud(uint32_t baudRate)
+{
+    Log::getInstance().flush();
+    Log::Lock lock;
+    return exportLogRecords(0, baudRate);
+}
+
+CommandCode MIRRAModule::Commands::exportLogsFrom(uint32_t baudRate, uint32_t position)
+{
+    Log::getInstance().flush();
+    Log::Lock lock;
+    const Log::File& file = Log::getInstance().file;
+    // positions do not change when the tail is cut, unlike addresses
+    size_t address{(position + file.getMaxSize() - file.getTail()) % file.getMaxSize()};
+    if (address >= file.getSize()) // the records following the position have been cut since
+        address = 0;
+    return exportLogRecords(address, baudRate);
+}
+
+CommandCode MIRRAModule::Commands::printData()
+{
+    SensorFile file{};
+    Serial.printf("Data: %u out of %u KB.\n", file.getSize() / 1024, file.getMaxSize() / 1024);
+    for (const SensorFile::DataEntry& entry : file)
+        printEntry(entry);
+    return COMMAND_SUCCESS;
+}
+
+CommandCode MIRRAModule::Commands::printDataRange(uint32_t from, uint32_t to)
+{
+    SensorFile file{};
+    for (auto it{file.seek(from)}; it != file.end(); ++it)
+    {
+        // entries are pushed as they are sampled or received: the range ends at the first later one
+        if (it->time > to)
+            break;
+        if (it->time >= from)
+            printEntry(*it);
     }
     return COMMAND_SUCCESS;
 }
 
+CommandCode MIRRAModule::Commands::requeueData(uint32_t from, uint32_t to)
+{
+    SensorFile file{};
+    Serial.printf("Requeued %u entries for upload.\n", file.requeue(from, to));
+    return COMMAND_SUCCESS;
+}
+
 CommandCode MIRRAModule::Commands::printDataRaw()
 {
     SensorFile file{};
-    for (SensorFile::DataEntry entry : file)
+    for (const SensorFile::DataEntry& entry : file)
     {
         for (size_t i = 0; i < entry.getSize(); i++)
         {
-            Serial.printf("%02X", reinterpret_cast<uint8_t*>(&entry)[i]);
+            Serial.printf("%02X", reinterpret_cast<const uint8_t*>(&entry)[i]);
         }
         Serial.print('\n');
     }
     return COMMAND_SUCCESS;
 }
 
+/// @brief Prints the FIFO state, flash usage and wear map of a file's partition.
+template <class F> static void printFileStats(const F& file)
+{
+    Serial.printf("Partition '%s': %u sectors.\n", file.getName(), file.getSectorCount());
+    Serial.printf("  FIFO: head %u, tail %u, %u out of %u KB used (%.1f%%).\n", file.getHead(),
+                  file.getTail(), file.getSize() / 1024, file.getMaxSize() / 1024,
+                  100.0 * file.getSize() / file.getMaxSize());
+    const auto& stats{file.getStats()};
+    Serial.printf("  Since opened: %u KB read, %u KB written, %u erases, %u/%u cache hits.\n",
+                  stats.bytesRead / 1024, stats.bytesWritten / 1024, stats.erases,
+                  stats.cacheHits, stats.cacheHits + stats.cacheMisses);
+
+    const auto& wear{file.getWear()};
+    time_t since = static_cast<time_t>(wear.since);
+    static constexpr size_t timeLength{sizeof("0000-00-00 00:00:00")};
+    char timeBuffer[timeLength];
+    std::strftime(timeBuffer, timeLength, "%F %T", gmtime(&since));
+    Serial.printf("  Since %s: %u KB programmed, %u erases.\n", timeBuffer,
+                  static_cast<uint32_t>(wear.bytesProgrammed / 1024), wear.totalErases);
+    size_t nSectors{std::min(file.getSectorCount(), wear.erases.size())};
+    auto [minErases, maxErases] = std::minmax_element(wear.erases.begin(),
+                                                      wear.erases.begin() + nSectors);
+    Serial.printf("  Erases per sector: min %u, mean %.1f, max %u (rated for %u).\n", *minErases,
+                  static_cast<float>(wear.totalErases) / nSectors, *maxErases,
+                  fs::Partition::sectorEndurance);
+    auto lifetime{file.getRemainingLifetime()};
+    if (lifetime)
+        Serial.printf("  Projected remaining lifetime: %.1f years.\n",
+                      *lifetime / (365.0f * 24 * 60 * 60));
+    else
+        Serial.print("  Projected remaining lifetime: unknown.\n");
+
+    static constexpr size_t sectorsPerLine{16};
+    Serial.print("  Wear map (erases per sector):");
+    for (size_t i{0}; i < nSectors; i++)
+    {
+        if (i % sectorsPerLine == 0)
+            Serial.printf("\n  %4u:", i);
+        Serial.printf(" %5u", wear.erases[i]);
+    }
+    Serial.print("\n\n");
+}
+
+CommandCode MIRRAModule::Commands::printFSStats()
+{
+    Log::getInstance().flush();
+    {
+        Log::Lock lock;
+        printFileStats(Log::getInstance().file);
+    }
+    printFileStats(SensorFile{});
+    return COMMAND_SUCCESS;
+}
+
 CommandCode MIRRAModule::Commands::format()
 {
     Serial.println("Erasing NVS...");
@@ -279,7 +511,7 @@ CommandCode MIRRAModule::Commands::format()
 CommandCode MIRRAModule::Commands::spam(size_t count)
 {
     for (size_t i = 0; i < count; i++)
-        Log::getInstance().file.push("abcdefghijklmnopqrstuvwxyz\n");
+        Log::getInstance().store<Log::Level::ERROR>("abcdefghijklmnopqrstuvwxyz");
     Serial.println("Spamming done.");
     return COMMAND_SUCCESS;
 }
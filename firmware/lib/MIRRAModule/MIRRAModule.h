@@ -5,6 +5,7 @@
 #include "FS.h"
 #include "LoRaModule.h"
 #include "PCF2129_RTC.h"
+#include "SensorFile.h"
 
 namespace mirra
 {
@@ -44,15 +45,57 @@ protected:
 
     struct Commands : CommonCommands
     {
-        /// @brief Change the log level.
+        /// @brief Change the log level of all modules.
         /// @param arg String describing the new log level. ("ERROR", "INFO" or "DEBUG")
         CommandCode setLogLevel(const char* arg);
+        /// @brief Change the log level of a single module.
+        /// @param module Name of the module. ("GENERAL", "LORA", "FS", "GATEWAY" or "SENSORS")
+        /// @param level String describing the new log level. ("ERROR", "INFO" or "DEBUG")
+        CommandCode setModuleLogLevel(const char* module, const char* level);
+        /// @brief Enables or disables printing log messages to the serial output outside of the
+        /// command phase.
+        /// @param arg "ON" or "OFF".
+        CommandCode setLogEcho(const char* arg);
         /// @brief Prints the stored logs to the serial output.
         CommandCode printLogs();
+        /// @brief Prints the stored logs at or above a level to the serial output.
+        CommandCode printLogsLevel(const char* level);
+        /// @brief Prints the stored logs at or above a level in a time range to the serial output.
+        /// @param from Start of the time range (UNIX epoch, seconds).
+        /// @param to End of the time range, inclusive (UNIX epoch, seconds).
+        CommandCode printLogsRange(const char* level, uint32_t from, uint32_t to);
+        /// @brief Prints the most recent stored logs to the serial output.
+        /// @param count Amount of log records to print.
+        CommandCode printLogsTail(size_t count);
+        /// @brief Exports the stored logs, formatted as by printLogs, as compressed frames at the
+        /// default export baud rate (see LogExport.h).
+        CommandCode exportLogs();
+        /// @brief Exports the stored logs as compressed frames. The serial is switched to the given
+        /// baud rate, and the export starts once the host sends a character at that baud rate.
+        CommandCode exportLogsBaud(uint32_t baudRate);
+        /// @brief Resumes an interrupted export of the stored logs.
+        /// @param position Position in the log partition to resume the export from, as reported
+        /// by the last frame received.
+        CommandCode exportLogsFrom(uint32_t baudRate, uint32_t position);
+        /// @brief Prints the log storm counters to the serial output: the messages coalesced and
+        /// suppressed in total and per call site.
+        CommandCode printLogStats();
         /// @brief Prints all stored data entries to the serial output in human readable format.
         CommandCode printData();
+        /// @brief Prints the stored data entries in a time range to the serial output in human
+        /// readable format.
+        /// @param from Start of the time range (UNIX epoch, seconds).
+        /// @param to End of the time range, inclusive (UNIX epoch, seconds).
+        CommandCode printDataRange(uint32_t from, uint32_t to);
+        /// @brief Queues the uploaded data entries in a time range for upload again.
+        /// @param from Start of the time range (UNIX epoch, seconds).
+        /// @param to End of the time range, inclusive (UNIX epoch, seconds).
+        CommandCode requeueData(uint32_t from, uint32_t to);
         /// @brief Prints all stored data entries to the serial output as a hex dump.
         CommandCode printDataRaw();
+        /// @brief Prints the state, flash usage and wear of the log and data partitions to the
+        /// serial output.
+        CommandCode printFSStats();
         /// @brief Formats the module, clearing the entire NVS and filesystem and restarts the
         /// module (effectively a hard reset).
         CommandCode format();
@@ -65,80 +108,31 @@ protected:
             return std::tuple_cat(
                 CommonCommands::getCommands(),
                 std::make_tuple(
+                    CommandAliasesPair(&Commands::setModuleLogLevel, "setlog", "setloglevel"),
                     CommandAliasesPair(&Commands::setLogLevel, "setlog", "setloglevel"),
+                    CommandAliasesPair(&Commands::setLogEcho, "setlogecho"),
+                    CommandAliasesPair(&Commands::printLogsRange, "printlog", "printlogs",
+                                       "printlogfile"),
+                    CommandAliasesPair(&Commands::printLogsLevel, "printlog", "printlogs",
+                                       "printlogfile"),
                     CommandAliasesPair(&Commands::printLogs, "printlog", "printlogs",
                                        "printlogfile"),
+                    CommandAliasesPair(&Commands::printLogsTail, "printlogtail"),
+                    CommandAliasesPair(&Commands::printLogStats, "logstats"),
+                    CommandAliasesPair(&Commands::exportLogsFrom, "exportlog", "exportlogs"),
+                    CommandAliasesPair(&Commands::exportLogsBaud, "exportlog", "exportlogs"),
+                    CommandAliasesPair(&Commands::exportLogs, "exportlog", "exportlogs"),
+                    CommandAliasesPair(&Commands::printDataRange, "printdata", "printdatafile"),
                     CommandAliasesPair(&Commands::printData, "printdata", "printdatafile"),
+                    CommandAliasesPair(&Commands::requeueData, "requeue"),
                     CommandAliasesPair(&Commands::printDataRaw, "printdataraw", "printdatahex"),
+                    CommandAliasesPair(&Commands::printFSStats, "fsstats"),
                     CommandAliasesPair(&Commands::format, "format"),
                     CommandAliasesPair(&Commands::spam, "spam")));
         }
     };
 
-    class SensorFile final : fs::FIFOFile
-    {
-        fs::NVS::Value<size_t> reader;
-
-        size_t cutTail(size_t cutSize);
-
-    public:
-        struct DataEntry
-        {
-            struct Flags
-            {
-                uint8_t nValues : 7;
-                bool uploaded : 1;
-            };
-            using SensorValueArray = Message<SENSOR_DATA>::SensorValueArray;
-
-            MACAddress source;
-            uint32_t time;
-            Flags flags;
-            SensorValueArray values;
-
-            static constexpr size_t flagsPosition = sizeof(source) + sizeof(time);
-
-            static constexpr size_t getSize(Flags flags)
-            {
-                return sizeof(source) + sizeof(time) + sizeof(flags) +
-                       flags.nValues * sizeof(SensorValue);
-            }
-            constexpr size_t getSize() const { return getSize(flags); }
-        } __attribute__((packed));
-
-        SensorFile();
-
-        using FIFOFile::getMaxSize;
-        using FIFOFile::getSize;
-
-        using FIFOFile::read;
-
-        class Iterator
-        {
-            size_t address;
-            const SensorFile* file;
-            Iterator(size_t address, const SensorFile* file) : address{address}, file{file} {}
-
-        public:
-            Iterator& operator++();
-            bool operator!=(const Iterator& other) const { return this->address != other.address; }
-            DataEntry operator*() const { return file->read<DataEntry>(address); }
-
-            friend class SensorFile;
-        };
-
-        Iterator begin() const { return Iterator(0, this); };
-        Iterator end() const { return Iterator(getSize(), this); };
-        std::optional<size_t> getUnuploadedAddress(size_t index);
-        std::optional<DataEntry> getUnuploaded(size_t index);
-        bool isLast(size_t index);
-
-        void push(const Message<SENSOR_DATA>& message);
-        void push(const DataEntry& entry) { FIFOFile::push(&entry, entry.getSize()); }
-        void setUploaded();
-
-        void flush();
-    };
+    using SensorFile = mirra::SensorFile;
 
     /// @brief Enters deep sleep for the specified time.
     /// @param sleepTime The time in seconds to sleep.
@@ -0,0 +1,721 @@
+#include "SensorFile.h"
+#include <algorithm>
+#include <limits>
+
+using namespace mirra;
+
+namespace
+{
+/// @brief Code of a value that did not change since the record before it. Other codes hold the
+/// amount of trailing zero bytes of the XORed value in the upper two bits and the amount of bytes
+/// stored, minus one, in the lower two bits.
+constexpr uint8_t unchangedCode = 0xF;
+
+void putVarint(uint8_t*& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+}
+
+uint64_t getVarint(const uint8_t*& in)
+{
+    uint64_t value{0};
+    for (size_t shift{0}; shift < 64; shift += 7)
+    {
+        uint8_t byte{*in++};
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            break;
+    }
+    return value;
+}
+
+/// @brief Maps signed integers to unsigned ones such that small magnitudes stay small.
+constexpr uint64_t toZigZag(int64_t value)
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+constexpr int64_t fromZigZag(uint64_t value)
+{
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+uint32_t toBits(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+float fromBits(uint32_t bits)
+{
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/// @brief Compacts unuploaded entries cut from the tail into aggregates. Samples are aggregated per
+/// hour, and hourly aggregates per day. Hours holding too few samples to be worth an aggregate of
+/// their own are aggregated per day straight away.
+class Compactor
+{
+    using DataEntry = SensorFile::DataEntry;
+    using Statistic = SensorFile::Statistic;
+
+    static constexpr uint32_t hour = 60 * 60;
+    static constexpr uint32_t day = 24 * hour;
+    /// @brief Minimum amount of samples for an hourly aggregate to be smaller than the samples.
+    static constexpr size_t minHourlyCount = 4;
+    /// @brief Minimum amount of entries in a daily aggregate. Single entries are not compacted,
+    /// but dropped, as compacting them would not free up any space.
+    static constexpr size_t minDailyCount = 2;
+
+    struct Statistics
+    {
+        uint8_t typeTag;
+        uint8_t instanceTag;
+        float minimum{std::numeric_limits<float>::infinity()};
+        float maximum{-std::numeric_limits<float>::infinity()};
+        float sum{0};
+        size_t count{0};
+    };
+    struct Bucket
+    {
+        MACAddress source;
+        /// @brief Start of the hour or day aggregated.
+        uint32_t start;
+        /// @brief Amount of entries aggregated.
+        size_t count{0};
+        std::vector<Statistics> values{};
+
+        /// @return The statistics of the sensor with the given tags, nullptr if the bucket holds
+        /// the maximum amount of sensors already.
+        Statistics* find(uint8_t typeTag, uint8_t instanceTag)
+        {
+            for (Statistics& statistics : values)
+            {
+                if (statistics.typeTag == typeTag && statistics.instanceTag == instanceTag)
+                    return &statistics;
+            }
+            if (values.size() >= Message<SENSOR_DATA>::maxNValues)
+                return nullptr;
+            return &values.emplace_back(Statistics{typeTag, instanceTag});
+        }
+        void add(const DataEntry& entry)
+        {
+            for (size_t i{0}; i < entry.flags.nValues; i++)
+            {
+                const SensorValue& value{entry.values[i]};
+                Statistics* statistics{
+                    find(value.typeTag, value.instanceTag & SensorFile::instanceMask)};
+                if (statistics == nullptr)
+                    continue;
+                Statistic statistic{SensorFile::getStatistic(value)};
+                if (statistic == Statistic::SAMPLE || statistic == Statistic::MINIMUM)
+                    statistics->minimum = std::min(statistics->minimum, value.value);
+                if (statistic == Statistic::SAMPLE || statistic == Statistic::MAXIMUM)
+                    statistics->maximum = std::max(statistics->maximum, value.value);
+                if (statistic == Statistic::SAMPLE || statistic == Statistic::MEAN)
+                {
+                    statistics->sum += value.value;
+                    statistics->count++;
+                }
+            }
+            count++;
+        }
+        void add(const Bucket& other)
+        {
+            for (const Statistics& from : other.values)
+            {
+                Statistics* statistics{find(from.typeTag, from.instanceTag)};
+                if (statistics == nullptr)
+                    continue;
+                statistics->minimum = std::min(statistics->minimum, from.minimum);
+                statistics->maximum = std::max(statistics->maximum, from.maximum);
+                statistics->sum += from.sum;
+                statistics->count += from.count;
+            }
+            count += other.count;
+        }
+    };
+
+    /// @brief Hour being aggregated for every source. The entries of a source are mostly in
+    /// order, so an hour is done with once the next one starts.
+    std::vector<Bucket> hours;
+    /// @brief Days being aggregated, kept until all entries are compacted.
+    std::vector<Bucket> days;
+    std::vector<DataEntry>& aggregates;
+
+    Bucket& getDay(const MACAddress& source, uint32_t time)
+    {
+        uint32_t start{time - time % day};
+        for (Bucket& bucket : days)
+        {
+            if (bucket.source == source && bucket.start == start)
+                return bucket;
+        }
+        return days.emplace_back(Bucket{source, start});
+    }
+    /// @brief Stores the hourly aggregate, or aggregates the hour into its day if it holds too few
+    /// samples.
+    void finishHour(const Bucket& bucket)
+    {
+        if (bucket.count >= minHourlyCount)
+            store(bucket, false);
+        else
+            getDay(bucket.source, bucket.start).add(bucket);
+    }
+    void store(const Bucket& bucket, bool daily)
+    {
+        DataEntry entry{bucket.source, bucket.start, DataEntry::Flags{0, false, true}, {}};
+        // the minimum and maximum are only kept if they are known and fit
+        bool extremes{bucket.values.size() * 3 <= Message<SENSOR_DATA>::maxNValues};
+        for (const Statistics& statistics : bucket.values)
+            extremes = extremes && statistics.minimum <= statistics.maximum;
+        uint8_t tag{static_cast<uint8_t>(daily ? SensorFile::dailyTag : 0)};
+        auto append = [&entry, tag](const Statistics& statistics, Statistic statistic,
+                                    float value) {
+            entry.values[entry.flags.nValues++] = SensorValue{
+                statistics.typeTag,
+                static_cast<uint8_t>(statistics.instanceTag | tag |
+                                     static_cast<uint8_t>(statistic)
+                                         << SensorFile::statisticShift),
+                value};
+        };
+        for (const Statistics& statistics : bucket.values)
+        {
+            float mean{statistics.count > 0 ? statistics.sum / statistics.count
+                                             : (statistics.minimum + statistics.maximum) / 2};
+            if (extremes)
+                append(statistics, Statistic::MINIMUM, statistics.minimum);
+            append(statistics, Statistic::MEAN, mean);
+            if (extremes)
+                append(statistics, Statistic::MAXIMUM, statistics.maximum);
+        }
+        aggregates.push_back(entry);
+    }
+
+public:
+    Compactor(std::vector<DataEntry>& aggregates) : aggregates{aggregates} {}
+
+    void add(const DataEntry& entry)
+    {
+        if (entry.flags.nValues == 0)
+            return;
+        if (SensorFile::getStatistic(entry.values[0]) != Statistic::SAMPLE)
+        {
+            // aggregates are aggregated per day, daily aggregates merging with others of that day
+            getDay(entry.source, entry.time).add(entry);
+            return;
+        }
+        uint32_t start{entry.time - entry.time % hour};
+        auto bucket{std::find_if(hours.begin(), hours.end(), [&entry](const Bucket& bucket) {
+            return bucket.source == entry.source;
+        })};
+        if (bucket == hours.end())
+            bucket = hours.insert(hours.end(), Bucket{entry.source, start});
+        else if (bucket->start != start)
+        {
+            finishHour(*bucket);
+            *bucket = Bucket{entry.source, start};
+        }
+        bucket->add(entry);
+    }
+
+    /// @brief Stores the aggregates of all entries added.
+    void finish()
+    {
+        for (const Bucket& bucket : hours)
+            finishHour(bucket);
+        hours.clear();
+        for (const Bucket& bucket : days)
+        {
+            if (bucket.count >= minDailyCount)
+                store(bucket, true);
+        }
+        days.clear();
+    }
+};
+}
+
+SensorFile::SensorFile()
+    : FIFOFile("data", sectorMagic), exceptions{nvs.getValue<Exceptions>("exceptions", {})}
+{}
+
+size_t SensorFile::cutTail(size_t cutSize)
+{
+    // uploaded entries lie before the cursor, so are reclaimed first
+    bool compact{cutSize > cursor};
+    size_t target{compact ? std::max(cutSize, cursor + compactionSize) : cutSize};
+    Compactor compactor{compacted};
+    size_t removed{0};
+    // the tail must start a chain, as the other records can not be decoded on their own
+    for (Iterator it{begin()};
+         it.address < getSize() && (it.address < target || !getHeader(it.address).flags.key);
+         ++it)
+    {
+        if (!it->flags.uploaded)
+            compactor.add(*it);
+        removed = it.address + it.size;
+    }
+    compactor.finish();
+    cursor = cursor < removed ? 0 : cursor - removed;
+    for (size_t i{0}; i < exceptions->count;)
+    {
+        if ((exceptions->positions[i] + getMaxSize() - getTail()) % getMaxSize() < removed)
+            exceptions->positions[i] = exceptions->positions[--exceptions->count];
+        else
+            i++;
+    }
+    return FIFOFile::cutTail(removed);
+}
+
+fs::FIFOFile::SectorInfo SensorFile::leaveSector(bool pushStarted)
+{
+    TimeRange range{std::numeric_limits<uint32_t>::max(), 0};
+    if (getSize() > 0)
+    {
+        size_t start{getSectorStart(getSize() - 1)};
+        if (start > 0)
+        {
+            if (std::optional<TimeRange> previous{getTimeRange(start - 1)})
+                range.maxTime = previous->maxTime;
+        }
+        std::optional<SectorSummary> summary{getSummary(start)};
+        if (summary || start == 0)
+        {
+            for (Iterator it{summary ? summary->first : 0, this}; it != end(); ++it)
+            {
+                range.minTime = std::min(range.minTime, (*it).time);
+                range.maxTime = std::max(range.maxTime, (*it).time);
+            }
+        }
+    }
+    if (pushStarted)
+    {
+        range.minTime = std::min(range.minTime, pendingTime);
+        range.maxTime = std::max(range.maxTime, pendingTime);
+    }
+    SectorInfo info;
+    std::memcpy(info.data(), &range, sizeof(range));
+    return info;
+}
+
+std::optional<SensorFile::TimeRange> SensorFile::getTimeRange(size_t address) const
+{
+    std::optional<SectorInfo> info{getSectorInfo(address)};
+    if (!info)
+        return std::nullopt;
+    TimeRange range;
+    std::memcpy(&range, info->data(), sizeof(range));
+    if (range.minTime == std::numeric_limits<uint32_t>::max() &&
+        range.maxTime == std::numeric_limits<uint32_t>::max())
+        return std::nullopt;
+    return range;
+}
+
+std::optional<size_t> SensorFile::findException(size_t address) const
+{
+    uint32_t position{toPosition(address)};
+    for (size_t i{0}; i < exceptions->count; i++)
+    {
+        if (exceptions->positions[i] == position)
+            return i;
+    }
+    return std::nullopt;
+}
+
+size_t SensorFile::countExceptions(size_t from, size_t to) const
+{
+    size_t count{0};
+    for (size_t i{0}; i < exceptions->count; i++)
+    {
+        size_t address{(exceptions->positions[i] + getMaxSize() - getTail()) % getMaxSize()};
+        if (address >= from && address < to)
+            count++;
+    }
+    return count;
+}
+
+SensorFile::RecordHeader SensorFile::getHeader(size_t address) const
+{
+    const RecordHeader* header{view<RecordHeader>(address)};
+    if (header == nullptr)
+        return read<RecordHeader>(address);
+    return *header;
+}
+
+size_t SensorFile::findKey(size_t address) const
+{
+    while (address > 0 && !getHeader(address).flags.key)
+    {
+        uint8_t previousSize{read<uint8_t>(address - 1)};
+        if (previousSize == 0 || previousSize > address)
+            break; // corrupted record
+        address -= previousSize;
+    }
+    return address;
+}
+
+size_t SensorFile::decode(size_t address, ChainState& state) const
+{
+    RecordHeader header{getHeader(address)};
+    std::array<uint8_t, maxRecordSize> buffer;
+    const uint8_t* record{view(address, header.size)};
+    if (record == nullptr)
+    {
+        read(address, buffer.data(), header.size);
+        record = buffer.data();
+    }
+    decode(record, address, state);
+    return header.size;
+}
+
+void SensorFile::decode(const uint8_t* record, size_t address, ChainState& state) const
+{
+    RecordHeader header;
+    std::memcpy(&header, record, sizeof(header));
+    const uint8_t* in{record + sizeof(RecordHeader)};
+    DataEntry& entry{state.entry};
+    size_t nValues{header.flags.nValues};
+    if (header.flags.key)
+    {
+        uint32_t time;
+        std::memcpy(&entry.source, in, sizeof(entry.source));
+        in += sizeof(entry.source);
+        std::memcpy(&time, in, sizeof(time));
+        in += sizeof(time);
+        std::memcpy(entry.values.data(), in, nValues * sizeof(SensorValue));
+        entry.time = time;
+        state.timeDelta = 0;
+        state.length = 1;
+    }
+    else
+    {
+        int64_t timeDelta{state.timeDelta + fromZigZag(getVarint(in))};
+        entry.time = static_cast<uint32_t>(entry.time + timeDelta);
+        state.timeDelta = timeDelta;
+        const uint8_t* codes{in};
+        in += (nValues + 1) / 2;
+        for (size_t i{0}; i < nValues; i++)
+        {
+            uint8_t code = (codes[i / 2] >> (4 * (i % 2))) & 0xF;
+            if (code == unchangedCode)
+                continue;
+            size_t trailing{static_cast<size_t>(code >> 2)}, length{(code & 0x3u) + 1};
+            uint32_t xored{0};
+            for (size_t byte{0}; byte < length; byte++)
+                xored |= static_cast<uint32_t>(*in++) << (8 * byte);
+            entry.values[i].value =
+                fromBits(toBits(entry.values[i].value) ^ (xored << (8 * trailing)));
+        }
+        state.length++;
+    }
+    bool aggregate{nValues > 0 && getStatistic(entry.values[0]) != Statistic::SAMPLE};
+    entry.flags = DataEntry::Flags{header.flags.nValues, isUploaded(address), aggregate};
+}
+
+size_t SensorFile::decodeChain(size_t address, ChainState& state) const
+{
+    size_t record{findKey(address)};
+    size_t size{decode(record, state)};
+    while (record + size <= address)
+    {
+        record += size;
+        size = decode(record, state);
+    }
+    return size;
+}
+
+void SensorFile::loadChain()
+{
+    if (chainLoaded)
+        return;
+    chainLoaded = true;
+    if (getSize() == 0)
+        return;
+    ChainState state{};
+    decodeChain(getSize() - read<uint8_t>(getSize() - 1), state);
+    chain = state;
+}
+
+size_t SensorFile::encode(const DataEntry& entry, uint8_t* record)
+{
+    uint8_t nValues{
+        std::min(entry.flags.nValues, static_cast<uint8_t>(Message<SENSOR_DATA>::maxNValues))};
+    bool key{!chain || chain->length >= maxChainLength || chain->entry.source != entry.source ||
+             chain->entry.flags.nValues != nValues};
+    for (size_t i{0}; !key && i < nValues; i++)
+    {
+        key = chain->entry.values[i].typeTag != entry.values[i].typeTag ||
+              chain->entry.values[i].instanceTag != entry.values[i].instanceTag;
+    }
+    uint8_t* out{record + sizeof(RecordHeader)};
+    if (key)
+    {
+        uint32_t time{entry.time};
+        std::memcpy(out, &entry.source, sizeof(entry.source));
+        out += sizeof(entry.source);
+        std::memcpy(out, &time, sizeof(time));
+        out += sizeof(time);
+        std::memcpy(out, entry.values.data(), nValues * sizeof(SensorValue));
+        out += nValues * sizeof(SensorValue);
+        chain = ChainState{entry, 0, 1};
+    }
+    else
+    {
+        int64_t timeDelta{static_cast<int64_t>(entry.time) - chain->entry.time};
+        putVarint(out, toZigZag(timeDelta - chain->timeDelta));
+        uint8_t* codes{out};
+        std::fill(codes, codes + (nValues + 1) / 2, 0);
+        out += (nValues + 1) / 2;
+        for (size_t i{0}; i < nValues; i++)
+        {
+            uint32_t xored{toBits(entry.values[i].value) ^ toBits(chain->entry.values[i].value)};
+            uint8_t code{unchangedCode};
+            if (xored != 0)
+            {
+                size_t trailing = __builtin_ctz(xored) / 8;
+                size_t length = 4 - trailing - __builtin_clz(xored) / 8;
+                code = (trailing << 2) | (length - 1);
+                for (size_t byte{0}; byte < length; byte++)
+                    *out++ = static_cast<uint8_t>(xored >> (8 * (trailing + byte)));
+            }
+            codes[i / 2] |= code << (4 * (i % 2));
+        }
+        chain->entry = entry;
+        chain->timeDelta = timeDelta;
+        chain->length++;
+    }
+    chain->entry.flags.nValues = nValues;
+    uint8_t size = out - record + 1;
+    RecordHeader header{size, RecordHeader::Flags{nValues, key}};
+    std::memcpy(record, &header, sizeof(header));
+    *out = size;
+    return size;
+}
+
+const SensorFile::DataEntry& SensorFile::getEntry(size_t address, DataEntry& buffer) const
+{
+    ChainState state{};
+    decodeChain(address, state);
+    buffer = state.entry;
+    return buffer;
+}
+
+SensorFile::Iterator::Iterator(size_t address, const SensorFile* file, bool unuploadedOnly)
+    : address{file->getSize()}, file{file}, unuploadedOnly{unuploadedOnly}, state{}
+{
+    if (address >= file->getSize())
+        return;
+    // records before the given address are only decoded to restore the state of its chain
+    this->address = file->findKey(address);
+    decode();
+    while (this->address + size <= address)
+        next();
+    if (unuploadedOnly && state.entry.flags.uploaded)
+        ++(*this);
+}
+
+void SensorFile::Iterator::load()
+{
+    RecordHeader header;
+    if (spanSize >= sizeof(RecordHeader))
+    {
+        std::memcpy(&header, (span ? span : buffer.data()) + spanOffset, sizeof(header));
+        if (header.size <= spanSize)
+            return;
+    }
+    auto [data, available] = file->span(address);
+    span = data;
+    spanOffset = 0;
+    spanSize = available;
+    if (span == nullptr)
+    {
+        spanSize = std::min(available, buffer.size());
+        file->read(address, buffer.data(), spanSize);
+    }
+    if (spanSize >= sizeof(RecordHeader))
+    {
+        std::memcpy(&header, (span ? span : buffer.data()), sizeof(header));
+        if (header.size <= spanSize)
+            return;
+    }
+    // the record crosses the end of the span, i.e. a sector boundary: read it as a whole
+    header = file->getHeader(address);
+    span = nullptr;
+    spanSize = header.size;
+    file->read(address, buffer.data(), spanSize);
+}
+
+void SensorFile::Iterator::decode()
+{
+    load();
+    const uint8_t* record{(span ? span : buffer.data()) + spanOffset};
+    RecordHeader header;
+    std::memcpy(&header, record, sizeof(header));
+    if (header.size <= sizeof(RecordHeader))
+    {
+        address = file->getSize(); // corrupted record: the rest of the file can not be walked
+        return;
+    }
+    file->decode(record, address, state);
+    size = header.size;
+    spanOffset += size;
+    spanSize -= size;
+}
+
+void SensorFile::Iterator::next()
+{
+    address += size;
+    if (address < file->getSize())
+        decode();
+}
+
+SensorFile::Iterator& SensorFile::Iterator::operator++()
+{
+    next();
+    while (unuploadedOnly && address < file->getSize() && state.entry.flags.uploaded)
+        next();
+    return *this;
+}
+
+SensorFile::Iterator SensorFile::seek(uint32_t time) const
+{
+    size_t tailOffset{getTail() % sectorDataSize};
+    size_t nSectors{(tailOffset + getSize() + sectorDataSize - 1) / sectorDataSize};
+    auto getStart = [tailOffset](size_t sector) {
+        return sector == 0 ? 0 : sector * sectorDataSize - tailOffset;
+    };
+    // the head sector has no time range yet, so always qualifies
+    size_t low{0}, high{nSectors};
+    while (low < high)
+    {
+        size_t mid{(low + high) / 2};
+        std::optional<TimeRange> range{getTimeRange(getStart(mid))};
+        if (range && range->maxTime < time)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low == 0)
+        return begin();
+    if (low >= nSectors)
+        return end();
+    std::optional<SectorSummary> summary{getSummary(getStart(low))};
+    return summary ? Iterator(summary->first, this) : end();
+}
+
+size_t SensorFile::requeue(uint32_t from, uint32_t to)
+{
+    size_t requeued{0};
+    size_t end{getSize()};
+    Iterator it{seek(from)};
+    while (it.address < end)
+    {
+        DataEntry entry{*it};
+        ++it;
+        if (entry.time < from || entry.time > to || !entry.flags.uploaded)
+            continue;
+        entry.flags.uploaded = false;
+        size_t tail{getTail()};
+        size_t next{it.address};
+        push(entry);
+        requeued++;
+        // pushing may cut entries from the tail, moving the addresses of all other entries
+        size_t cut{(getTail() + getMaxSize() - tail) % getMaxSize()};
+        if (cut > next)
+            break;
+        end -= cut;
+        // the iterator is only valid until the push, so continue with a new one
+        it = Iterator(next - cut, this);
+    }
+    return requeued;
+}
+
+std::optional<size_t> SensorFile::getUnuploadedAddress(size_t index)
+{
+    size_t address{cursor};
+    while (address < getSize())
+    {
+        RecordHeader header{getHeader(address)};
+        if (findException(address))
+        {
+            address += header.size;
+            continue;
+        }
+        if (index == 0)
+            return address;
+        std::optional<SectorSummary> summary{getSummary(address)};
+        if (summary && summary->first == address)
+        {
+            // the first record started in the next sector follows the last one in this sector
+            std::optional<SectorSummary> next{getSummary(summary->end)};
+            size_t skipped{next ? summary->count - countExceptions(address, next->first) : 0};
+            if (next && skipped <= index)
+            {
+                index -= skipped;
+                address = next->first;
+                continue;
+            }
+        }
+        address += header.size;
+        index--;
+    }
+    return std::nullopt;
+}
+
+void SensorFile::push(const Message<SENSOR_DATA>& message)
+{
+    push(DataEntry{message.getSource(), message.time, DataEntry::Flags{message.nValues, false},
+                   message.values});
+}
+
+void SensorFile::push(const DataEntry& entry)
+{
+    loadChain();
+    pendingTime = entry.time;
+    std::array<uint8_t, maxRecordSize> record;
+    FIFOFile::push(record.data(), encode(entry, record.data()));
+    // aggregates compacted while cutting the tail are stored as any other entry
+    while (!compacted.empty())
+    {
+        std::vector<DataEntry> aggregates;
+        aggregates.swap(compacted);
+        for (const DataEntry& aggregate : aggregates)
+        {
+            pendingTime = aggregate.time;
+            FIFOFile::push(record.data(), encode(aggregate, record.data()));
+        }
+    }
+}
+
+void SensorFile::setUploaded(size_t address)
+{
+    if (address < cursor || address >= getSize() || findException(address))
+        return;
+    if (address > cursor)
+    {
+        if (exceptions->count < maxExceptions)
+            exceptions->positions[exceptions->count++] = toPosition(address);
+        return;
+    }
+    // the cursor moves past the entry and any following entries that were uploaded out of order
+    cursor += getHeader(cursor).size;
+    while (std::optional<size_t> exception{findException(cursor)})
+    {
+        exceptions->positions[*exception] = exceptions->positions[--exceptions->count];
+        cursor += getHeader(cursor).size;
+    }
+}
+
+void SensorFile::flush()
+{
+    exceptions.commit();
+    FIFOFile::flush();
+}
@@ -0,0 +1,292 @@
+#ifndef __MIRRA_SENSORFILE_H__
+#define __MIRRA_SENSORFILE_H__
+
+#include "CommunicationCommon.h"
+#include "FS.h"
+#include <optional>
+#include <vector>
+
+namespace mirra
+{
+/// @brief FIFO file storing sensor data entries. The FIFO cursor points to the first entry that
+/// has not been uploaded yet: it is the upload high-watermark, below which all entries have been
+/// uploaded. Entries beyond it that were uploaded out of order are kept in a small exception list.
+/// Stored records are thus never rewritten to mark them as uploaded.
+///
+/// Entries are stored as compressed records, in chains starting with a key record that holds the
+/// entry as is. Every other record of a chain is encoded against the record before it: the
+/// timestamp as a delta-of-delta and every value XORed with the value of the same sensor, so that
+/// neither the source MAC nor the sensor tags are repeated. Decoding an entry thus requires
+/// decoding its chain up to that entry, which is bounded by the maximum length of a chain.
+///
+/// For every sector, the time range of its entries is kept in the header of the next sector. It
+/// serves as a sparse time index, with which the file is searched for entries in a time range.
+///
+/// When the file is full, the tail is cut. Uploaded entries are simply dropped, but entries that
+/// have not been uploaded yet are compacted into hourly, and later daily, aggregates that are
+/// stored anew. Only daily aggregates reaching the tail are dropped for good.
+class SensorFile final : fs::FIFOFile
+{
+public:
+    struct DataEntry
+    {
+        struct Flags
+        {
+            uint8_t nValues : 6;
+            bool uploaded : 1;
+            /// @brief Whether the entry is an hourly or daily aggregate (see Statistic), so that
+            /// the receivers of an uploaded entry need not decode its instance tags to tell.
+            bool aggregate : 1;
+        };
+        static_assert(Message<SENSOR_DATA>::maxNValues < (1 << 6));
+        using SensorValueArray = Message<SENSOR_DATA>::SensorValueArray;
+
+        MACAddress source;
+        uint32_t time;
+        Flags flags;
+        SensorValueArray values;
+
+        static constexpr size_t getSize(Flags flags)
+        {
+            return sizeof(source) + sizeof(time) + sizeof(flags) +
+                   flags.nValues * sizeof(SensorValue);
+        }
+        constexpr size_t getSize() const { return getSize(flags); }
+    } __attribute__((packed));
+
+    /// @brief Statistic held by a value of an aggregated entry. Aggregated entries hold the
+    /// minimum, mean and maximum of every sensor, or only the mean if those do not fit. The
+    /// statistic is kept in the upper bits of the instance tag, which sensors do not use.
+    enum class Statistic : uint8_t
+    {
+        SAMPLE,
+        MINIMUM,
+        MEAN,
+        MAXIMUM
+    };
+    static constexpr uint8_t statisticShift = 6;
+    /// @brief Set in the instance tags of an entry aggregated over a day rather than an hour.
+    static constexpr uint8_t dailyTag = 1 << 5;
+    /// @brief Bits of the instance tag that hold the sensor's instance.
+    static constexpr uint8_t instanceMask = dailyTag - 1;
+    static constexpr Statistic getStatistic(const SensorValue& value)
+    {
+        return static_cast<Statistic>(value.instanceTag >> statisticShift);
+    }
+
+private:
+    /// @brief Identifies sectors formatted as sensor data sectors, versioning the record format.
+    static constexpr uint32_t sectorMagic = 0x3546534D; // "MSF5"
+    /// @brief Maximum amount of records in a chain, bounding the cost of decoding a single entry.
+    static constexpr size_t maxChainLength = 16;
+    /// @brief Maximum size of an encoded record in bytes.
+    static constexpr size_t maxRecordSize = 256;
+    /// @brief Maximum amount of entries uploaded out of order that are remembered.
+    static constexpr size_t maxExceptions = 16;
+    /// @brief Minimum amount of unuploaded data compacted at once. The larger, the more entries
+    /// end up in the same aggregate.
+    static constexpr size_t compactionSize = 16 * sectorDataSize;
+
+    /// @brief Header of a record, followed by its encoded entry and trailed by the size of the
+    /// record, so that the file can be walked in both directions.
+    struct RecordHeader
+    {
+        struct Flags
+        {
+            uint8_t nValues : 7;
+            /// @brief Whether the record starts a chain, holding the entry as is.
+            bool key : 1;
+        };
+        /// @brief Size of the record in bytes, header and trailer included.
+        uint8_t size;
+        Flags flags;
+    } __attribute__((packed));
+    static_assert(Message<SENSOR_DATA>::maxNValues < (1 << 7));
+
+    /// @brief State of a chain after decoding one of its records, against which the next record
+    /// of the chain is decoded.
+    struct ChainState
+    {
+        DataEntry entry;
+        /// @brief Difference between the timestamps of the entry and the entry before it.
+        int64_t timeDelta;
+        /// @brief Amount of records in the chain up to and including the entry.
+        size_t length;
+    };
+
+    /// @brief State of the chain ending at the head, std::nullopt if the next record must start a
+    /// new chain.
+    std::optional<ChainState> chain;
+    /// @brief Whether the chain ending at the head was loaded from the file.
+    bool chainLoaded{false};
+
+    /// @brief Entries beyond the cursor that were uploaded out of order.
+    struct Exceptions
+    {
+        uint32_t count;
+        /// @brief Positions of the entries in the file data, which unlike their addresses do not
+        /// change when the tail is cut.
+        std::array<uint32_t, maxExceptions> positions;
+    };
+    fs::NVS::Value<Exceptions> exceptions;
+
+    /// @return The position in the file data of the given address.
+    uint32_t toPosition(size_t address) const { return (getTail() + address) % getMaxSize(); }
+    /// @return The index of the given address in the exception list, std::nullopt if it is not in
+    /// there.
+    std::optional<size_t> findException(size_t address) const;
+    /// @return The amount of exceptions between the given addresses.
+    size_t countExceptions(size_t from, size_t to) const;
+    bool isUploaded(size_t address) const { return address < cursor || findException(address); }
+
+    /// @brief Time range of the entries started in a sector, kept as its sector info.
+    struct TimeRange
+    {
+        /// @brief Minimum time of the entries in the sector.
+        uint32_t minTime;
+        /// @brief Maximum time of the entries in the sector and all sectors before it, which never
+        /// decreases from one sector to the next, so that sectors can be binary searched by it.
+        uint32_t maxTime;
+    };
+    static_assert(sizeof(TimeRange) == sizeof(SectorInfo));
+    /// @brief Time of the entry being pushed.
+    uint32_t pendingTime{0};
+
+    /// @brief Aggregates compacted from the tail, to be stored once the push that cut the tail
+    /// is done.
+    std::vector<DataEntry> compacted;
+
+    /// @brief Cuts uploaded entries from the tail. If that does not free up enough space, at least
+    /// compactionSize of unuploaded entries is cut along and compacted.
+    size_t cutTail(size_t cutSize);
+    SectorInfo leaveSector(bool pushStarted);
+    /// @return The time range of the sector holding the given address, std::nullopt for the head
+    /// sector.
+    std::optional<TimeRange> getTimeRange(size_t address) const;
+
+    /// @return The header of the record at the given address.
+    RecordHeader getHeader(size_t address) const;
+    /// @return The address of the key record of the chain holding the record at the given address.
+    size_t findKey(size_t address) const;
+    /// @brief Decodes a record, encoded against the given state, into that same state. For key
+    /// records, the state is discarded.
+    /// @param record The encoded record, header included.
+    /// @param address Address of the record.
+    void decode(const uint8_t* record, size_t address, ChainState& state) const;
+    /// @brief Decodes the record at the given address, encoded against the given state, into that
+    /// same state. For key records, the state is discarded.
+    /// @return The size of the decoded record.
+    size_t decode(size_t address, ChainState& state) const;
+    /// @brief Decodes the chain holding the record at the given address up to that record.
+    /// @return The size of the record at the given address.
+    size_t decodeChain(size_t address, ChainState& state) const;
+    /// @brief Loads the state of the chain ending at the head, on the first push since opening.
+    void loadChain();
+    /// @brief Encodes the entry as the next record, continuing the chain ending at the head if
+    /// possible.
+    /// @return The size of the encoded record.
+    size_t encode(const DataEntry& entry, uint8_t* record);
+
+public:
+    SensorFile();
+
+    using FIFOFile::getHead;
+    using FIFOFile::getMaxSize;
+    using FIFOFile::getName;
+    using FIFOFile::getRemainingLifetime;
+    using FIFOFile::getSectorCount;
+    using FIFOFile::getSize;
+    using FIFOFile::getStats;
+    using FIFOFile::getTail;
+    using FIFOFile::getWear;
+
+    using FIFOFile::read;
+
+    /// @brief Decodes the entry of the record at the given address.
+    /// @param buffer Buffer the entry is decoded into.
+    /// @return The decoded entry, i.e. the buffer.
+    const DataEntry& getEntry(size_t address, DataEntry& buffer) const;
+
+    /// @brief Streaming cursor over the entries of the file. Records are decoded in one pass
+    /// straight from spans of contiguously stored file data, one span per sector, instead of being
+    /// read one by one. Only records crossing a sector boundary, or all records if the partition
+    /// can not be mapped, are read into a read-ahead buffer. Like views, an iterator is only valid
+    /// until the next push to the file.
+    class Iterator
+    {
+        /// @brief Amount of file data read ahead at once when it can not be viewed.
+        static constexpr size_t readAheadSize = 512;
+        static_assert(readAheadSize >= maxRecordSize);
+
+        size_t address;
+        const SensorFile* file;
+        /// @brief Whether entries that have been uploaded already are skipped.
+        bool unuploadedOnly;
+        /// @brief State of the chain up to and including the record at the address.
+        ChainState state;
+        /// @brief Size of the record at the address.
+        size_t size{0};
+        /// @brief Viewed span of file data holding the record at the address, nullptr if the
+        /// span was read into the buffer instead.
+        const uint8_t* span{nullptr};
+        /// @brief Offset of the record at the address in the span.
+        size_t spanOffset{0};
+        /// @brief Amount of bytes in the span from the record at the address onwards.
+        size_t spanSize{0};
+        std::array<uint8_t, readAheadSize> buffer;
+
+        Iterator(size_t address, const SensorFile* file, bool unuploadedOnly = false);
+        /// @brief Makes sure the record at the address is held in the span, moving on to the next
+        /// span if needed.
+        void load();
+        /// @brief Decodes the record at the address, moving past it in the span.
+        void decode();
+        /// @brief Moves on to the next record, without skipping uploaded entries.
+        void next();
+
+    public:
+        Iterator& operator++();
+        bool operator==(const Iterator& other) const { return this->address == other.address; }
+        bool operator!=(const Iterator& other) const { return this->address != other.address; }
+        const DataEntry& operator*() const { return state.entry; }
+        const DataEntry* operator->() const { return &state.entry; }
+        /// @return The address of the record of the current entry.
+        size_t getAddress() const { return address; }
+
+        friend class SensorFile;
+    };
+
+    Iterator begin() const { return Iterator(0, this); };
+    Iterator end() const { return Iterator(getSize(), this); };
+    /// @return Iterator over the entries that have not been uploaded yet, in the order in which
+    /// they are to be uploaded.
+    Iterator unuploaded() const { return Iterator(cursor, this, true); }
+    /// @brief Seeks the first sector that may hold entries at or after the given time.
+    /// @return Iterator at the first entry of that sector. Entries before it are all older.
+    Iterator seek(uint32_t time) const;
+    /// @brief Finds an entry that has not been uploaded yet. Entries are uploaded in order, so the
+    /// entries following the first unuploaded one are skipped per sector rather than walked.
+    /// @param index Index of the entry among the unuploaded entries.
+    /// @return Address of the entry, std::nullopt if there are not that many unuploaded entries.
+    std::optional<size_t> getUnuploadedAddress(size_t index);
+
+    void push(const Message<SENSOR_DATA>& message);
+    void push(const DataEntry& entry);
+    /// @brief Marks the first unuploaded entry as uploaded, advancing the cursor.
+    void setUploaded() { setUploaded(cursor); }
+    /// @brief Marks the entry at the given address as uploaded. Beyond the cursor, the entry is
+    /// added to the exception list. If that list is full, the entry is left unuploaded and thus
+    /// uploaded again later.
+    void setUploaded(size_t address);
+
+    /// @brief Pushes the uploaded entries in the given time range anew, so that they are uploaded
+    /// again.
+    /// @return The amount of entries requeued.
+    size_t requeue(uint32_t from, uint32_t to);
+
+    /// @brief Writes all file data to flash and stores the FIFO state and exception list.
+    void flush();
+};
+}
+
+#endif
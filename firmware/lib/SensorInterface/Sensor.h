@@ -15,7 +15,7 @@ struct SensorValue
     /// @param typeTag Type ID of the sensor.
     /// @param instanceTag Instance ID of the sensor.
     /// @param value Concrete value.
-    SensorValue(uint8_t typeTag, u_int8_t instanceTag, float value)
+    SensorValue(uint8_t typeTag, uint8_t instanceTag, float value)
         : typeTag{typeTag}, instanceTag{instanceTag}, value{value} {};
 } __attribute__((packed));
 
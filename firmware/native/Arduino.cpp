@@ -0,0 +1,17 @@
+#include <Arduino.h>
+#include <chrono>
+
+HardwareSerial Serial;
+
+int64_t esp_timer_get_time()
+{
+    static const auto start{std::chrono::steady_clock::now()};
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                 start)
+        .count();
+}
+
+int digitalRead(uint8_t)
+{
+    return 0;
+}
@@ -0,0 +1,207 @@
+#include "NativeFlash.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <esp_partition.h>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace mirra::native;
+
+namespace
+{
+/// @brief Data partitions as laid out in partitions.csv.
+struct PartitionTableEntry
+{
+    const char* label;
+    size_t size;
+};
+constexpr PartitionTableEntry partitionTable[]{
+    {"logs", 1280 * 1024},
+    {"data", 1280 * 1024},
+};
+
+struct NativePartition
+{
+    esp_partition_t partition;
+    /// @brief Contents of the partition, mapped from its backing file.
+    uint8_t* contents;
+    std::vector<SectorCounters> counters;
+};
+
+std::string flashDirectory{"."};
+std::vector<std::unique_ptr<NativePartition>> partitions;
+
+NativePartition* openPartition(const PartitionTableEntry& entry)
+{
+    std::string path{flashDirectory + "/" + entry.label + ".bin"};
+    int fd{open(path.c_str(), O_RDWR | O_CREAT, 0644)};
+    if (fd < 0)
+    {
+        printf("Error while opening partition file '%s': %s\n", path.c_str(), strerror(errno));
+        return nullptr;
+    }
+    off_t fileSize{lseek(fd, 0, SEEK_END)};
+    bool fresh{static_cast<size_t>(fileSize) != entry.size};
+    if (fresh && ftruncate(fd, entry.size) != 0)
+    {
+        printf("Error while resizing partition file '%s': %s\n", path.c_str(), strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+    void* contents{mmap(nullptr, entry.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)};
+    close(fd);
+    if (contents == MAP_FAILED)
+    {
+        printf("Error while mapping partition file '%s': %s\n", path.c_str(), strerror(errno));
+        return nullptr;
+    }
+    auto native{std::make_unique<NativePartition>()};
+    native->partition.type = ESP_PARTITION_TYPE_DATA;
+    native->partition.subtype = ESP_PARTITION_SUBTYPE_DATA_UNDEFINED;
+    native->partition.address = 0;
+    native->partition.size = entry.size;
+    std::strncpy(native->partition.label, entry.label, sizeof(native->partition.label) - 1);
+    native->partition.encrypted = false;
+    native->contents = static_cast<uint8_t*>(contents);
+    native->counters.resize(entry.size / sectorSize);
+    // a newly created file is in the erased state, like new flash
+    if (fresh)
+        std::memset(native->contents, 0xFF, entry.size);
+    partitions.push_back(std::move(native));
+    return partitions.back().get();
+}
+
+NativePartition* findPartition(const char* label)
+{
+    for (auto& native : partitions)
+    {
+        if (std::strcmp(native->partition.label, label) == 0)
+            return native.get();
+    }
+    for (const PartitionTableEntry& entry : partitionTable)
+    {
+        if (std::strcmp(entry.label, label) == 0)
+            return openPartition(entry);
+    }
+    return nullptr;
+}
+
+NativePartition& getPartition(const esp_partition_t* partition)
+{
+    for (auto& native : partitions)
+    {
+        if (&native->partition == partition)
+            return *native;
+    }
+    std::abort();
+}
+
+bool isInBounds(const esp_partition_t* partition, size_t offset, size_t size)
+{
+    return offset <= partition->size && size <= partition->size - offset;
+}
+
+/// @brief Calls the given function for every sector in the given range, with the amount of bytes
+/// of the range in that sector.
+template <class F> void forEachSector(size_t offset, size_t size, F&& f)
+{
+    while (size > 0)
+    {
+        size_t inSector{std::min(sectorSize - offset % sectorSize, size)};
+        f(offset / sectorSize, inSector);
+        offset += inSector;
+        size -= inSector;
+    }
+}
+}
+
+void mirra::native::setFlashDirectory(const char* path)
+{
+    flashDirectory = path;
+}
+
+const std::vector<SectorCounters>& mirra::native::getSectorCounters(const char* label)
+{
+    static const std::vector<SectorCounters> none;
+    NativePartition* native{findPartition(label)};
+    return native ? native->counters : none;
+}
+
+void mirra::native::resetPartition(const char* label)
+{
+    NativePartition* native{findPartition(label)};
+    if (native == nullptr)
+        return;
+    std::memset(native->contents, 0xFF, native->partition.size);
+    std::fill(native->counters.begin(), native->counters.end(), SectorCounters{});
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype, const char* label)
+{
+    if (type != ESP_PARTITION_TYPE_DATA || subtype != ESP_PARTITION_SUBTYPE_DATA_UNDEFINED)
+        return nullptr;
+    NativePartition* native{findPartition(label)};
+    return native ? &native->partition : nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst,
+                             size_t size)
+{
+    if (!isInBounds(partition, src_offset, size))
+        return ESP_ERR_INVALID_SIZE;
+    NativePartition& native{getPartition(partition)};
+    std::memcpy(dst, &native.contents[src_offset], size);
+    forEachSector(src_offset, size, [&native](size_t sector, size_t inSector) {
+        native.counters[sector].bytesRead += inSector;
+    });
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset,
+                              const void* src, size_t size)
+{
+    if (!isInBounds(partition, dst_offset, size))
+        return ESP_ERR_INVALID_SIZE;
+    NativePartition& native{getPartition(partition)};
+    const uint8_t* source{static_cast<const uint8_t*>(src)};
+    // programming can only clear bits
+    for (size_t i{0}; i < size; i++)
+        native.contents[dst_offset + i] &= source[i];
+    forEachSector(dst_offset, size, [&native](size_t sector, size_t inSector) {
+        native.counters[sector].bytesProgrammed += inSector;
+    });
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size)
+{
+    if (offset % sectorSize != 0 || size % sectorSize != 0)
+        return ESP_ERR_INVALID_ARG;
+    if (!isInBounds(partition, offset, size))
+        return ESP_ERR_INVALID_SIZE;
+    NativePartition& native{getPartition(partition)};
+    std::memset(&native.contents[offset], 0xFF, size);
+    for (size_t sector{offset / sectorSize}; sector < (offset + size) / sectorSize; sector++)
+        native.counters[sector].erases++;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t* partition, size_t offset, size_t size,
+                             spi_flash_mmap_memory_t memory, const void** out_ptr,
+                             spi_flash_mmap_handle_t* out_handle)
+{
+    if (!isInBounds(partition, offset, size))
+        return ESP_ERR_INVALID_ARG;
+    *out_ptr = &getPartition(partition).contents[offset];
+    *out_handle = 0;
+    return ESP_OK;
+}
+
+void spi_flash_munmap(spi_flash_mmap_handle_t handle) {}
@@ -0,0 +1,39 @@
+#ifndef __NATIVE_FLASH_H__
+#define __NATIVE_FLASH_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// @brief Host-native flash backend. Every partition of partitions.csv used by MIRRAFS is backed by
+/// a file "<label>.bin" in the flash directory, which behaves like NOR flash: programming only
+/// clears bits, and only an erase sets them again.
+namespace mirra::native
+{
+/// @brief Flash operations performed on a single sector of a partition.
+struct SectorCounters
+{
+    /// @brief Amount of times the sector was erased.
+    size_t erases{0};
+    /// @brief Amount of bytes programmed into the sector.
+    size_t bytesProgrammed{0};
+    /// @brief Amount of bytes read from the sector through esp_partition_read. Reads through a
+    /// memory mapping of the partition are not counted.
+    size_t bytesRead{0};
+};
+
+/// @brief Size of a flash sector, the smallest erasable unit.
+static constexpr size_t sectorSize = 4096;
+
+/// @brief Sets the directory in which the partition files are stored, "." by default. Only
+/// partitions opened afterwards are affected.
+void setFlashDirectory(const char* path);
+/// @return The operation counters of every sector in the partition with the given label.
+const std::vector<SectorCounters>& getSectorCounters(const char* label);
+/// @brief Erases the entire partition with the given label and resets its counters.
+void resetPartition(const char* label);
+/// @return The amount of values written to or erased from NVS since it was last erased entirely.
+size_t getNVSWrites();
+}
+
+#endif
@@ -0,0 +1,209 @@
+#include "NativeFlash.h"
+#include <cstring>
+#include <map>
+#include <nvs_flash.h>
+#include <string>
+#include <vector>
+
+// Host-native NVS, backed by an in-memory map. Contents are lost when the program exits.
+
+namespace
+{
+struct Entry
+{
+    nvs_type_t type;
+    std::vector<uint8_t> data;
+};
+using Namespace = std::map<std::string, Entry>;
+
+std::map<std::string, Namespace> namespaces;
+/// @brief Namespace names of all opened handles, indexed by handle.
+std::vector<std::string> handles;
+size_t writes{0};
+
+Namespace* getNamespace(nvs_handle_t handle)
+{
+    if (handle >= handles.size())
+        return nullptr;
+    return &namespaces[handles[handle]];
+}
+
+esp_err_t get(nvs_handle_t handle, const char* key, nvs_type_t type, void* out_value,
+              size_t* length)
+{
+    Namespace* ns{getNamespace(handle)};
+    if (ns == nullptr)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    auto it{ns->find(key)};
+    if (it == ns->end() || it->second.type != type)
+        return ESP_ERR_NVS_NOT_FOUND;
+    const std::vector<uint8_t>& data{it->second.data};
+    if (out_value == nullptr)
+    {
+        *length = data.size();
+        return ESP_OK;
+    }
+    if (*length < data.size())
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    std::memcpy(out_value, data.data(), data.size());
+    *length = data.size();
+    return ESP_OK;
+}
+
+esp_err_t set(nvs_handle_t handle, const char* key, nvs_type_t type, const void* value,
+              size_t length)
+{
+    Namespace* ns{getNamespace(handle)};
+    if (ns == nullptr)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    const uint8_t* bytes{static_cast<const uint8_t*>(value)};
+    (*ns)[key] = Entry{type, std::vector<uint8_t>(bytes, bytes + length)};
+    writes++;
+    return ESP_OK;
+}
+
+template <class T> esp_err_t getIntegral(nvs_handle_t handle, const char* key, nvs_type_t type,
+                                         T* out_value)
+{
+    size_t length{sizeof(T)};
+    return get(handle, key, type, out_value, &length);
+}
+}
+
+struct nvs_opaque_iterator_t
+{
+    Namespace::const_iterator it;
+    Namespace::const_iterator end;
+    std::string namespaceName;
+    nvs_type_t type;
+
+    /// @brief Advances the iterator to the first entry matching its type.
+    /// @return Whether such an entry was found.
+    bool skipToMatch()
+    {
+        while (it != end && type != NVS_TYPE_ANY && it->second.type != type)
+            ++it;
+        return it != end;
+    }
+};
+
+esp_err_t nvs_flash_init()
+{
+    return ESP_OK;
+}
+
+size_t mirra::native::getNVSWrites()
+{
+    return writes;
+}
+
+esp_err_t nvs_flash_erase()
+{
+    namespaces.clear();
+    writes = 0;
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle)
+{
+    handles.emplace_back(name);
+    *out_handle = handles.size() - 1;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return getNamespace(handle) ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+}
+
+#define NVS_NATIVE_INTEGRAL(SUFFIX, TYPE, NVS_TYPE)                                                \
+    esp_err_t nvs_get_##SUFFIX(nvs_handle_t handle, const char* key, TYPE* out_value)              \
+    {                                                                                              \
+        return getIntegral(handle, key, NVS_TYPE, out_value);                                      \
+    }                                                                                              \
+    esp_err_t nvs_set_##SUFFIX(nvs_handle_t handle, const char* key, TYPE value)                   \
+    {                                                                                              \
+        return set(handle, key, NVS_TYPE, &value, sizeof(value));                                  \
+    }
+
+NVS_NATIVE_INTEGRAL(u8, uint8_t, NVS_TYPE_U8)
+NVS_NATIVE_INTEGRAL(i8, int8_t, NVS_TYPE_I8)
+NVS_NATIVE_INTEGRAL(u16, uint16_t, NVS_TYPE_U16)
+NVS_NATIVE_INTEGRAL(i16, int16_t, NVS_TYPE_I16)
+NVS_NATIVE_INTEGRAL(u32, uint32_t, NVS_TYPE_U32)
+NVS_NATIVE_INTEGRAL(i32, int32_t, NVS_TYPE_I32)
+NVS_NATIVE_INTEGRAL(u64, uint64_t, NVS_TYPE_U64)
+NVS_NATIVE_INTEGRAL(i64, int64_t, NVS_TYPE_I64)
+
+#undef NVS_NATIVE_INTEGRAL
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* out_value, size_t* length)
+{
+    return get(handle, key, NVS_TYPE_STR, out_value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length)
+{
+    return get(handle, key, NVS_TYPE_BLOB, out_value, length);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value)
+{
+    return set(handle, key, NVS_TYPE_STR, value, std::strlen(value) + 1);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length)
+{
+    return set(handle, key, NVS_TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key)
+{
+    Namespace* ns{getNamespace(handle)};
+    if (ns == nullptr)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    if (ns->erase(key) == 0)
+        return ESP_ERR_NVS_NOT_FOUND;
+    writes++;
+    return ESP_OK;
+}
+
+nvs_iterator_t nvs_entry_find(const char* part_name, const char* namespace_name, nvs_type_t type)
+{
+    const Namespace& ns{namespaces[namespace_name]};
+    nvs_iterator_t iterator{new nvs_opaque_iterator_t{ns.begin(), ns.end(), namespace_name, type}};
+    if (!iterator->skipToMatch())
+    {
+        delete iterator;
+        return nullptr;
+    }
+    return iterator;
+}
+
+nvs_iterator_t nvs_entry_next(nvs_iterator_t iterator)
+{
+    ++iterator->it;
+    if (!iterator->skipToMatch())
+    {
+        delete iterator;
+        return nullptr;
+    }
+    return iterator;
+}
+
+void nvs_entry_info(nvs_iterator_t iterator, nvs_entry_info_t* out_info)
+{
+    std::strncpy(out_info->namespace_name, iterator->namespaceName.c_str(),
+                 sizeof(out_info->namespace_name) - 1);
+    out_info->namespace_name[sizeof(out_info->namespace_name) - 1] = '\0';
+    std::strncpy(out_info->key, iterator->it->first.c_str(), sizeof(out_info->key) - 1);
+    out_info->key[sizeof(out_info->key) - 1] = '\0';
+    out_info->type = iterator->it->second.type;
+}
+
+void nvs_release_iterator(nvs_iterator_t iterator)
+{
+    delete iterator;
+}
@@ -0,0 +1,12 @@
+#include <cstring>
+#include <esp_ota_ops.h>
+
+int esp_ota_get_app_elf_sha256(char* dst, size_t size)
+{
+    static constexpr const char* sha256{"4d495252"};
+    if (size == 0)
+        return 0;
+    std::strncpy(dst, sha256, size - 1);
+    dst[size - 1] = '\0';
+    return static_cast<int>(std::strlen(dst));
+}
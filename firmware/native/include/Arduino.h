@@ -0,0 +1,17 @@
+#ifndef __NATIVE_ARDUINO_H__
+#define __NATIVE_ARDUINO_H__
+
+// Host-native subset of Arduino.h, sufficient for the command parser.
+
+#include "HardwareSerial.h"
+#include <cstdint>
+#include <cstring>
+
+extern HardwareSerial Serial;
+
+/// @brief Time in microseconds since the host-native program started.
+int64_t esp_timer_get_time();
+/// @brief Host-native pins are not connected and always read low.
+int digitalRead(uint8_t pin);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef __NATIVE_HARDWARE_SERIAL_H__
+#define __NATIVE_HARDWARE_SERIAL_H__
+
+// Host-native subset of Arduino's HardwareSerial.h, sufficient for the logging module and the
+// command parser. Output is written to stdout, there is never any input.
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+class HardwareSerial
+{
+public:
+    virtual ~HardwareSerial() = default;
+    virtual size_t write(const uint8_t* buffer, size_t size)
+    {
+        return std::fwrite(buffer, 1, size, stdout);
+    }
+    size_t write(const char* buffer, size_t size)
+    {
+        return write(reinterpret_cast<const uint8_t*>(buffer), size);
+    }
+    size_t print(const char* string) { return write(string, std::strlen(string)); }
+    size_t print(char c) { return write(&c, 1); }
+    size_t print(int n) { return printf("%d", n); }
+    size_t println(const char* string) { return print(string) + print('\n'); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        int length{std::vsnprintf(buffer, sizeof(buffer), format, args)};
+        va_end(args);
+        if (length < 0)
+            return 0;
+        return write(buffer, std::min<size_t>(length, sizeof(buffer) - 1));
+    }
+    int available() { return 0; }
+    int read() { return -1; }
+};
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef __NATIVE_ESP_ATTR_H__
+#define __NATIVE_ESP_ATTR_H__
+
+// Host-native subset of ESP-IDF's esp_attr.h. There is no RTC memory on the host: data placed in
+// it is kept in regular memory.
+
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+
+#endif
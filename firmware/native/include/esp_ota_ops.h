@@ -0,0 +1,13 @@
+#ifndef __NATIVE_ESP_OTA_OPS_H__
+#define __NATIVE_ESP_OTA_OPS_H__
+
+// Host-native subset of ESP-IDF's esp_ota_ops.h, sufficient for the logging module.
+
+#include "esp_err.h"
+#include <cstddef>
+
+/// @brief Fills the given buffer with the hexadecimal SHA-256 of the running image, cut short to
+/// the size of the buffer. The host-native image has a fixed hash.
+int esp_ota_get_app_elf_sha256(char* dst, size_t size);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef __NATIVE_NVS_FLASH_H__
+#define __NATIVE_NVS_FLASH_H__
+
+// Host-native subset of ESP-IDF's nvs_flash.h, sufficient for MIRRAFS.
+
+#include "nvs.h"
+
+esp_err_t nvs_flash_init();
+esp_err_t nvs_flash_erase();
+
+#endif
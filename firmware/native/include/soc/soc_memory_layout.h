@@ -0,0 +1,9 @@
+#ifndef __NATIVE_SOC_MEMORY_LAYOUT_H__
+#define __NATIVE_SOC_MEMORY_LAYOUT_H__
+
+// Host-native subset of ESP-IDF's soc/soc_memory_layout.h. There is no flash mapped to the data
+// bus on the host: no string is a literal in flash.
+
+inline bool esp_ptr_in_drom(const void*) { return false; }
+
+#endif
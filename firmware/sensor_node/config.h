@@ -22,11 +22,28 @@
 
 #define DISCOVERY_TIMEOUT (5 * 60 * 1000) // ms, time to wait for a discovery message from gateway
 
-#define TIME_CONFIG_TIMEOUT 6000 // ms
+#define COMM_PERIOD_PADDING                                                                        \
+    3 // s, clock difference to the gateway tolerated at the start of a comm period
+
+// Timeouts are derived from the time on air of the messages at the given spreading factor, see
+// LoRaModule::getAnswerTime.
+#define TIME_CONFIG_TIMEOUT(SF)                                                                    \
+    ((TIME_CONFIG_ATTEMPTS + 1) *                                                                  \
+     (SENSOR_DATA_FRAME_TIMEOUT(SF) +                                                              \
+      LoRaModule::getAnswerTime(sizeof(Message<TIME_CONFIG>), SF))) // ms
 #define TIME_CONFIG_ATTEMPTS 1
 
-#define SENSOR_DATA_TIMEOUT 6000 // ms
+#define SENSOR_DATA_TIMEOUT(SF)                                                                    \
+    (SENSOR_DATA_FRAME_TIMEOUT(SF) +                                                               \
+     LoRaModule::getAnswerTime(sizeof(Message<ACK_DATA>), SF)) // ms
 #define SENSOR_DATA_ATTEMPTS 1
+#define SENSOR_DATA_WINDOW                                                                         \
+    4 // amount of sensor data messages sent back to back before awaiting an acknowledgement
+#define SENSOR_DATA_BURST_DELAY                                                                    \
+    50 // ms, time between the messages of a window, for the gateway to resume listening
+#define SENSOR_DATA_FRAME_TIMEOUT(SF)                                                              \
+    LoRaModule::getAnswerTime(MessageHeader::maxLength, SF,                                        \
+                              SENSOR_DATA_BURST_DELAY) // ms, as on the gateway
 
 #define MAX_SENSORS 20
 
@@ -6,6 +6,7 @@
 #include <RandomSensor.h>
 #include <SoilTempSensor.h>
 #include <TempHumiSensor.h>
+#include <bitset>
 
 using namespace mirra;
 
@@ -20,6 +21,9 @@ RTC_DATA_ATTR uint32_t commInterval;
 RTC_DATA_ATTR uint32_t nextCommTime = -1;
 RTC_DATA_ATTR uint32_t maxMessages;
 RTC_DATA_ATTR MACAddress gatewayMAC;
+// link assigned by the gateway for the next comm period, zero for the defaults
+RTC_DATA_ATTR uint8_t linkSpreadingFactor{0};
+RTC_DATA_ATTR int8_t linkPower{0};
 
 SensorNode::SensorNode(const MIRRAPins& pins) : MIRRAModule(pins)
 {
@@ -34,7 +38,7 @@ SensorNode::SensorNode(const MIRRAPins& pins) : MIRRAModule(pins)
 
 void SensorNode::wake()
 {
-    Log::debug("Running wake()...");
+    LOG_DEBUG(SENSORS, "Running wake()...");
     uint32_t cTime{rtc.getSysTime()};
     if (cTime >= WAKE_COMM_PERIOD(nextCommTime))
         commPeriod();
@@ -44,34 +48,35 @@ void SensorNode::wake()
         samplePeriod();
     }
     cTime = rtc.getSysTime();
-    Log::info("Next sample in ", nextSampleTime - cTime, "s, next comm period in ",
-              nextCommTime - cTime, "s");
+    LOG_INFO(SENSORS, "Next sample in ", nextSampleTime - cTime, "s, next comm period in ",
+             nextCommTime - cTime, "s");
     Serial.printf("Welcome! This is Sensor Node %s\n", lora.getMACAddress().toString());
     commandEntry.prompt(Commands(this));
     cTime = rtc.getSysTime();
     if (cTime >= nextCommTime || cTime >= nextSampleTime)
         wake();
-    Log::debug("Entering deep sleep...");
+    LOG_DEBUG(SENSORS, "Entering deep sleep...");
     deepSleepUntil(std::min(WAKE_COMM_PERIOD(nextCommTime), nextSampleTime));
 }
 
 void SensorNode::discovery()
 {
-    Log::info("Sending hello message...");
+    LOG_INFO(SENSORS, "Sending hello message...");
     lora.sendMessage(Message<HELLO>(lora.getMACAddress(), MACAddress::broadcast));
-    Log::debug("Awaiting time config message...");
-    auto timeConfig{lora.receiveMessage<TIME_CONFIG>(TIME_CONFIG_TIMEOUT, TIME_CONFIG_ATTEMPTS,
-                                                     MACAddress::broadcast)};
+    LOG_DEBUG(SENSORS, "Awaiting time config message...");
+    auto timeConfig{lora.receiveMessage<TIME_CONFIG>(TIME_CONFIG_TIMEOUT(lora.getSpreadingFactor()),
+                                                     TIME_CONFIG_ATTEMPTS, MACAddress::broadcast)};
     const MACAddress& gatewayMAC{timeConfig->getSource()};
     if (!timeConfig)
     {
-        Log::error("Error while awaiting time config message from gateway. Aborting discovery.");
+        LOG_ERROR(SENSORS,
+                  "Error while awaiting time config message from gateway. Aborting discovery.");
         return;
     }
     this->timeConfig(*timeConfig);
-    Log::debug("Time config message received. Sending TIME_ACK");
+    LOG_DEBUG(SENSORS, "Time config message received. Sending TIME_ACK");
     lora.sendMessage(Message<ACK_TIME>(lora.getMACAddress(), gatewayMAC));
-    lora.receiveMessage<REPEAT>(TIME_CONFIG_TIMEOUT, 0, gatewayMAC);
+    lora.receiveMessage<REPEAT>(TIME_CONFIG_TIMEOUT(lora.getSpreadingFactor()), 0, gatewayMAC);
 }
 
 void SensorNode::timeConfig(Message<TIME_CONFIG>& m)
@@ -88,14 +93,17 @@ void SensorNode::timeConfig(Message<TIME_CONFIG>& m)
     nextCommTime = m.getCommTime();
     maxMessages = m.getMaxMessages();
     gatewayMAC = m.getSource();
+    linkSpreadingFactor = m.getSpreadingFactor();
+    linkPower = m.getPower();
     if (!scheduleValid)
     {
         sensorsNextSampleTimes.fill(0);
         initSensors();
         clearSensors();
     }
-    Log::info("Sample interval: ", sampleInterval, ", Comm interval: ", commInterval,
-              ", Max messages: ", maxMessages, ", Gateway MAC: ", gatewayMAC.toString());
+    LOG_INFO(SENSORS, "Sample interval: ", sampleInterval, ", Comm interval: ", commInterval,
+             ", Max messages: ", maxMessages, ", Gateway MAC: ", gatewayMAC.toString(),
+             ", SF: ", linkSpreadingFactor, ", Power: ", linkPower);
 }
 
 void SensorNode::addSensor(std::unique_ptr<Sensor>&& sensor)
@@ -144,7 +152,7 @@ void SensorNode::clearSensors()
 
 SensorNode::SensorFile::DataEntry SensorNode::sampleAll()
 {
-    Log::info("Sampling all sensors...");
+    LOG_INFO(SENSORS, "Sampling all sensors...");
     for (size_t i{0}; i < nSensors; i++)
     {
         Serial.printf("Starting measurement for %u\n", sensors[i]->getTypeTag());
@@ -163,7 +171,7 @@ SensorNode::SensorFile::DataEntry SensorNode::sampleAll()
 
 SensorNode::SensorFile::DataEntry SensorNode::sampleScheduled(uint32_t cTime)
 {
-    Log::info("Sampling scheduled sensors...");
+    LOG_INFO(SENSORS, "Sampling scheduled sensors...");
     for (size_t i{0}; i < nSensors; i++)
     {
         if (sensors[i]->getNextSampleTime() == cTime)
@@ -211,86 +219,151 @@ void SensorNode::samplePeriod()
 void SensorNode::commPeriod()
 {
     uint32_t cTime{rtc.getSysTime()};
-    if (cTime >= nextCommTime + (SENSOR_DATA_TIMEOUT / 1000))
+    if (cTime >= nextCommTime + COMM_PERIOD_PADDING)
     {
-        Log::error("Too late to start comm period. Skipping and assuming next comm period from "
-                   "given interval.");
+        LOG_ERROR(SENSORS, "Too late to start comm period. Skipping and assuming next comm period "
+                           "from given interval.");
         while (nextCommTime <= cTime)
             nextCommTime += commInterval;
+        linkSpreadingFactor = 0;
+        linkPower = 0;
         return;
     }
+    // the gateway switches to the link it assigned before the comm period as well
+    lora.setLink(linkSpreadingFactor, linkPower);
     MACAddress _gatewayMAC{gatewayMAC}; // avoid access to slow RTC memory
-    Log::info("Communicating with gateway ", _gatewayMAC.toString(), " ...");
+    LOG_INFO(SENSORS, "Communicating with gateway ", _gatewayMAC.toString(), " ...");
     size_t _maxMessages{maxMessages}; // avoid access to slow RTC memory
-    Log::debug("Max messages to send: ", _maxMessages);
+    LOG_DEBUG(SENSORS, "Max messages to send: ", _maxMessages);
     SensorFile file{};
-    bool firstMessage{true};
-    for (size_t i{0}; i < _maxMessages; i++)
+    SensorFile::Iterator it{file.unuploaded()};
+    std::vector<WindowMessage> window;
+    window.reserve(SENSOR_DATA_WINDOW);
+    size_t sent{0};
+    for (uint8_t windowNumber{0}; sent < _maxMessages && it != file.end(); windowNumber++)
     {
-        auto entry = file.getUnuploaded(0);
-        if (!entry)
-            break;
-
-        Message<SENSOR_DATA> message{entry->source, _gatewayMAC, entry->time, entry->flags.nValues,
-                                     entry->values};
-        if ((i == _maxMessages - 1) || (file.isLast(0)))
+        window.clear();
+        while (window.size() < SENSOR_DATA_WINDOW && sent + window.size() < _maxMessages &&
+               it != file.end())
+        {
+            WindowMessage& wm{
+                window.emplace_back(WindowMessage{{lora.getMACAddress(), _gatewayMAC}, {}})};
+            while (it != file.end() &&
+                   wm.message.push(it->time, it->flags.nValues, it->values.data()))
+            {
+                wm.addresses[wm.message.getNEntries() - 1] = it.getAddress();
+                ++it;
+            }
+            LOG_DEBUG(SENSORS, "Packed ", wm.message.getNEntries(), " entries in ",
+                      wm.message.getLength(), " bytes.");
+        }
+        sent += window.size();
+        bool last{sent >= _maxMessages || it == file.end()};
+        for (size_t i{0}; i < window.size(); i++)
+        {
+            window[i].message.setWindow(windowNumber, i, window.size());
+            if (last)
+                window[i].message.setLast();
+        }
+        if (last)
+            LOG_DEBUG(SENSORS, "Last sensor data window...");
+        uint16_t acknowledged{sendWindow(window, windowNumber == 0)};
+        for (size_t i{0}; i < window.size(); i++)
         {
-            Log::debug("Last sensor data message...");
-            message.setLast();
+            if (!(acknowledged & (1 << i)))
+                continue;
+            for (size_t j{0}; j < window[i].message.getNEntries(); j++)
+                file.setUploaded(window[i].addresses[j]);
         }
-        if (sendSensorMessage(message, firstMessage))
-            file.setUploaded();
-        firstMessage = false;
+        if (acknowledged != (1 << window.size()) - 1)
+        {
+            LOG_ERROR(SENSORS, "Error while uploading to gateway.");
+            break;
+        }
+        if (last)
+            return;
+    }
+    if (sent > 0)
+    {
+        LOG_ERROR(SENSORS, "Error while receiving new time config from gateway. Assuming next "
+                           "comm period from given interval.");
+        while (nextCommTime <= rtc.getSysTime())
+            nextCommTime += commInterval;
     }
+    // fall back to the default link, as the gateway does when it misses this node
+    linkSpreadingFactor = 0;
+    linkPower = 0;
 }
 
-bool SensorNode::sendSensorMessage(Message<SENSOR_DATA>& message, bool firstMessage)
+uint16_t SensorNode::sendWindow(std::vector<WindowMessage>& window, bool firstWindow)
 {
-    Log::debug("Sending data message...");
-    if (firstMessage)
-    {
-        lightSleepUntil(nextCommTime);
-        lora.sendMessage(message, 0); // gateway should already be listening for first message
-    }
-    else
-    {
-        lora.sendMessage(message);
-    }
-    Log::debug("Awaiting acknowledgement...");
-    if (!message.isLast())
+    const MACAddress& dest{window.front().message.getDest()};
+    uint16_t pending{static_cast<uint16_t>((1 << window.size()) - 1)};
+    for (size_t attempt{0}; attempt <= SENSOR_DATA_ATTEMPTS && pending != 0; attempt++)
     {
-        auto dataAck{lora.receiveMessage<ACK_DATA>(SENSOR_DATA_TIMEOUT, SENSOR_DATA_ATTEMPTS,
-                                                   message.getDest())};
-        if (dataAck)
+        LOG_DEBUG(SENSORS, "Sending data window ", window.front().message.getWindow(), "...");
+        bool firstMessage{true};
+        // the gateway answers once the message ending the burst was received
+        uint8_t remaining{static_cast<uint8_t>(std::bitset<16>(pending).count())};
+        for (size_t i{0}; i < window.size(); i++)
         {
-            return 1;
+            if (!(pending & (1 << i)))
+                continue;
+            window[i].message.setRemaining(--remaining);
+            if (firstMessage && firstWindow && attempt == 0)
+            {
+                lightSleepUntil(nextCommTime);
+                // gateway should already be listening for first message
+                lora.sendMessage(window[i].message, 0);
+            }
+            else if (firstMessage)
+            {
+                lora.sendMessage(window[i].message);
+            }
+            else
+            {
+                // the gateway only needs to resume listening between messages of a window
+                lora.sendMessage(window[i].message, SENSOR_DATA_BURST_DELAY);
+            }
+            firstMessage = false;
         }
-        else
+        LOG_DEBUG(SENSORS, "Awaiting acknowledgement...");
+        if (!window.front().message.isLast())
         {
-            Log::error("Error while uploading to gateway.");
-            return 0;
+            auto dataAck{lora.receiveMessage<ACK_DATA>(
+                SENSOR_DATA_TIMEOUT(lora.getSpreadingFactor()), 0, dest)};
+            if (dataAck && dataAck->getWindow() == window.front().message.getWindow())
+                pending &= ~dataAck->getReceived();
+            else
+                LOG_ERROR(SENSORS, "No acknowledgement received for data window.");
+            continue;
         }
-    }
-    else
-    {
-        auto timeConfig{lora.receiveMessage<TIME_CONFIG>(TIME_CONFIG_TIMEOUT, TIME_CONFIG_ATTEMPTS,
-                                                         message.getDest())};
-        if (timeConfig)
+        // the final window is acknowledged by the time config ending the comm period
+        auto timeConfig{lora.receiveMessage<TIME_CONFIG>(
+            TIME_CONFIG_TIMEOUT(lora.getSpreadingFactor()), TIME_CONFIG_ATTEMPTS, dest)};
+        if (!timeConfig || timeConfig->getWindow() != window.front().message.getWindow())
         {
-            this->timeConfig(*timeConfig);
-            lora.sendMessage(Message<ACK_TIME>(lora.getMACAddress(), message.getDest()));
-            lora.receiveMessage<REPEAT>(TIME_CONFIG_TIMEOUT, 0, gatewayMAC);
-            return 1;
+            LOG_ERROR(SENSORS, "No time config received for final data window.");
+            continue;
         }
-        else
+        pending &= ~timeConfig->getReceived();
+        if (pending == 0)
         {
-            Log::error("Error while receiving new time config from gateway. Assuming next comm "
-                       "period from given interval.");
-            while (nextCommTime <= rtc.getSysTime())
-                nextCommTime += commInterval;
-            return 0;
+            this->timeConfig(*timeConfig);
+            lora.sendMessage(Message<ACK_TIME>(lora.getMACAddress(), dest));
+            lora.receiveMessage<REPEAT>(TIME_CONFIG_TIMEOUT(lora.getSpreadingFactor()), 0, dest);
+            if (lora.getRepeatsAnswered() > 0)
+            {
+                // the gateway missed the ack at first, and only switches to the new link if it
+                // did not: stay on the default link with it
+                LOG_INFO(SENSORS, "Time config acknowledged after a REPEAT, keeping the default "
+                                  "link.");
+                linkSpreadingFactor = 0;
+                linkPower = 0;
+            }
         }
     }
+    return static_cast<uint16_t>(((1 << window.size()) - 1) & ~pending);
 }
 
 CommandCode SensorNode::Commands::discovery()
@@ -70,16 +70,24 @@ private:
     /// @brief Initiates a sampling period.
     void samplePeriod();
 
-    /// @brief Uploads sensor data messages to the gateway, and marks them as uploaded if
+    /// @brief Uploads the unuploaded sensor data entries to the gateway, packing as many of them
+    /// as fit in every message and sending the messages in windows, and marks them as uploaded if
     /// successful.
     void commPeriod();
-    /// @brief Sends a single sensor message to the gateway, handling both acknowledgement and, if
-    /// it is the last message, time configuration.
-    /// @param message The message to send.
-    /// @param dest The gateway MAC address.
-    /// @param firstMessage Whether the message is the first in the 'conversation' or not.
-    /// @return Whether the sent message was successfully acknowledged or not.
-    bool sendSensorMessage(Message<SENSOR_DATA>& message, bool firstMessage);
+    /// @brief Sensor data message of a window, along with the addresses of the entries it packs.
+    struct WindowMessage
+    {
+        Message<SENSOR_BATCH> message;
+        std::array<size_t, Message<SENSOR_BATCH>::maxNEntries> addresses;
+    };
+    static_assert(SENSOR_DATA_WINDOW <= Message<SENSOR_BATCH>::maxWindowSize);
+    /// @brief Sends a window of sensor messages to the gateway back to back, and resends the
+    /// messages that the gateway's acknowledgement reports missing. The final window is
+    /// acknowledged by the time config message, which is applied once all messages are received.
+    /// @param window The messages of the window.
+    /// @param firstWindow Whether the window is the first in the 'conversation' or not.
+    /// @return Bitmap of the messages of the window acknowledged by the gateway.
+    uint16_t sendWindow(std::vector<WindowMessage>& window, bool firstWindow);
 
     std::array<std::unique_ptr<Sensor>, MAX_SENSORS> sensors;
     size_t nSensors{0};
@@ -26,10 +26,8 @@ void setup(void)
 
     printf("AFTER COMMIT:\n");
     {
-        fs::NVS nvs{"logs"};
-
-        printf("tail: %u, size: %u, head: %u\n", size_t(nvs.getValue<size_t>("tail", 0)),
-               size_t(nvs.getValue<size_t>("size", 0)), size_t(nvs.getValue<size_t>("head", 0)));
+        Log::File file{};
+        printf("size: %u, max size: %u\n", file.getSize(), file.getMaxSize());
     }
 
     // Restart module
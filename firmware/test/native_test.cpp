@@ -0,0 +1,506 @@
+#include "../gateway/adr.h"
+#include "Commands.h"
+#include "CommunicationCommon.h"
+#include "LogExport.h"
+#include "NativeFlash.h"
+#include "logging.h"
+#include <bitset>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <nvs_flash.h>
+#include <string>
+#include <vector>
+
+// Regression checks of the radio protocol, the adaptive data rate of the gateway, the binary log
+// records and the command parser, run on the host. Every failed check is reported, and fails the
+// run.
+
+using namespace mirra;
+
+namespace
+{
+/// @brief Retries of a window of sensor data (see SENSOR_DATA_ATTEMPTS in gateway/config.h).
+constexpr size_t dataAttempts = 1;
+/// @brief Messages per window (see SENSOR_DATA_WINDOW in sensor_node/config.h).
+constexpr size_t windowSize = 4;
+/// @brief Link adaptation of the gateway (see Node::adaptLink and gateway/config.h).
+constexpr LinkAdaptation adaptation{7, 9, 2, 14, 10, 3};
+/// @brief Default link of the firmware (see LORA_SPREADING_FACTOR and LORA_POWER).
+constexpr uint8_t defaultSpreadingFactor = 7;
+constexpr int8_t defaultPower = 10;
+
+size_t failures{0};
+
+void check(bool condition, const char* expression, int line)
+{
+    if (condition)
+        return;
+    printf("  FAILED line %d: %s\n", line, expression);
+    failures++;
+}
+#define CHECK(...) check(__VA_ARGS__, #__VA_ARGS__, __LINE__)
+
+MACAddress createMAC(size_t index)
+{
+    uint8_t address[MACAddress::length]{0x24, 0x0A, 0xC4, 0x00, 0x00, static_cast<uint8_t>(index)};
+    return MACAddress(address);
+}
+
+/// @brief Copies a message as it is sent: only its length is on air.
+template <class T> std::array<uint8_t, MessageHeader::maxLength> transmit(const T& message)
+{
+    std::array<uint8_t, MessageHeader::maxLength> frame{};
+    std::memcpy(frame.data(), message.toData(), message.getLength());
+    return frame;
+}
+
+/// @brief Packs entries of every size into batches and unpacks them on the other end.
+void batchCodec()
+{
+    printf("protocol: sensor data batches\n");
+    for (uint8_t nValues : {0, 1, 3, 8, 20, static_cast<int>(Message<SENSOR_DATA>::maxNValues)})
+    {
+        Message<SENSOR_BATCH> batch{createMAC(1), createMAC(0)};
+        std::vector<std::array<SensorValue, Message<SENSOR_DATA>::maxNValues>> entries;
+        while (true)
+        {
+            auto& values{entries.emplace_back()};
+            for (uint8_t i{0}; i < nValues; i++)
+                values[i] = SensorValue(i, entries.size(), 100.0f * entries.size() + i);
+            if (!batch.push(1000 + entries.size(), nValues, values.data()))
+                break;
+        }
+        entries.pop_back();
+        CHECK(entries.size() == Message<SENSOR_BATCH>::getEntriesPerBatch(nValues));
+        CHECK(batch.getNEntries() == entries.size());
+        CHECK(batch.getLength() <= MessageHeader::maxLength);
+        batch.setWindow(3, 2, windowSize);
+        batch.setRemaining(1);
+        batch.setLast();
+
+        auto frame{transmit(batch)};
+        const Message<SENSOR_BATCH>& received{Message<SENSOR_BATCH>::fromData(frame.data())};
+        CHECK(received.isValid());
+        CHECK(received.getWindow() == 3 && received.getSequence() == 2);
+        CHECK(received.getWindowSize() == windowSize && received.getRemaining() == 1);
+        CHECK(received.isLast());
+        CHECK(received.getNEntries() == entries.size());
+        size_t offset{0};
+        for (size_t i{0}; i < entries.size(); i++)
+        {
+            auto entry{received.getEntry(offset)};
+            CHECK(entry && entry->getSource() == createMAC(1));
+            CHECK(entry && entry->time == 1001 + i && entry->nValues == nValues);
+            CHECK(entry && std::memcmp(entry->values.data(), entries[i].data(),
+                                       nValues * sizeof(SensorValue)) == 0);
+        }
+        CHECK(!received.getEntry(offset));
+    }
+
+    // entries running past the batch, or holding too many values, are malformed
+    Message<SENSOR_BATCH> batch{createMAC(1), createMAC(0)};
+    std::array<SensorValue, 8> values{};
+    batch.push(1000, values.size(), values.data());
+    batch.push(1001, values.size(), values.data());
+    auto frame{transmit(batch)};
+    constexpr size_t entriesOffset{MessageHeader::headerLength +
+                                   Message<SENSOR_DATA>::batchFieldsLength};
+    constexpr size_t sizeOffset{MessageHeader::headerLength + 1};
+    frame[entriesOffset + sizeof(uint32_t)] = Message<SENSOR_DATA>::maxNValues + 1;
+    size_t offset{0};
+    CHECK(!Message<SENSOR_BATCH>::fromData(frame.data()).getEntry(offset));
+    frame = transmit(batch);
+    frame[sizeOffset]--;
+    offset = 0;
+    CHECK(Message<SENSOR_BATCH>::fromData(frame.data()).getEntry(offset).has_value());
+    CHECK(!Message<SENSOR_BATCH>::fromData(frame.data()).getEntry(offset));
+    frame[sizeOffset] = 0xFF;
+    CHECK(Message<SENSOR_BATCH>::fromData(frame.data()).getLength() <= MessageHeader::maxLength);
+
+    Message<TIME_CONFIG> timeConfig{createMAC(0), createMAC(1), 1, 2, 3, 4, 5, 6, 7};
+    timeConfig.setReceived(3, 0b1011);
+    timeConfig.setLink(9, -1);
+    frame = transmit(timeConfig);
+    const Message<TIME_CONFIG>& config{Message<TIME_CONFIG>::fromData(frame.data())};
+    CHECK(config.getCommTime() == 6 && config.getMaxMessages() == 7);
+    CHECK(config.getWindow() == 3 && config.getReceived() == 0b1011);
+    CHECK(config.getSpreadingFactor() == 9 && config.getPower() == -1);
+}
+
+/// @brief Outcome of a window sent by a node.
+struct Exchange
+{
+    /// @brief Bitmap of the messages acknowledged to the node.
+    uint16_t acknowledged{0};
+    /// @brief Bitmap of the messages whose entries the gateway unpacked.
+    uint16_t unpacked{0};
+    /// @brief Amount of messages unpacked more than once.
+    size_t duplicates{0};
+    /// @brief Amount of acknowledgements sent while the node was still sending its burst.
+    size_t collisions{0};
+};
+
+/// @brief Sends a window of messages that is not the final one of the comm period, following
+/// sendWindow on the node and nodeCommPeriod on the gateway. Transmissions are lost when their bit
+/// is set in the loss pattern, in order of transmission. Acknowledgements sent while the node is
+/// still sending are lost as well, along with the rest of the burst.
+Exchange sendWindow(uint32_t losses)
+{
+    std::vector<Message<SENSOR_BATCH>> window(windowSize, {createMAC(1), createMAC(0)});
+    for (size_t i{0}; i < windowSize; i++)
+        window[i].setWindow(0, i, windowSize);
+    size_t transmission{0};
+    auto isLost = [&losses, &transmission] { return (losses >> transmission++) & 1; };
+
+    Exchange exchange;
+    WindowReceiver receiver;
+    uint16_t pending{(1 << windowSize) - 1};
+    for (size_t attempt{0}; attempt <= dataAttempts && pending != 0; attempt++)
+    {
+        uint8_t remaining{static_cast<uint8_t>(std::bitset<16>(pending).count())};
+        bool answering{false};
+        bool collision{false};
+        for (size_t i{0}; i < windowSize; i++)
+        {
+            if (!(pending & (1 << i)))
+                continue;
+            window[i].setRemaining(--remaining);
+            if (isLost() || answering)
+            {
+                collision |= answering;
+                continue;
+            }
+            if (receiver.receive(window[i]))
+            {
+                exchange.duplicates += (exchange.unpacked >> i) & 1;
+                exchange.unpacked |= 1 << i;
+            }
+            answering = receiver.isBurstOver();
+        }
+        // a burst that ended in a lost message is answered after the frame timeout
+        exchange.collisions += collision;
+        auto ack{Message<ACK_DATA>(createMAC(0), createMAC(1), receiver.getWindow(),
+                                   receiver.getReceived())};
+        if (!isLost() && !collision)
+            pending &= ~ack.getReceived();
+    }
+    exchange.acknowledged = ((1 << windowSize) - 1) & ~pending;
+    return exchange;
+}
+
+/// @brief Sends windows under every pattern of lost transmissions.
+void windowExchange()
+{
+    printf("protocol: windows acknowledged by bitmap\n");
+    // every message sent twice and every acknowledgement lost
+    constexpr size_t maxTransmissions{(1 + dataAttempts) * (windowSize + 1)};
+    size_t complete{0};
+    for (uint32_t losses{0}; losses < (1 << maxTransmissions); losses++)
+    {
+        Exchange exchange{sendWindow(losses)};
+        CHECK((exchange.acknowledged & ~exchange.unpacked) == 0);
+        CHECK(exchange.duplicates == 0);
+        CHECK(exchange.collisions == 0);
+        complete += exchange.acknowledged == (1 << windowSize) - 1;
+    }
+    // the acknowledgement of the first burst is lost: the node resends the whole window, which the
+    // gateway only answers once the burst is over
+    CHECK(sendWindow(1 << windowSize).acknowledged == (1 << windowSize) - 1);
+    CHECK(sendWindow(1 << windowSize).unpacked == (1 << windowSize) - 1);
+    printf("  %zu of %u loss patterns acknowledged the whole window\n", complete,
+           1 << maxTransmissions);
+
+    // messages of a new window start it anew
+    WindowReceiver receiver;
+    Message<SENSOR_BATCH> message{createMAC(1), createMAC(0)};
+    message.setWindow(0, 1, 2);
+    message.setRemaining(1);
+    CHECK(receiver.receive(message) && !receiver.isBurstOver() && !receiver.isComplete());
+    message.setWindow(0, 0, 2);
+    message.setRemaining(0);
+    CHECK(receiver.receive(message) && receiver.isBurstOver() && receiver.isComplete());
+    CHECK(!receiver.receive(message));
+    message.setWindow(1, 0, 3);
+    message.setLast();
+    CHECK(receiver.receive(message) && receiver.getWindow() == 1);
+    CHECK(receiver.getReceived() == 0b001 && !receiver.isComplete() && receiver.isLast());
+}
+
+/// @return The lowest SNR at which the spreading factor is still demodulated (see
+/// LoRaModule::getRequiredSNR).
+float getRequiredSNR(uint8_t spreadingFactor) { return -5.0f - 2.5f * (spreadingFactor - 6); }
+
+/// @brief Adapts links of every quality over successive comm periods.
+void linkAdaptation()
+{
+    printf("adaptive data rate\n");
+    // a link exactly at the margin is kept
+    CHECK(adaptation.adapt(8, 5, adaptation.margin) == std::make_pair<uint8_t, int8_t>(8, 5));
+    // strong links speed up first, then lower their power
+    CHECK(adaptation.adapt(9, 14, 40) == std::make_pair<uint8_t, int8_t>(7, 2));
+    CHECK(adaptation.adapt(9, 14, adaptation.margin + 3) == std::make_pair<uint8_t, int8_t>(8, 14));
+    // weak links raise their power first, then slow down
+    CHECK(adaptation.adapt(7, 10, 0) == std::make_pair<uint8_t, int8_t>(9, 14));
+    CHECK(adaptation.adapt(7, 10, adaptation.margin - 1) ==
+          std::make_pair<uint8_t, int8_t>(7, 13));
+    for (uint8_t sf{adaptation.minSpreadingFactor}; sf <= adaptation.maxSpreadingFactor; sf++)
+    {
+        for (int8_t power{adaptation.minPower}; power <= adaptation.maxPower; power++)
+        {
+            for (float headroom{-40}; headroom <= 40; headroom += 0.5f)
+            {
+                auto [nextSF, nextPower]{adaptation.adapt(sf, power, headroom)};
+                CHECK(nextSF >= adaptation.minSpreadingFactor &&
+                      nextSF <= adaptation.maxSpreadingFactor);
+                CHECK(nextPower >= adaptation.minPower && nextPower <= adaptation.maxPower);
+            }
+        }
+    }
+    // the SNR of a node follows its output power: the link settles within a few comm periods, on
+    // a link keeping the margin unless the most robust one does not
+    for (float snr{-20}; snr <= 20; snr += 0.25f)
+    {
+        uint8_t sf{defaultSpreadingFactor};
+        int8_t power{defaultPower};
+        auto measure = [&] { return snr + (power - defaultPower); };
+        for (size_t period{0}; period < 4; period++)
+            std::tie(sf, power) = adaptation.adapt(sf, power, measure() - getRequiredSNR(sf));
+        auto next{adaptation.adapt(sf, power, measure() - getRequiredSNR(sf))};
+        CHECK(next == std::make_pair(sf, power));
+        CHECK(measure() - getRequiredSNR(sf) >= adaptation.margin ||
+              (sf == adaptation.maxSpreadingFactor && power == adaptation.maxPower));
+    }
+}
+
+/// @brief Captures the messages printed by the log.
+class Capture : public HardwareSerial
+{
+public:
+    std::string output;
+    using HardwareSerial::write;
+    size_t write(const uint8_t* buffer, size_t size) override
+    {
+        output.append(reinterpret_cast<const char*>(buffer), size);
+        return size;
+    }
+};
+
+/// @brief Stores messages as binary records and formats them as they were printed.
+void logRecords()
+{
+    printf("log: binary records\n");
+    native::resetPartition("logs");
+    Log& log{Log::getInstance()};
+    Capture capture;
+    log.serial = &capture;
+    log.flush();
+    size_t start{log.file.getSize()};
+
+    enum class Module : uint8_t
+    {
+        FS = 2
+    };
+    std::string longString(300, 'x');
+    char ramString[]{"in RAM"};
+    log.print<Log::Level::INFO>(nullptr, "Sensor data received from ", createMAC(1).toString(),
+                                " with length ", 237u, " holding ", static_cast<uint8_t>(4),
+                                " entries at SNR ", -7.25f, " dB");
+    log.print<Log::Level::ERROR>(nullptr, "Error ", -12, " in module ", Module::FS, ": '", 'x',
+                                 "' ", ramString, " ", static_cast<const char*>(nullptr));
+    log.print<Log::Level::DEBUG>(nullptr, "Long: ", longString.c_str(), " cut");
+    log.print<Log::Level::INFO>(nullptr, "");
+    Log::Site site{__FILE__, __LINE__};
+    for (size_t i{0}; i < 3; i++)
+        log.print<Log::Level::INFO>(&site, "Repeated ", 1u);
+    log.flush();
+
+    std::vector<std::string> printed;
+    for (size_t begin{0}, end; (end = capture.output.find('\n', begin)) != std::string::npos;
+         begin = end + 1)
+        printed.push_back(capture.output.substr(begin, end + 1 - begin));
+    CHECK(printed.size() == 6);
+    CHECK(printed.back().find("Last message repeated 2 times.") != std::string::npos);
+
+    std::vector<size_t> addresses;
+    size_t index{0};
+    for (size_t address{start}; address < log.file.getSize(); index++)
+    {
+        addresses.push_back(address);
+        char buffer[Log::bufferSize];
+        size_t length;
+        size_t size{log.file.decode(address, buffer, length)};
+        CHECK(size > sizeof(Log::RecordHeader) && size <= Log::maxRecordSize);
+        CHECK(length <= Log::bufferSize && buffer[length - 1] == '\n');
+        if (size == 0 || index >= printed.size())
+            break;
+        // records cut short hold the start of the message
+        std::string line(buffer, length - 1);
+        CHECK(printed[index].compare(0, line.size(), line) == 0);
+        if (index != 2)
+            CHECK(line.size() + 1 == printed[index].size());
+        address += size;
+    }
+    CHECK(index == printed.size());
+    // records are walked back from their trailers
+    for (size_t i{addresses.size()}, address{log.file.getSize()}; i > 0; i--)
+    {
+        address = log.file.getPrevious(address);
+        CHECK(address == addresses[i - 1]);
+    }
+    log.serial = nullptr;
+}
+
+/// @brief Commands sharing aliases like those of MIRRAModule::Commands (see MIRRAModule.h), which
+/// record the overload called.
+struct ModuleCommands : CommonCommands
+{
+    std::string called;
+
+    CommandCode setLogLevel(const char* level)
+    {
+        called = std::string("setLogLevel ") + level;
+        return COMMAND_SUCCESS;
+    }
+    CommandCode setModuleLogLevel(const char* module, const char* level)
+    {
+        called = std::string("setModuleLogLevel ") + module + " " + level;
+        return COMMAND_SUCCESS;
+    }
+    CommandCode printLogs()
+    {
+        called = "printLogs";
+        return COMMAND_SUCCESS;
+    }
+    CommandCode printLogsLevel(const char* level)
+    {
+        called = std::string("printLogsLevel ") + level;
+        return COMMAND_SUCCESS;
+    }
+    CommandCode printLogsRange(const char* level, uint32_t from, uint32_t to)
+    {
+        called = std::string("printLogsRange ") + level + " " + std::to_string(from) + " " +
+                 std::to_string(to);
+        return COMMAND_SUCCESS;
+    }
+    CommandCode exportLogs()
+    {
+        called = "exportLogs";
+        return COMMAND_SUCCESS;
+    }
+    CommandCode exportLogsBaud(uint32_t baudRate)
+    {
+        called = "exportLogsBaud " + std::to_string(baudRate);
+        return COMMAND_SUCCESS;
+    }
+    CommandCode exportLogsFrom(uint32_t baudRate, uint32_t position)
+    {
+        called = "exportLogsFrom " + std::to_string(baudRate) + " " + std::to_string(position);
+        return COMMAND_SUCCESS;
+    }
+    CommandCode printDataRange(uint32_t from, uint32_t to)
+    {
+        called = "printDataRange " + std::to_string(from) + " " + std::to_string(to);
+        return COMMAND_SUCCESS;
+    }
+    CommandCode printData()
+    {
+        called = "printData";
+        return COMMAND_SUCCESS;
+    }
+
+    static constexpr auto getCommands()
+    {
+        return std::tuple_cat(
+            CommonCommands::getCommands(),
+            std::make_tuple(
+                CommandAliasesPair(&ModuleCommands::setModuleLogLevel, "setlog", "setloglevel"),
+                CommandAliasesPair(&ModuleCommands::setLogLevel, "setlog", "setloglevel"),
+                CommandAliasesPair(&ModuleCommands::printLogsRange, "printlog", "printlogs",
+                                   "printlogfile"),
+                CommandAliasesPair(&ModuleCommands::printLogsLevel, "printlog", "printlogs",
+                                   "printlogfile"),
+                CommandAliasesPair(&ModuleCommands::printLogs, "printlog", "printlogs",
+                                   "printlogfile"),
+                CommandAliasesPair(&ModuleCommands::exportLogsFrom, "exportlog", "exportlogs"),
+                CommandAliasesPair(&ModuleCommands::exportLogsBaud, "exportlog", "exportlogs"),
+                CommandAliasesPair(&ModuleCommands::exportLogs, "exportlog", "exportlogs"),
+                CommandAliasesPair(&ModuleCommands::printDataRange, "printdata", "printdatafile"),
+                CommandAliasesPair(&ModuleCommands::printData, "printdata", "printdatafile")));
+    }
+};
+
+/// @brief Commands of which two can never be reached.
+struct AmbiguousCommands : ModuleCommands
+{
+    static constexpr auto getCommands()
+    {
+        return std::tuple_cat(ModuleCommands::getCommands(),
+                              std::make_tuple(CommandAliasesPair(&ModuleCommands::printData,
+                                                                 "printdatafile")));
+    }
+};
+
+/// @return The overload called by the command line, empty if none was.
+std::string parse(ModuleCommands& commands, const char* line)
+{
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "%s", line);
+    commands.called.clear();
+    CommandParser().parseLine(buffer, commands);
+    return commands.called;
+}
+
+/// @brief Calls every overload of the commands sharing an alias.
+void commandAliases()
+{
+    printf("commands: shared aliases\n");
+    CHECK(CommandParser::isUnambiguous<ModuleCommands>());
+    CHECK(!CommandParser::isUnambiguous<AmbiguousCommands>());
+    ModuleCommands commands;
+    CHECK(parse(commands, "setlog DEBUG") == "setLogLevel DEBUG");
+    CHECK(parse(commands, "setloglevel ERROR") == "setLogLevel ERROR");
+    CHECK(parse(commands, "setlog LORA DEBUG") == "setModuleLogLevel LORA DEBUG");
+    CHECK(parse(commands, "setloglevel FS INFO") == "setModuleLogLevel FS INFO");
+    CHECK(parse(commands, "setlog").empty());
+    CHECK(parse(commands, "printlog") == "printLogs");
+    CHECK(parse(commands, "printlog ERROR") == "printLogsLevel ERROR");
+    CHECK(parse(commands, "printlogfile INFO") == "printLogsLevel INFO");
+    CHECK(parse(commands, "printlogs DEBUG 100 200") == "printLogsRange DEBUG 100 200");
+    // a level and a single time falls back to the level alone
+    CHECK(parse(commands, "printlog INFO 100") == "printLogsLevel INFO");
+    CHECK(parse(commands, "exportlog") == "exportLogs");
+    CHECK(parse(commands, "exportlogs 460800") == "exportLogsBaud 460800");
+    CHECK(parse(commands, "exportlog 460800 8192") == "exportLogsFrom 460800 8192");
+    // as sent by the host-side tool (see tools/logexport.cpp)
+    char command[64];
+    logexport::formatCommand(command, sizeof(command), 460800, std::nullopt);
+    CHECK(parse(commands, command) == "exportLogsBaud 460800");
+    logexport::formatCommand(command, sizeof(command), logexport::defaultBaudRate, 8192);
+    CHECK(parse(commands, command) == "exportLogsFrom 921600 8192");
+    CHECK(parse(commands, "printdata") == "printData");
+    CHECK(parse(commands, "printdatafile\r\n") == "printData");
+    CHECK(parse(commands, "printdata 100 200") == "printDataRange 100 200");
+    CHECK(parse(commands, "printdata  100   200 ") == "printDataRange 100 200");
+    // surplus arguments are ignored by the overload taking the most
+    CHECK(parse(commands, "printdata 100") == "printData");
+    CHECK(parse(commands, "printdata 100 200 300") == "printDataRange 100 200");
+    // arguments that do not parse call nothing
+    CHECK(parse(commands, "printdata 100 x").empty());
+    CHECK(parse(commands, "print 100 200").empty());
+}
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        native::setFlashDirectory(argv[1]);
+    fs::NVS::init();
+    batchCodec();
+    windowExchange();
+    linkAdaptation();
+    logRecords();
+    commandAliases();
+    printf(failures == 0 ? "all checks passed\n" : "%zu checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,293 @@
+#include "LogExport.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <optional>
+#include <termios.h>
+#include <unistd.h>
+
+// Host-side counterpart of the `exportlog` command: requests a compressed log export from a module
+// in command phase over its serial port, or decodes an export captured to a file, and writes the
+// decompressed log lines to the output. Interrupted exports are resumed with -r.
+
+using namespace mirra;
+
+namespace
+{
+/// @brief Baud rate of the command line interface.
+constexpr uint32_t commandBaudRate = 115200;
+/// @brief Time the module is given to answer, and the maximum silence during the export.
+constexpr int timeout = 5; // s
+/// @brief Maximum amount of bytes skipped looking for the first frame.
+constexpr size_t maxSkipped = 64 * 1024;
+
+void printUsage(const char* program)
+{
+    std::fprintf(stderr,
+                 "Usage: %s [-b BAUD] [-r POSITION] [-o OUTPUT] PORT\n"
+                 "       %s [-o OUTPUT] -f CAPTURE\n"
+                 "  PORT      serial port of a module in command phase\n"
+                 "  -b BAUD   baud rate of the export (default: %u)\n"
+                 "  -r POS    resume an interrupted export from the reported position, appending\n"
+                 "            to the output\n"
+                 "  -o OUTPUT file the log lines are written to (default: standard output)\n"
+                 "  -f FILE   decodes an export captured to a file instead\n",
+                 program, program, logexport::defaultBaudRate);
+}
+
+std::optional<speed_t> toSpeed(uint32_t baudRate)
+{
+    switch (baudRate)
+    {
+    case 115200:
+        return B115200;
+    case 230400:
+        return B230400;
+#ifdef B460800
+    case 460800:
+        return B460800;
+#endif
+#ifdef B921600
+    case 921600:
+        return B921600;
+#endif
+#ifdef B1500000
+    case 1500000:
+        return B1500000;
+#endif
+#ifdef B2000000
+    case 2000000:
+        return B2000000;
+#endif
+    default:
+        return std::nullopt;
+    }
+}
+
+bool setBaudRate(int port, speed_t speed)
+{
+    termios options;
+    if (tcgetattr(port, &options) != 0)
+        return false;
+    cfmakeraw(&options);
+    options.c_cflag |= CLOCAL | CREAD;
+    options.c_cflag &= ~CRTSCTS;
+    // reads return after the timeout if no data arrives, which ends the stream
+    options.c_cc[VMIN] = 0;
+    options.c_cc[VTIME] = timeout * 10;
+    cfsetispeed(&options, speed);
+    cfsetospeed(&options, speed);
+    return tcsetattr(port, TCSANOW, &options) == 0;
+}
+
+/// @brief Sends the export command to the module and switches to the baud rate of the export once
+/// the module acknowledges it.
+/// @param position Position to resume the export from, std::nullopt to start from the beginning.
+/// @return Whether the module started the export.
+bool startExport(int port, std::optional<uint32_t> position, uint32_t baudRate, speed_t speed)
+{
+    if (!setBaudRate(port, *toSpeed(commandBaudRate)))
+        return false;
+    tcflush(port, TCIOFLUSH);
+    char command[64];
+    int length{logexport::formatCommand(command, sizeof(command), baudRate, position)};
+    if (write(port, command, length) != length)
+        return false;
+    // wait for the acknowledgement, echoed command and all, to end with a newline
+    const char* acknowledgement{"Exporting logs"};
+    char line[256];
+    size_t lineLength{0};
+    bool acknowledged{false};
+    std::time_t start{std::time(nullptr)};
+    while (std::time(nullptr) - start < timeout)
+    {
+        char c;
+        if (read(port, &c, 1) != 1)
+            break;
+        if (c == '\n')
+        {
+            line[lineLength] = '\0';
+            if (acknowledged)
+                break;
+            if (std::strstr(line, "not found") != nullptr)
+                return false;
+            lineLength = 0;
+            continue;
+        }
+        if (lineLength < sizeof(line) - 1)
+            line[lineLength++] = c;
+        line[lineLength] = '\0';
+        acknowledged = acknowledged || std::strstr(line, acknowledgement) != nullptr;
+    }
+    if (!acknowledged)
+        return false;
+    // give the module the time to switch as well
+    usleep(100 * 1000);
+    if (!setBaudRate(port, speed))
+        return false;
+    tcflush(port, TCIFLUSH);
+    return write(port, "\n", 1) == 1;
+}
+
+/// @brief Reads the frames of an export, writing their log lines to the output.
+/// @param position Set to the position to resume from after the last frame read intact.
+/// @return Whether the export was read up to its end.
+bool readExport(std::FILE* input, std::FILE* output, std::optional<uint32_t>& position)
+{
+    static uint8_t frame[logexport::maxFrameSize];
+    static uint8_t block[logexport::blockSize];
+    uint32_t magic{0};
+    size_t skipped{0};
+    size_t exported{0};
+    while (true)
+    {
+        // frames follow each other directly, but the first one may be preceded by noise
+        while (magic != logexport::frameMagic)
+        {
+            int c{std::fgetc(input)};
+            if (c == EOF || skipped++ > maxSkipped)
+                return false;
+            magic = (magic >> 8) | (static_cast<uint32_t>(c) << 24);
+        }
+        magic = 0;
+        skipped = 0;
+        logexport::FrameHeader header;
+        std::memcpy(&header, &logexport::frameMagic, sizeof(header.magic));
+        size_t rest{sizeof(header) - sizeof(header.magic)};
+        if (std::fread(reinterpret_cast<uint8_t*>(&header) + sizeof(header.magic), 1, rest,
+                       input) != rest)
+            return false;
+        if (header.rawSize > logexport::blockSize || header.size > header.rawSize)
+        {
+            std::fprintf(stderr, "\nCorrupted frame header.\n");
+            return false;
+        }
+        std::memcpy(frame, &header, sizeof(header));
+        uint32_t crc;
+        if (std::fread(&frame[sizeof(header)], 1, header.size, input) != header.size ||
+            std::fread(&crc, 1, sizeof(crc), input) != sizeof(crc))
+            return false;
+        if (crc != logexport::crc32(frame, sizeof(header) + header.size))
+        {
+            std::fprintf(stderr, "\nCRC mismatch.\n");
+            return false;
+        }
+        const uint8_t* text{&frame[sizeof(header)]};
+        if (header.size < header.rawSize)
+        {
+            auto size{logexport::decompress(text, header.size, block, sizeof(block))};
+            if (!size || *size != header.rawSize)
+            {
+                std::fprintf(stderr, "\nCorrupted frame data.\n");
+                return false;
+            }
+            text = block;
+        }
+        std::fwrite(text, 1, header.rawSize, output);
+        position = static_cast<uint32_t>(header.resume);
+        exported += header.rawSize;
+        std::fprintf(stderr, "\r%zu KB exported, %u KB remaining.", exported / 1024,
+                     header.remaining / 1024);
+        if (header.rawSize == 0)
+        {
+            std::fprintf(stderr, "\n");
+            return true;
+        }
+    }
+}
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t baudRate{logexport::defaultBaudRate};
+    std::optional<uint32_t> position;
+    const char* outputPath{nullptr};
+    const char* capturePath{nullptr};
+    int option;
+    while ((option = getopt(argc, argv, "b:r:o:f:h")) != -1)
+    {
+        switch (option)
+        {
+        case 'b':
+            baudRate = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'r':
+            position = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'o':
+            outputPath = optarg;
+            break;
+        case 'f':
+            capturePath = optarg;
+            break;
+        default:
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if ((capturePath == nullptr) == (optind >= argc))
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::FILE* input;
+    if (capturePath != nullptr)
+    {
+        input = std::fopen(capturePath, "rb");
+        if (input == nullptr)
+        {
+            std::fprintf(stderr, "Could not open '%s': %s\n", capturePath, std::strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        auto speed{toSpeed(baudRate)};
+        if (!speed)
+        {
+            std::fprintf(stderr, "Baud rate %u is not supported on this host.\n", baudRate);
+            return EXIT_FAILURE;
+        }
+        int port{open(argv[optind], O_RDWR | O_NOCTTY)};
+        if (port < 0)
+        {
+            std::fprintf(stderr, "Could not open '%s': %s\n", argv[optind], std::strerror(errno));
+            return EXIT_FAILURE;
+        }
+        if (!startExport(port, position, baudRate, *speed))
+        {
+            std::fprintf(stderr, "The module did not start the export. Is it in command phase?\n");
+            close(port);
+            return EXIT_FAILURE;
+        }
+        input = fdopen(port, "rb");
+    }
+    // resumed exports are appended to the lines exported before
+    std::FILE* output{stdout};
+    if (outputPath != nullptr)
+        output = std::fopen(outputPath, position ? "ab" : "wb");
+    if (output == nullptr)
+    {
+        std::fprintf(stderr, "Could not open '%s': %s\n", outputPath, std::strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    std::optional<uint32_t> resume{position};
+    bool complete{readExport(input, output, resume)};
+    std::fclose(input);
+    if (output != stdout)
+        std::fclose(output);
+    if (!complete)
+    {
+        if (resume)
+            std::fprintf(stderr, "\nExport interrupted, resume it with: -r %u\n", *resume);
+        else
+            std::fprintf(stderr, "\nExport interrupted before its first frame.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
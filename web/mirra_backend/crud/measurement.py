@@ -13,6 +13,15 @@ from .sensor import get_sensor
 
 log = logging.getLogger(__name__)
 
+# flags of an uploaded entry, see SensorFile::DataEntry::Flags in the firmware
+AGGREGATE_FLAG = 0x80
+# instance tags of the values of an aggregate, see SensorFile::Statistic in the firmware
+STATISTIC_SHIFT = 6
+STATISTIC_MEAN = 2
+DAILY_TAG = 1 << 5
+HOUR = 60 * 60
+DAY = 24 * HOUR
+
 
 async def add_measurement(
     session: AsyncSession,
@@ -51,35 +60,54 @@ async def process_measurement(
     Message format:
     `[mac 6]:[timestamp 4]:[flags 1]:[sensorvalue_1 6]:...[sensorvalue_n 6]`
 
+    The flags hold the amount of sensor values in their lower 6 bits, and whether the message is
+    an aggregate in their highest bit.
+
     Each sensorvalue has the following format:
-    `[sensor_id 2]:[data 4 (float)]`
+    `[sensor_id 1]:[instance_tag 1]:[data 4 (float)]`
+
+    Aggregates replace samples the node had to compact before it could upload them. They hold the
+    minimum, mean and maximum (or only the mean) of every sensor over the hour or day starting at
+    the timestamp, marked in the upper bits of the instance tag. As measurements hold a single
+    value per sensor and timestamp, only the mean is stored, in the middle of the hour or day.
     """
     payload = payload[6:]  # skip over mac
     timestamp: int = struct.unpack("I", payload[:4])[0]
+    flags: int = payload[4]
     payload = payload[5:]  # skip over timestamp, flags
-    log.info(f"sensor message: {gateway_mac}-{node_mac}-{timestamp}")
+    aggregate = bool(flags & AGGREGATE_FLAG)
+    log.info(
+        f"sensor message: {gateway_mac}-{node_mac}-{timestamp}"
+        + (" (aggregate)" if aggregate else "")
+    )
     instance_tags: dict[int, int] = {}
     while len(payload) > 0:
         sensor_key: int = payload[0]
-        if sensor_key not in instance_tags:
-            instance_tags[sensor_key] = 0
-
+        instance_tag: int = payload[1]
         value: float = struct.unpack("f", payload[2:6])[0]
-        log.info(f"    sensor value: {sensor_key}-{instance_tags[sensor_key]}: {value}")
+        payload = payload[6:]  # skip over sensorvalue
+
+        value_timestamp = timestamp
+        if aggregate:
+            if instance_tag >> STATISTIC_SHIFT != STATISTIC_MEAN:
+                continue
+            instance = instance_tag & (DAILY_TAG - 1)
+            value_timestamp += (DAY if instance_tag & DAILY_TAG else HOUR) // 2
+        else:
+            instance = instance_tags.get(sensor_key, 0)
+            instance_tags[sensor_key] = instance + 1
+        log.info(f"    sensor value: {sensor_key}-{instance}: {value}")
 
         await add_measurement(
             session,
             gateway_mac,
             node_mac,
-            timestamp,
+            value_timestamp,
             sensor_key,
-            instance_tags[sensor_key],
+            instance,
             value,
         )
 
-        instance_tags[sensor_key] += 1
-        payload = payload[6:]  # skip over sensorvalue
-
 
 def process_measurement_sync(gateway_mac, node_mac, payload) -> None:
     return inject_session_sync(process_measurement, gateway_mac, node_mac, payload)
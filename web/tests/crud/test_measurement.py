@@ -2,9 +2,11 @@ import struct
 from random import random
 
 import pytest
+import sqlalchemy as sa
 from conftest import gateway_macs, node_macs
 
 from mirra_backend.crud.measurement import process_measurement
+from mirra_backend.data.measurement import Measurement
 
 
 @pytest.mark.asyncio
@@ -15,3 +17,23 @@ async def test_process_measurement(test_db):
     for sensor_key in range(1, 4):
         payload += struct.pack("Bx", sensor_key) + struct.pack("f", random())
     await process_measurement(test_db, gateway_mac, node_mac, payload)
+
+
+@pytest.mark.asyncio
+async def test_process_measurement_aggregate(test_db):
+    gateway_mac = gateway_macs[0]
+    node_mac = node_macs[0]
+    start = 3600 * 1000
+    # hourly aggregate of sensor 1: minimum, mean and maximum
+    payload = node_mac.to_bytes() + struct.pack("I", start) + struct.pack("B", 0x80 | 3)
+    for statistic, value in ((1, 1.0), (2, 2.0), (3, 3.0)):
+        payload += struct.pack("<BBf", 1, statistic << 6, value)
+    await process_measurement(test_db, gateway_mac, node_mac, payload)
+    measurements = (
+        await test_db.scalars(
+            sa.select(Measurement).where(Measurement.timestamp >= start)
+        )
+    ).all()
+    assert [(m.timestamp, m.sensor_id, m.value) for m in measurements] == [
+        (start + 1800, 1, 2.0)
+    ]